@@ -0,0 +1,169 @@
+/*
+ * clienttable.c - clienttable module, a table of clients keyed by address
+ *
+ * see clienttable.h for more information.
+ *
+ * Team JEN, Winter 2021
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "clienttable.h"
+#include "memory.h"
+
+/**************** local types ****************/
+typedef struct entry {
+  addr_t address;       // the client's address, the key
+  uint32_t hash;        // its hash, to skip most comparisons
+  void *item;
+} entry_t;
+
+/**************** global types ****************/
+typedef struct clienttable {
+  int capacity;         // most entries
+  int count;            // entries in use
+  int mask;             // slots - 1; the number of slots is a power of 2
+  int *slots;           // each 0 if empty, else 1 + an index in 'entries'
+  entry_t *entries;     // in the order inserted
+} clienttable_t;
+
+/**************** local functions ****************/
+/* not visible outside this file */
+static uint32_t hash_address(const addr_t *address);
+static int *find_slot(const clienttable_t *table, const addr_t *address,
+                      const uint32_t hash);
+
+/**************** clienttable_new ****************/
+/* see clienttable.h for documentation */
+clienttable_t *
+clienttable_new(const int capacity)
+{
+  if (capacity <= 0) {
+    return NULL;
+  }
+  // at least twice as many slots as entries, so probes stay short
+  int slots = 1;
+  while (slots < 2 * capacity) {
+    slots *= 2;
+  }
+  clienttable_t *table = count_malloc_assert(sizeof(clienttable_t), "clienttable_t");
+  table->capacity = capacity;
+  table->count = 0;
+  table->mask = slots - 1;
+  table->slots = count_malloc_assert(slots * sizeof(int), "clienttable slots");
+  memset(table->slots, 0, slots * sizeof(int));
+  table->entries = count_malloc_assert(capacity * sizeof(entry_t), "clienttable entries");
+  return table;
+}
+
+/**************** clienttable_insert ****************/
+/* see clienttable.h for documentation */
+bool
+clienttable_insert(clienttable_t *table, const addr_t *address, void *item)
+{
+  if (table == NULL || address == NULL || item == NULL
+      || table->count == table->capacity) {
+    return false;
+  }
+  uint32_t hash = hash_address(address);
+  int *slot = find_slot(table, address, hash);
+  if (*slot != 0) {
+    return false;     // already there
+  }
+  entry_t *entry = &table->entries[table->count++];
+  entry->address = *address;
+  entry->hash = hash;
+  entry->item = item;
+  *slot = table->count;
+  return true;
+}
+
+/**************** clienttable_find ****************/
+/* see clienttable.h for documentation */
+void *
+clienttable_find(const clienttable_t *table, const addr_t *address)
+{
+  if (table == NULL || address == NULL) {
+    return NULL;
+  }
+  int *slot = find_slot(table, address, hash_address(address));
+  return (*slot == 0) ? NULL : table->entries[*slot - 1].item;
+}
+
+/**************** clienttable_iterate ****************/
+/* see clienttable.h for documentation */
+void
+clienttable_iterate(const clienttable_t *table, void *arg,
+                    void (*itemfunc)(void *arg, const addr_t *address, void *item))
+{
+  if (table == NULL || itemfunc == NULL) {
+    return;
+  }
+  for (int i = 0; i < table->count; i++) {
+    itemfunc(arg, &table->entries[i].address, table->entries[i].item);
+  }
+}
+
+/**************** clienttable_delete ****************/
+/* see clienttable.h for documentation */
+void
+clienttable_delete(clienttable_t *table, void (*itemdelete)(void *item))
+{
+  if (table == NULL) {
+    return;
+  }
+  if (itemdelete != NULL) {
+    for (int i = 0; i < table->count; i++) {
+      itemdelete(table->entries[i].item);
+    }
+  }
+  count_free(table->slots);
+  count_free(table->entries);
+  count_free(table);
+}
+
+/***********************************************************************
+ * INTERNAL FUNCTIONS
+ ***********************************************************************/
+
+/**************** hash_address ****************/
+/* Helper method to hash an address: an Internet address and port are
+ * packed into 48 bits and scrambled with one multiply (Fibonacci
+ * hashing); a Unix-domain name is hashed byte by byte (FNV-1a).
+ */
+static uint32_t
+hash_address(const addr_t *address)
+{
+  if (address->sa.sa_family == AF_UNIX) {
+    uint32_t hash = 2166136261u;
+    const unsigned char *p = (const unsigned char *) address->un.sun_path;
+    for (size_t i = 0; i < sizeof(address->un.sun_path); i++) {
+      hash = (hash ^ p[i]) * 16777619u;
+    }
+    return hash;
+  }
+  uint64_t key = ((uint64_t) address->in.sin_addr.s_addr << 16)
+                 | address->in.sin_port;
+  return (uint32_t) ((key * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+/**************** find_slot ****************/
+/* Helper method to find the slot holding an address, or else the empty
+ * slot where it would go: probe from the slot its hash picks, one slot
+ * at a time.  There is always an empty slot, since at most half are full.
+ */
+static int *
+find_slot(const clienttable_t *table, const addr_t *address, const uint32_t hash)
+{
+  int s = hash & table->mask;
+  while (table->slots[s] != 0) {
+    const entry_t *entry = &table->entries[table->slots[s] - 1];
+    if (entry->hash == hash && message_eqAddr(entry->address, *address)) {
+      break;
+    }
+    s = (s + 1) & table->mask;
+  }
+  return &table->slots[s];
+}
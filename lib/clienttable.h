@@ -0,0 +1,85 @@
+/*
+ * clienttable module - a table of clients, keyed by their address
+ *
+ * Maps each client's address (an addr_t, from the message module) to an
+ * item, such as the client's server_player_t.  The key is the address
+ * itself, not a string made from it, so a lookup formats nothing and
+ * allocates nothing, and clients differ whenever their addresses do:
+ * two hosts with the same port, say, or two Unix-domain sockets.
+ *
+ * The table is an array of slots, twice the table's capacity or more,
+ * searched by linear probing from the slot the address hashes to; items
+ * are kept in the order they were inserted, which is the order in which
+ * clienttable_iterate visits them.  Items are never removed; a server
+ * marks a client that leaves as inactive instead.
+ *
+ * Team JEN, Winter 2021
+ */
+
+#ifndef __CLIENTTABLE_H
+#define __CLIENTTABLE_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "message.h"
+
+/**************** global types ****************/
+typedef struct clienttable clienttable_t;  // opaque to users of the module
+
+/**************** functions ****************/
+
+/**************** clienttable_new ****************/
+/* Create a new, empty table.
+ *
+ * Caller provides:
+ *   the most clients it will hold (> 0).
+ * We return:
+ *   pointer to the new table; NULL if error.
+ * Caller is responsible for:
+ *   later calling clienttable_delete.
+ */
+clienttable_t *clienttable_new(const int capacity);
+
+/**************** clienttable_insert ****************/
+/* Insert an item, identified by a client's address, into the table.
+ *
+ * Caller provides:
+ *   valid table, valid address, valid item.
+ * We return:
+ *   false if the address is already in the table, if the table is full,
+ *   or if any parameter is NULL; true otherwise.
+ * Notes:
+ *   The address is copied; the item is not.
+ */
+bool clienttable_insert(clienttable_t *table, const addr_t *address, void *item);
+
+/**************** clienttable_find ****************/
+/* Return the item for a client's address.
+ *
+ * Caller provides:
+ *   valid table, valid address.
+ * We return:
+ *   the item for that address; NULL if there is none, or if either
+ *   parameter is NULL.
+ */
+void *clienttable_find(const clienttable_t *table, const addr_t *address);
+
+/**************** clienttable_iterate ****************/
+/* Call itemfunc with arg on each (address, item) in the table, in the
+ * order they were inserted.
+ *
+ * Caller provides:
+ *   valid table, arbitrary arg, pointer to itemfunc.
+ * We do:
+ *   nothing, if table or itemfunc is NULL.
+ */
+void clienttable_iterate(const clienttable_t *table, void *arg,
+                         void (*itemfunc)(void *arg, const addr_t *address,
+                                          void *item));
+
+/**************** clienttable_delete ****************/
+/* Delete the table, calling itemdelete (if not NULL) on each item.
+ */
+void clienttable_delete(clienttable_t *table, void (*itemdelete)(void *item));
+
+#endif // __CLIENTTABLE_H
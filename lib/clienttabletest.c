@@ -0,0 +1,146 @@
+/*
+ * clienttabletest.c - unit test program for the Nuggets Project's clienttable module
+ *
+ * Code adapted from ringtest.c
+ * Read the README or the TESTING.md file for more information.
+ *
+ * CS50, Team JEN, March 2021
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "clienttable.h"
+#include "memory.h"
+
+// file-local global variables
+static int clienttable_unit_tested = 0;     // number of test cases run
+static int clienttable_unit_failed = 0;     // number of test cases failed
+
+// a macro for shorthand calls to expect()
+#define EXPECT(cond) { unit_expect((cond), __LINE__); }
+
+// Checks 'condition', increments clienttable_unit_tested, prints FAIL or PASS
+void unit_expect(bool condition, int linenum)
+{
+  clienttable_unit_tested++;
+  if (condition) {
+    printf("PASS test %03d at line %d\n", clienttable_unit_tested, linenum);
+  } else {
+    printf("FAIL test %03d at line %d\n", clienttable_unit_tested, linenum);
+    clienttable_unit_failed++;
+  }
+}
+
+static const int Capacity = 26;
+
+// the address of host:port, as message_setAddr would make it
+static addr_t inet(const char *host, const char *port);
+// collects the items clienttable_iterate visits, in order, in a string
+static void collect(void *arg, const addr_t *address, void *item);
+// counts the items clienttable_delete deletes
+static void count(void *item);
+static int deleted = 0;
+
+/* **************************************** */
+int main()
+{
+  printf("starting unit test for clienttable...\n");
+  char items[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+  addr_t a = inet("127.0.0.1", "5000");
+
+  // error cases
+  EXPECT(clienttable_new(0) == NULL);
+  EXPECT(clienttable_insert(NULL, &a, items) == false);
+  EXPECT(clienttable_find(NULL, &a) == NULL);
+  clienttable_t *table = clienttable_new(Capacity);
+  EXPECT(table != NULL);
+  EXPECT(clienttable_insert(table, NULL, items) == false);
+  EXPECT(clienttable_insert(table, &a, NULL) == false);
+  EXPECT(clienttable_find(table, NULL) == NULL);
+  EXPECT(clienttable_find(table, &a) == NULL);
+
+  // the same port on two hosts, and two ports on one host, are all distinct
+  addr_t b = inet("127.0.0.2", "5000");
+  addr_t c = inet("127.0.0.1", "5001");
+  EXPECT(clienttable_insert(table, &a, &items[0]));
+  EXPECT(clienttable_insert(table, &b, &items[1]));
+  EXPECT(clienttable_insert(table, &c, &items[2]));
+  EXPECT(clienttable_find(table, &a) == &items[0]);
+  EXPECT(clienttable_find(table, &b) == &items[1]);
+  EXPECT(clienttable_find(table, &c) == &items[2]);
+  EXPECT(clienttable_insert(table, &a, &items[3]) == false);   // already there
+  addr_t copy = inet("127.0.0.1", "5000");
+  EXPECT(clienttable_find(table, &copy) == &items[0]);
+
+  // Unix-domain names: a pathname, and an abstract name, are distinct
+  addr_t path, abstract;
+  EXPECT(message_setLocalAddr("/tmp/nuggets", &path));
+  EXPECT(message_setLocalAddr("@nuggets", &abstract));
+  EXPECT(clienttable_insert(table, &path, &items[3]));
+  EXPECT(clienttable_insert(table, &abstract, &items[4]));
+  EXPECT(clienttable_find(table, &path) == &items[3]);
+  EXPECT(clienttable_find(table, &abstract) == &items[4]);
+
+  // fill it up; every client is still found, and no more fit
+  char port[8];
+  for (int i = 5; i < Capacity; i++) {
+    sprintf(port, "%d", 6000 + i);
+    addr_t address = inet("10.0.0.1", port);
+    clienttable_insert(table, &address, &items[i]);
+  }
+  bool all = true;
+  for (int i = 5; i < Capacity; i++) {
+    sprintf(port, "%d", 6000 + i);
+    addr_t address = inet("10.0.0.1", port);
+    all = all && clienttable_find(table, &address) == &items[i];
+  }
+  EXPECT(all);
+  addr_t extra = inet("10.0.0.2", "6000");
+  EXPECT(clienttable_insert(table, &extra, items) == false);   // full
+  EXPECT(clienttable_find(table, &extra) == NULL);
+
+  // iterate visits them in the order inserted
+  char order[Capacity + 1];
+  order[0] = '\0';
+  clienttable_iterate(table, order, collect);
+  EXPECT(strcmp(order, items) == 0);
+
+  clienttable_delete(table, count);
+  EXPECT(deleted == Capacity);
+  clienttable_delete(NULL, count);    // does nothing
+
+  printf("unit test complete\n");
+
+  // print a summary
+  if (clienttable_unit_failed > 0) {
+    printf("FAILED %d of %d tests\n", clienttable_unit_failed, clienttable_unit_tested);
+    return clienttable_unit_failed;
+  } else {
+    printf("PASSED all of %d tests\n", clienttable_unit_tested);
+    return 0;
+  }
+}
+
+static addr_t
+inet(const char *host, const char *port)
+{
+  addr_t address;
+  message_setAddr(host, port, &address);
+  return address;
+}
+
+static void
+collect(void *arg, const addr_t *address, void *item)
+{
+  char *order = arg;
+  size_t len = strlen(order);
+  order[len] = *(char *) item;
+  order[len + 1] = '\0';
+}
+
+static void
+count(void *item)
+{
+  deleted++;
+}
@@ -0,0 +1,774 @@
+/*
+ * display.c - display module to encode the DISPLAY frames sent to each client
+ *
+ * see display.h for more information.
+ *
+ * Team JEN, Winter 2021
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "display.h"
+#include "memory.h"
+
+/**************** file-local constants ****************/
+static const int MaxHeader = 64;  // room for the first line of any message
+static const int MergeGap = 4;    // merge runs separated by this few equal cells
+static const char RunMark = '~';  // starts a run in RLE
+static const int MinRun = 4;      // shortest run worth writing as one in RLE
+
+/**************** global types ****************/
+typedef struct display {
+  int nR;              // number of rows in the grid
+  int nC;              // number of columns in the grid
+  int len;             // length of a frame: nR * (nC + 1)
+  display_mode_t mode; // how frames are encoded
+  int seq;             // number of the last frame sent (0 if none)
+  int acked;           // newest frame the client acknowledged (0 if none)
+  bool full;           // send the next frame in full
+  char **history;      // recent frames sent; frame n is in slot n % display_History
+  int *history_seq;    // number of the frame in each slot (0 if empty)
+  char *buf;           // the encoded message
+  char *map;           // the static map, for DISPLAY_BASEMAP (NULL if not set)
+  bool map_sent;       // the client has been sent the map since the last resync
+  int win_rows;        // size of the window, for DISPLAY_VIEWPORT (0 if not set)
+  int win_cols;
+  int centre_row;      // centre of the window
+  int centre_col;
+} display_t;
+
+/**************** local functions ****************/
+/* not visible outside this file */
+static void history_free(display_t *display);
+static const char *delta_base(display_t *display);
+static int encode_message(display_t *display, const char *frame, bool *verbatim);
+static void remember(display_t *display, const int seq, const char *frame);
+static int encode_runs(const int nR, const int nC, const char *frame, const char *base,
+                       const bool drawn_only, char *out, int max);
+static int encode_binary(display_t *display, const char *frame, char *out);
+static int encode_window(display_t *display, const char *frame, char *out);
+static int window_origin(const int centre, const int size, const int total);
+static int encode_toggles(display_t *display, const char *frame, const char *base,
+                          char *out, int max, int *ntoggle);
+static int encode_rle(const char *frame, const int len, char *out);
+
+/**************** display_new ****************/
+/* see display.h for documentation */
+display_t*
+display_new(const int nR, const int nC)
+{
+  if (nR <= 0 || nC <= 0) {
+    return NULL;
+  }
+  display_t *display = count_malloc_assert(sizeof(display_t), "display_t");
+  display->nR = nR;
+  display->nC = nC;
+  display->len = nR * (nC + 1);
+  display->mode = DISPLAY_TEXT;
+  display->seq = 0;
+  display->acked = 0;
+  display->full = true;
+  display->history = NULL;
+  display->history_seq = NULL;
+  display->map = NULL;
+  display->map_sent = false;
+  display->win_rows = 0;
+  display->win_cols = 0;
+  display->centre_row = nR / 2;
+  display->centre_col = nC / 2;
+  // an RLE frame is at worst three times the text, when every cell is a '~'
+  display->buf = count_malloc_assert(3 * display->len + MaxHeader + 1, "display buffer");
+  return display;
+}
+
+/**************** display_setBase ****************/
+/* see display.h for documentation */
+bool
+display_setBase(display_t *display, const char *map)
+{
+  if (display == NULL || map == NULL) {
+    return false;
+  }
+  if (display->map == NULL) {
+    display->map = count_malloc_assert(display->len + 1, "display map");
+  }
+  memcpy(display->map, map, display->len);
+  display->map[display->len] = '\0';
+  display->map_sent = false;
+  return true;
+}
+
+/**************** display_setWindow ****************/
+/* see display.h for documentation */
+bool
+display_setWindow(display_t *display, const int rows, const int cols)
+{
+  if (display == NULL || rows < 1 || cols < 1) {
+    return false;
+  }
+  display->win_rows = (rows < display->nR) ? rows : display->nR;
+  display->win_cols = (cols < display->nC) ? cols : display->nC;
+  display->centre_row = display->nR / 2;
+  display->centre_col = display->nC / 2;
+  return true;
+}
+
+/**************** display_setCentre ****************/
+/* see display.h for documentation */
+void
+display_setCentre(display_t *display, const int row, const int col)
+{
+  if (display != NULL && row >= 0 && row < display->nR
+      && col >= 0 && col < display->nC) {
+    display->centre_row = row;
+    display->centre_col = col;
+  }
+}
+
+/**************** display_setMode ****************/
+/* see display.h for documentation */
+bool
+display_setMode(display_t *display, const display_mode_t mode)
+{
+  if (display == NULL || mode < DISPLAY_TEXT || mode > DISPLAY_VIEWPORT) {
+    return false;
+  }
+  if (mode == DISPLAY_BASEMAP && display->map == NULL) {
+    return false;
+  }
+  if (mode == DISPLAY_VIEWPORT && display->win_rows == 0) {
+    return false;
+  }
+  // forget everything sent so far
+  history_free(display);
+  display->mode = mode;
+  display->seq = 0;
+  display->acked = 0;
+  display->full = true;
+  display->map_sent = false;
+  // only numbered frames need to be remembered
+  if (mode == DISPLAY_DELTA || mode == DISPLAY_BASEMAP) {
+    display->history = count_calloc_assert(display_History, sizeof(char*), "display history");
+    display->history_seq = count_calloc_assert(display_History, sizeof(int), "display history");
+    for (int i = 0; i < display_History; i++) {
+      display->history[i] = count_malloc_assert(display->len + 1, "display history");
+    }
+  }
+  return true;
+}
+
+/**************** display_getMode ****************/
+/* see display.h for documentation */
+display_mode_t
+display_getMode(const display_t *display)
+{
+  return display ? display->mode : DISPLAY_TEXT;
+}
+
+/**************** display_ack ****************/
+/* see display.h for documentation */
+bool
+display_ack(display_t *display, const int seq)
+{
+  if (display == NULL || display->history == NULL || seq <= 0 || seq > display->seq) {
+    return false;
+  }
+  // the frame must still be in our history, to serve as a base
+  if (display->history_seq[seq % display_History] != seq) {
+    return false;
+  }
+  if (seq > display->acked) {
+    display->acked = seq;
+  }
+  return true;
+}
+
+/**************** display_resync ****************/
+/* see display.h for documentation */
+void
+display_resync(display_t *display)
+{
+  if (display != NULL) {
+    display->full = true;
+    display->map_sent = false;
+  }
+}
+
+/**************** display_encodeBase ****************/
+/* see display.h for documentation */
+const char*
+display_encodeBase(display_t *display, int *len)
+{
+  if (display == NULL || len == NULL || display->mode != DISPLAY_BASEMAP
+      || display->map_sent) {
+    return NULL;
+  }
+  int n = sprintf(display->buf, "MAP\n");
+  memcpy(display->buf + n, display->map, display->len + 1);
+  display->map_sent = true;
+  *len = n + display->len;
+  return display->buf;
+}
+
+/**************** display_encode ****************/
+/* see display.h for documentation */
+const char*
+display_encode(display_t *display, const char *frame, int *len)
+{
+  if (display == NULL || frame == NULL || len == NULL) {
+    return NULL;
+  }
+  bool verbatim;
+  int n = encode_message(display, frame, &verbatim);
+  // the frame follows the header as is; copy it in after the header
+  if (verbatim) {
+    memcpy(display->buf + n, frame, display->len);
+    n += display->len;
+    display->buf[n] = '\0';
+  }
+  *len = n;
+  return display->buf;
+}
+
+/**************** display_encodev ****************/
+/* see display.h for documentation */
+int
+display_encodev(display_t *display, const char *frame, struct iovec iov[2])
+{
+  if (display == NULL || frame == NULL || iov == NULL) {
+    return 0;
+  }
+  bool verbatim;
+  int n = encode_message(display, frame, &verbatim);
+  iov[0].iov_base = display->buf;
+  iov[0].iov_len = n;
+  if (!verbatim) {
+    return 1;
+  }
+  // the frame follows the header as is; point at it rather than copy it
+  iov[1].iov_base = (char *) frame;
+  iov[1].iov_len = display->len;
+  return 2;
+}
+
+/**************** encode_message ****************/
+/* Helper method to encode the message that brings this client up to date
+ * with 'frame', into the display's buffer.  Some messages are a header
+ * followed by the frame text as is; for those we write only the header,
+ * and set *verbatim so the caller can send or copy the frame after it.
+ *
+ * We RETURN: the number of chars written to the buffer.
+ */
+static int
+encode_message(display_t *display, const char *frame, bool *verbatim)
+{
+  char *buf = display->buf;
+  int n = 0;
+  *verbatim = false;
+
+  switch (display->mode) {
+  case DISPLAY_TEXT:
+    n = sprintf(buf, "DISPLAY\n");
+    *verbatim = true;
+    break;
+
+  case DISPLAY_DELTA: {
+    int seq = display->seq + 1;
+    const char *base = delta_base(display);
+    n = -1;
+    if (base != NULL) {
+      n = sprintf(buf, "DELTA %d %d\n", seq, display->acked);
+      int runs = encode_runs(display->nR, display->nC, frame, base, false,
+                             buf + n, display->len);
+      n = (runs < 0) ? -1 : n + runs;
+    }
+    // no base, or the delta would be no smaller than the frame itself
+    if (n < 0) {
+      n = sprintf(buf, "FRAME %d\n", seq);
+      *verbatim = true;
+    }
+    remember(display, seq, frame);
+    break;
+  }
+
+  case DISPLAY_BASEMAP: {
+    int seq = display->seq + 1;
+    // with no acknowledged frame, toggle against a blank frame
+    const char *base = delta_base(display);
+    int base_seq = (base == NULL) ? 0 : display->acked;
+    // the body goes after room for the header, which needs its length
+    char *body = buf + MaxHeader;
+    int ntoggle;
+    int toggles = encode_toggles(display, frame, base, body, display->len, &ntoggle);
+    int occupants = -1;
+    if (toggles >= 0) {
+      occupants = encode_runs(display->nR, display->nC, frame, display->map, true,
+                              body + toggles, display->len - toggles);
+    }
+    if (occupants >= 0) {
+      n = sprintf(buf, "VIEW %d %d %d\n", seq, base_seq, ntoggle);
+      memmove(buf + n, body, toggles + occupants);
+      n += toggles + occupants;
+    } else {
+      n = sprintf(buf, "FRAME %d\n", seq);
+      *verbatim = true;
+    }
+    remember(display, seq, frame);
+    break;
+  }
+
+  case DISPLAY_RLE:
+    n = sprintf(buf, "RLE\n");
+    n += encode_rle(frame, display->len, buf + n);
+    break;
+
+  case DISPLAY_VIEWPORT:
+    n = encode_window(display, frame, buf);
+    break;
+
+  case DISPLAY_BINARY:
+    n = encode_binary(display, frame, buf);
+    // too many kinds of cell for the side table
+    if (n < 0) {
+      n = sprintf(buf, "DISPLAY\n");
+      *verbatim = true;
+    }
+    break;
+  }
+
+  buf[n] = '\0';
+  display->full = false;
+  return n;
+}
+
+/**************** display_diff ****************/
+/* see display.h for documentation */
+int
+display_diff(const char *frame, const char *base, const int nR, const int nC,
+             char *out, const int max)
+{
+  if (frame == NULL || base == NULL || out == NULL || nR <= 0 || nC <= 0) {
+    return -1;
+  }
+  return encode_runs(nR, nC, frame, base, false, out, max);
+}
+
+/**************** display_applyDelta ****************/
+/* see display.h for documentation */
+bool
+display_applyDelta(char *frame, const int nR, const int nC, const char *runs)
+{
+  if (frame == NULL || runs == NULL || nR <= 0 || nC <= 0) {
+    return false;
+  }
+  // each run is one line: "row col bytes"; the bytes, which may well
+  // begin with blanks, start just after the one space that ends "col"
+  const char *p = runs;
+  while (*p != '\0') {
+    int row, col, skip;
+    if (sscanf(p, "%d %d%n", &row, &col, &skip) != 2 || p[skip] != ' ') {
+      return false;
+    }
+    p += skip + 1;
+    const char *end = strchr(p, '\n');
+    if (end == NULL) {
+      return false;
+    }
+    int count = end - p;
+    if (row < 0 || row >= nR || col < 0 || count <= 0 || col + count > nC) {
+      return false;
+    }
+    memcpy(frame + row * (nC + 1) + col, p, count);
+    p = end + 1;
+  }
+  return true;
+}
+
+/**************** display_applyView ****************/
+/* see display.h for documentation */
+bool
+display_applyView(char *frame, const char *map, const int nR, const int nC,
+                  const int ntoggle, const char *body)
+{
+  if (frame == NULL || map == NULL || body == NULL || nR <= 0 || nC <= 0
+      || ntoggle < 0) {
+    return false;
+  }
+  // drawn cells go back to the map; occupants are listed again below
+  for (int i = 0; i < nR * (nC + 1); i++) {
+    if (frame[i] != ' ') {
+      frame[i] = map[i];
+    }
+  }
+  // flip the cells whose drawn state changed
+  const char *p = body;
+  for (int t = 0; t < ntoggle; t++) {
+    int row, col, count, skip;
+    if (sscanf(p, "%d %d %d%n", &row, &col, &count, &skip) != 3 || p[skip] != '\n') {
+      return false;
+    }
+    if (row < 0 || row >= nR || col < 0 || count <= 0 || col + count > nC) {
+      return false;
+    }
+    for (int i = row * (nC + 1) + col; i < row * (nC + 1) + col + count; i++) {
+      frame[i] = (frame[i] == ' ') ? map[i] : ' ';
+    }
+    p += skip + 1;
+  }
+  // then the occupants
+  return display_applyDelta(frame, nR, nC, p);
+}
+
+/**************** display_decodeRLE ****************/
+/* see display.h for documentation */
+bool
+display_decodeRLE(const char *rle, char *frame, const int len)
+{
+  if (rle == NULL || frame == NULL || len < 0) {
+    return false;
+  }
+  int n = 0;
+  const char *p = rle;
+  while (*p != '\0') {
+    // either a run, "~count char", or a char standing for itself
+    int count = 1;
+    if (*p == RunMark) {
+      p++;
+      if (!isdigit((unsigned char) *p)) {
+        return false;
+      }
+      count = 0;
+      while (isdigit((unsigned char) *p)) {
+        count = count * 10 + (*p++ - '0');
+        if (count > len) {
+          return false;
+        }
+      }
+      if (*p == '\0' || count == 0) {
+        return false;
+      }
+    }
+    if (n + count > len) {
+      return false;
+    }
+    memset(frame + n, *p++, count);
+    n += count;
+  }
+  frame[n] = '\0';
+  return n == len;
+}
+
+/**************** display_decodeBinary ****************/
+/* see display.h for documentation */
+bool
+display_decodeBinary(const char *msg, const int len, char *frame,
+                     const int nR, const int nC)
+{
+  if (msg == NULL || frame == NULL || nR <= 0 || nC <= 0
+      || len < 7 || strncmp(msg, "BINARY", 6) != 0) {
+    return false;
+  }
+  // the side table, if any, runs from after the space to the newline
+  const char *table = msg + 6;
+  const char *end = memchr(msg, '\n', len);
+  if (end == NULL) {
+    return false;
+  }
+  int ntable = 0;
+  if (*table == ' ') {
+    table++;
+    ntable = end - table;
+  } else if (table != end) {
+    return false;
+  }
+  if (ntable > display_TableSize) {
+    return false;
+  }
+  // then exactly enough bytes for every cell
+  const unsigned char *cells = (const unsigned char *) end + 1;
+  if (msg + len - (const char *) cells != (nR * nC + 1) / 2) {
+    return false;
+  }
+  for (int i = 0; i < nR * nC; i++) {
+    int code = (i % 2 == 0) ? cells[i / 2] >> 4 : cells[i / 2] & 0x0F;
+    if (code >= 8 && code - 8 >= ntable) {
+      return false;
+    }
+    frame[i / nC * (nC + 1) + i % nC] = (code < 8) ? display_Cells[code] : table[code - 8];
+  }
+  for (int r = 0; r < nR; r++) {
+    frame[r * (nC + 1) + nC] = '\n';
+  }
+  frame[nR * (nC + 1)] = '\0';
+  return true;
+}
+
+/**************** display_delete ****************/
+/* see display.h for documentation */
+void
+display_delete(display_t *display)
+{
+  if (display != NULL) {
+    history_free(display);
+    free(display->buf);
+    free(display->map);
+    free(display);
+  }
+}
+
+/***********************************************************************
+ * INTERNAL FUNCTIONS
+ ***********************************************************************/
+
+/**************** history_free ****************/
+/* Helper method to free the frames remembered by a display.
+ */
+static void
+history_free(display_t *display)
+{
+  if (display->history != NULL) {
+    for (int i = 0; i < display_History; i++) {
+      free(display->history[i]);
+    }
+    free(display->history);
+    free(display->history_seq);
+    display->history = NULL;
+    display->history_seq = NULL;
+  }
+}
+
+/**************** delta_base ****************/
+/* Helper method to find the frame a delta can be based on: the newest frame
+ * the client acknowledged, if we still remember it and need not resync.
+ *
+ * We RETURN: the base frame, or NULL if there is none.
+ */
+static const char *
+delta_base(display_t *display)
+{
+  int base = display->acked;
+  if (display->full || base <= 0
+      || display->history_seq[base % display_History] != base) {
+    return NULL;
+  }
+  return display->history[base % display_History];
+}
+
+/**************** remember ****************/
+/* Helper method to record frame number 'seq' as sent, for use as a later base.
+ */
+static void
+remember(display_t *display, const int seq, const char *frame)
+{
+  memcpy(display->history[seq % display_History], frame, display->len);
+  display->history_seq[seq % display_History] = seq;
+  display->seq = seq;
+}
+
+/**************** encode_runs ****************/
+/* Helper method to write the runs of cells where 'frame' differs from 'base',
+ * one per line as "row col bytes\n", into 'out'.  Runs separated by only a
+ * few equal cells are merged, since each run costs a few bytes of header.
+ * If 'drawn_only', blank cells of 'frame' count as equal.
+ *
+ * We RETURN: the number of chars written, or -1 if that would reach 'max'.
+ */
+static int
+encode_runs(const int nR, const int nC, const char *frame, const char *base,
+            const bool drawn_only, char *out, int max)
+{
+  int n = 0;
+  for (int r = 0; r < nR; r++) {
+    const char *cur = frame + r * (nC + 1);
+    const char *old = base + r * (nC + 1);
+    int c = 0;
+    while (c < nC) {
+      if (cur[c] == old[c] || (drawn_only && cur[c] == ' ')) {
+        c++;
+        continue;
+      }
+      // extend the run through any short stretch of equal cells
+      int start = c;
+      int end = c + 1;
+      for (int k = end; k < nC && k - end <= MergeGap; k++) {
+        if (cur[k] != old[k] && !(drawn_only && cur[k] == ' ')) {
+          end = k + 1;
+        }
+      }
+      char head[32];
+      int headlen = sprintf(head, "%d %d ", r, start);
+      if (n + headlen + (end - start) + 1 >= max) {
+        return -1;
+      }
+      memcpy(out + n, head, headlen);
+      n += headlen;
+      memcpy(out + n, cur + start, end - start);
+      n += end - start;
+      out[n++] = '\n';
+      c = end;
+    }
+  }
+  return n;
+}
+
+/**************** encode_rle ****************/
+/* Helper method to write the run-length encoding of 'frame' into 'out',
+ * which has room for at least 3*len chars.  See display_decodeRLE.
+ *
+ * We RETURN: the number of chars written.
+ */
+static int
+encode_rle(const char *frame, const int len, char *out)
+{
+  int n = 0;
+  int i = 0;
+  while (i < len) {
+    char c = frame[i];
+    int run = 1;
+    while (i + run < len && frame[i + run] == c) {
+      run++;
+    }
+    if (run >= MinRun || c == RunMark) {
+      n += sprintf(out + n, "%c%d%c", RunMark, run, c);
+    } else {
+      memset(out + n, c, run);
+      n += run;
+    }
+    i += run;
+  }
+  return n;
+}
+
+/**************** encode_binary ****************/
+/* Helper method to write 'frame' as a BINARY message into 'out';
+ * see display_decodeBinary for the format.
+ *
+ * We RETURN: the number of bytes written, or -1 if the frame holds more
+ * kinds of cell than fit in the fixed codes and the side table.
+ */
+static int
+encode_binary(display_t *display, const char *frame, char *out)
+{
+  // the code for each char: fixed, or a side table entry when first seen
+  signed char code[256];
+  memset(code, -1, sizeof(code));
+  for (int k = 0; k < 8; k++) {
+    code[(unsigned char) display_Cells[k]] = k;
+  }
+  char table[display_TableSize];
+  int ntable = 0;
+
+  // pack the cells after room for the header, which needs the side table
+  unsigned char *cells = (unsigned char *) out + MaxHeader;
+  int i = 0;
+  for (int r = 0; r < display->nR; r++) {
+    const char *row = frame + r * (display->nC + 1);
+    for (int c = 0; c < display->nC; c++, i++) {
+      unsigned char ch = row[c];
+      if (code[ch] < 0) {
+        if (ntable == display_TableSize) {
+          return -1;
+        }
+        table[ntable] = ch;
+        code[ch] = 8 + ntable++;
+      }
+      if (i % 2 == 0) {
+        cells[i / 2] = code[ch] << 4;
+      } else {
+        cells[i / 2] |= code[ch];
+      }
+    }
+  }
+
+  int n = sprintf(out, "BINARY");
+  if (ntable > 0) {
+    out[n++] = ' ';
+    memcpy(out + n, table, ntable);
+    n += ntable;
+  }
+  out[n++] = '\n';
+  memmove(out + n, cells, (i + 1) / 2);
+  return n + (i + 1) / 2;
+}
+
+/**************** encode_window ****************/
+/* Helper method to write the window of 'frame' around the display's centre,
+ * as "WINDOW top left rows cols\n" and the window's rows, into 'out'.
+ *
+ * We RETURN: the number of chars written.
+ */
+static int
+encode_window(display_t *display, const char *frame, char *out)
+{
+  int rows = display->win_rows;
+  int cols = display->win_cols;
+  int top = window_origin(display->centre_row, rows, display->nR);
+  int left = window_origin(display->centre_col, cols, display->nC);
+  int n = sprintf(out, "WINDOW %d %d %d %d\n", top, left, rows, cols);
+  for (int r = top; r < top + rows; r++) {
+    memcpy(out + n, frame + r * (display->nC + 1) + left, cols);
+    n += cols;
+    out[n++] = '\n';
+  }
+  return n;
+}
+
+/**************** window_origin ****************/
+/* Helper method to place a window of 'size' cells on a line of 'total'
+ * cells, as nearly centred on 'centre' as fits.
+ *
+ * We RETURN: the first cell in the window.
+ */
+static int
+window_origin(const int centre, const int size, const int total)
+{
+  int origin = centre - size / 2;
+  if (origin > total - size) {
+    origin = total - size;
+  }
+  return (origin < 0) ? 0 : origin;
+}
+
+/**************** encode_toggles ****************/
+/* Helper method to write the runs of cells that are drawn (not blank) in
+ * exactly one of 'frame' and 'base', one per line as "row col count\n",
+ * into 'out'.  A NULL 'base' counts as entirely blank.  The number of runs
+ * is stored in *ntoggle.
+ *
+ * We RETURN: the number of chars written, or -1 if that would reach 'max'.
+ */
+static int
+encode_toggles(display_t *display, const char *frame, const char *base,
+               char *out, int max, int *ntoggle)
+{
+  int n = 0;
+  *ntoggle = 0;
+  for (int r = 0; r < display->nR; r++) {
+    const char *cur = frame + r * (display->nC + 1);
+    const char *old = (base == NULL) ? NULL : base + r * (display->nC + 1);
+    int c = 0;
+    while (c < display->nC) {
+      // the cell toggles if it is drawn in one frame but not the other
+      int start = c;
+      while (c < display->nC
+             && (cur[c] != ' ') != (old != NULL && old[c] != ' ')) {
+        c++;
+      }
+      if (c == start) {
+        c++;
+        continue;
+      }
+      char line[48];
+      int linelen = sprintf(line, "%d %d %d\n", r, start, c - start);
+      if (n + linelen >= max) {
+        return -1;
+      }
+      memcpy(out + n, line, linelen);
+      n += linelen;
+      (*ntoggle)++;
+    }
+  }
+  return n;
+}
@@ -0,0 +1,266 @@
+/*
+ * display module - encoding the DISPLAY frames sent to each client
+ *
+ * Every client (player or spectator) has a display_t that records how
+ * the client asked for its frames to be encoded, and what it has already
+ * been sent.  The server renders a frame as text, exactly as it would
+ * appear after "DISPLAY\n", and asks the display_t for the message that
+ * brings this client up to date.
+ *
+ * Encodings (see IMPLEMENTATION.md for the message formats):
+ *   DISPLAY_TEXT   every frame is sent in full, as "DISPLAY\n" and the text.
+ *   DISPLAY_DELTA  frames are numbered; the client acknowledges each one,
+ *                  and later frames carry only the runs of cells that differ
+ *                  from the newest frame the client acknowledged.
+ *   DISPLAY_RLE    every frame is sent in full, run-length encoded,
+ *                  as "RLE\n" and the encoded text.
+ *   DISPLAY_BINARY every frame is sent in full, packed two cells to a byte,
+ *                  for machine clients; see display_decodeBinary.
+ *   DISPLAY_VIEWPORT every frame is cut down to a window of the size the
+ *                  client asked for, around a centre, and sent as
+ *                  "WINDOW top left rows cols\n" and the window's text.
+ *   DISPLAY_BASEMAP  the static map is sent once; frames are numbered and
+ *                  acknowledged as in DISPLAY_DELTA, and each carries only
+ *                  the changes to which cells are drawn, and the cells
+ *                  that differ from the map (gold and players).
+ *
+ * Team JEN, Winter 2021
+ */
+
+#ifndef __DISPLAY_H
+#define __DISPLAY_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <sys/uio.h>
+
+/**************** global types ****************/
+typedef struct display display_t;  // opaque to users of the module
+
+typedef enum display_mode {
+  DISPLAY_TEXT,    // plain "DISPLAY\n" frames (the default)
+  DISPLAY_DELTA,   // numbered frames, and deltas against acknowledged frames
+  DISPLAY_RLE,     // run-length encoded frames
+  DISPLAY_BASEMAP, // the map once, then drawn cells and occupants
+  DISPLAY_BINARY,  // frames packed into 4-bit cell codes
+  DISPLAY_VIEWPORT, // a window of the frame around a centre
+} display_mode_t;
+
+/**************** constants ****************/
+// Number of recent frames that can serve as the base of a delta.
+// A client in DISPLAY_DELTA mode must keep every frame numbered within
+// display_History of the newest frame it has received.
+static const int display_History = 8;
+
+// The chars for the fixed 4-bit cell codes of DISPLAY_BINARY: code 0 is
+// a blank (unknown) cell, 1 a horizontal wall, 2 a vertical wall, 3 a
+// corner, 4 a room spot, 5 a passage, 6 gold, 7 the player themself.
+// Codes 8 to 15 name the entries of the side table sent with each frame.
+static const char display_Cells[] = " -|+.#*@";
+static const int display_TableSize = 8;
+
+/**************** functions ****************/
+
+/**************** display_new ****************/
+/* Create a new display for a client viewing a grid of nR rows and nC columns.
+ *
+ * Caller provides:
+ *   the number of rows and columns in the grid (both > 0).
+ * We return:
+ *   pointer to the new display, in DISPLAY_TEXT mode; NULL if error.
+ * Caller is responsible for:
+ *   later calling display_delete.
+ */
+display_t* display_new(const int nR, const int nC);
+
+/**************** display_setBase ****************/
+/* Give the display the static map, as the frame text of the map with no
+ * gold or players on it; needed before choosing DISPLAY_BASEMAP.
+ * The display keeps its own copy.
+ *
+ * We return:
+ *   true on success; false if display or map is NULL.
+ */
+bool display_setBase(display_t *display, const char *map);
+
+/**************** display_setWindow ****************/
+/* Set the size of the window sent in DISPLAY_VIEWPORT mode; needed before
+ * choosing that mode.  The centre starts in the middle of the grid.
+ * A window larger than the grid is cut down to the grid.
+ *
+ * We return:
+ *   true on success; false if display is NULL or either size is < 1.
+ */
+bool display_setWindow(display_t *display, const int rows, const int cols);
+
+/**************** display_setCentre ****************/
+/* Move the centre of the window sent in DISPLAY_VIEWPORT mode; e.g., to
+ * follow the player.  The window is kept inside the grid, so near an edge
+ * the centre is not in the middle of the window.
+ * Out-of-bounds centres are ignored.
+ */
+void display_setCentre(display_t *display, const int row, const int col);
+
+/**************** display_setMode ****************/
+/* Change how frames are encoded for this client.
+ * Any frames sent earlier are forgotten, so the next frame is sent in full.
+ *
+ * We return:
+ *   true on success; false if display is NULL, the mode is unknown,
+ *   or the mode is DISPLAY_BASEMAP and display_setBase was never called,
+ *   or the mode is DISPLAY_VIEWPORT and display_setWindow was never called.
+ */
+bool display_setMode(display_t *display, const display_mode_t mode);
+
+/**************** display_getMode ****************/
+/* We return: the display's mode; DISPLAY_TEXT if display is NULL.
+ */
+display_mode_t display_getMode(const display_t *display);
+
+/**************** display_ack ****************/
+/* Record that the client acknowledged frame number 'seq'.
+ * Acknowledged frames become the base for later deltas.
+ *
+ * We return:
+ *   true if 'seq' names a frame we sent and still remember;
+ *   false otherwise (the acknowledgement is ignored).
+ */
+bool display_ack(display_t *display, const int seq);
+
+/**************** display_resync ****************/
+/* Ask for the next frame to be sent in full, whatever the mode;
+ * e.g., because the client lost track of its frames.
+ */
+void display_resync(display_t *display);
+
+/**************** display_encodeBase ****************/
+/* Encode the MAP message carrying the static map, if this client needs it:
+ * in DISPLAY_BASEMAP mode, once after the mode is chosen and after each
+ * display_resync.  Send it before the message from display_encode.
+ *
+ * We return:
+ *   pointer to the message, which is also null-terminated, and its
+ *   length in *len; the memory belongs to the display, and is reused by
+ *   the next call to display_encodeBase or display_encode.
+ *   NULL if the client needs no MAP message, or on any error.
+ */
+const char* display_encodeBase(display_t *display, int *len);
+
+/**************** display_encode ****************/
+/* Encode the message that brings this client up to date with 'frame'.
+ *
+ * Caller provides:
+ *   valid display, and the frame text: nR lines of nC chars and a newline.
+ *   a pointer to an int, where we store the length of the message.
+ * We return:
+ *   pointer to the message, which is also null-terminated; but a BINARY
+ *   message may hold '\0' bytes, so send exactly *len bytes.
+ *   The memory belongs to the display, and is reused by the next call.
+ *   NULL on any error.
+ */
+const char* display_encode(display_t *display, const char *frame, int *len);
+
+/**************** display_encodev ****************/
+/* Like display_encode, but without copying the frame: the message is
+ * described by one or two iovecs, for use with message_sendv.  When the
+ * message is a header followed by the frame text as is, the second iovec
+ * points into 'frame', which must stay valid until the message is sent.
+ *
+ * We return:
+ *   the number of iovecs filled in (1 or 2); 0 on any error.
+ *   The header belongs to the display, and is reused by the next call.
+ */
+int display_encodev(display_t *display, const char *frame, struct iovec iov[2]);
+
+/**************** display_diff ****************/
+/* Write the runs of cells where 'frame' differs from 'base', in the format
+ * of the body of a DELTA message, into 'out'; see display_applyDelta.
+ *
+ * Caller provides:
+ *   two frames of nR lines of nC chars and a newline,
+ *   a buffer and its size in chars.
+ * We return:
+ *   the number of chars written (0 if the frames are equal), not counting
+ *   a terminating '\0', which is not written; -1 if the runs would not
+ *   fit in fewer than 'max' chars, or on any error.
+ */
+int display_diff(const char *frame, const char *base, const int nR, const int nC,
+                 char *out, const int max);
+
+/**************** display_applyDelta ****************/
+/* Apply the runs of a DELTA message to a frame; for use by clients.
+ *
+ * Caller provides:
+ *   the frame to update (nR lines of nC chars and a newline),
+ *   its number of rows and columns,
+ *   the body of the DELTA message (everything after its first line).
+ * We return:
+ *   true on success; false if the runs are malformed or out of bounds,
+ *   in which case the frame may be partly updated.
+ */
+bool display_applyDelta(char *frame, const int nR, const int nC, const char *runs);
+
+/**************** display_applyView ****************/
+/* Rebuild a frame from the body of a VIEW message; for use by clients.
+ *
+ * A cell of a frame is drawn if it is not a space.  The body first lists
+ * 'ntoggle' runs of cells, one per line as "row col count", that are drawn
+ * in exactly one of the base frame and the new frame; then, in the format
+ * of display_applyDelta, the drawn cells that differ from the map.
+ *
+ * Caller provides:
+ *   the base frame the message names, which is updated to the new frame
+ *   (all spaces, nR lines of nC and a newline, if the base is 0),
+ *   the map from the MAP message, its number of rows and columns,
+ *   the number of toggled runs from the VIEW line, and the body.
+ * We return:
+ *   true on success; false if the body is malformed or out of bounds,
+ *   in which case the frame may be partly updated.
+ */
+bool display_applyView(char *frame, const char *map, const int nR, const int nC,
+                       const int ntoggle, const char *body);
+
+/**************** display_decodeRLE ****************/
+/* Decode the body of an RLE message; for use by clients.
+ *
+ * In the encoding, '~' then a decimal count then a char stands for that
+ * many copies of the char; any other char stands for itself.  A '~' in
+ * the frame is always written as a run ("~1~"), so it is never ambiguous.
+ *
+ * Caller provides:
+ *   the body of the RLE message (everything after its first line),
+ *   a buffer of at least len+1 chars for the frame,
+ *   the length of the frame, nR * (nC + 1).
+ * We return:
+ *   true on success, with the frame null-terminated;
+ *   false if the body is malformed or does not decode to exactly len chars.
+ */
+bool display_decodeRLE(const char *rle, char *frame, const int len);
+
+/**************** display_decodeBinary ****************/
+/* Decode a BINARY message; for use by clients.
+ *
+ * A BINARY message is a line "BINARY", then, if the side table is not
+ * empty, a space and the side table's chars (other players, usually),
+ * then a newline; then the nR * nC cells, row by row, two to a byte,
+ * the first cell in the high 4 bits; an odd last cell is padded with 0.
+ * A frame whose cells need more than display_TableSize other chars is
+ * sent as a plain DISPLAY message instead.
+ *
+ * Caller provides:
+ *   the whole message and its length in bytes (it may contain '\0'),
+ *   a buffer of at least nR * (nC + 1) + 1 chars for the frame,
+ *   the number of rows and columns, from the GRID message.
+ * We return:
+ *   true on success, with the frame as text and null-terminated;
+ *   false if the message is malformed or of the wrong length.
+ */
+bool display_decodeBinary(const char *msg, const int len, char *frame,
+                          const int nR, const int nC);
+
+/**************** display_delete ****************/
+/* Free the display and the frames it remembers.
+ */
+void display_delete(display_t *display);
+
+#endif // __DISPLAY_H
@@ -0,0 +1,297 @@
+/*
+ * displaytest.c - unit test program for the Nuggets Project's display module
+ *
+ * Code adapted from gridtest.c
+ * Read the README or the TESTING.md file for more information.
+ *
+ * CS50, Team JEN, March 2021
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "display.h"
+#include "memory.h"
+
+// file-local global variables
+static int display_unit_tested = 0;     // number of test cases run
+static int display_unit_failed = 0;     // number of test cases failed
+
+// a macro for shorthand calls to expect()
+#define EXPECT(cond) { unit_expect((cond), __LINE__); }
+
+// Checks 'condition', increments display_unit_tested, prints FAIL or PASS
+void unit_expect(bool condition, int linenum)
+{
+  display_unit_tested++;
+  if (condition) {
+    printf("PASS test %03d at line %d\n", display_unit_tested, linenum);
+  } else {
+    printf("FAIL test %03d at line %d\n", display_unit_tested, linenum);
+    display_unit_failed++;
+  }
+}
+
+// a small 3x5 frame, and a copy with one cell changed
+static const int nR = 3;
+static const int nC = 5;
+static const char *frame1 = "+---+\n|.@.|\n+---+\n";
+static const char *frame2 = "+---+\n|..@|\n+---+\n";
+
+/* **************************************** */
+int main()
+{
+  printf("starting unit test for display...\n");
+  int len;
+  const char *msg;
+
+  // error cases
+  EXPECT(display_new(0, nC) == NULL);
+  EXPECT(display_encode(NULL, frame1, &len) == NULL);
+  EXPECT(display_setMode(NULL, DISPLAY_DELTA) == false);
+  EXPECT(display_getMode(NULL) == DISPLAY_TEXT);
+
+  // text mode - every frame is a plain DISPLAY message
+  display_t *display = display_new(nR, nC);
+  EXPECT(display != NULL);
+  EXPECT(display_getMode(display) == DISPLAY_TEXT);
+  msg = display_encode(display, frame1, &len);
+  EXPECT(strncmp(msg, "DISPLAY\n", 8) == 0);
+  EXPECT(strcmp(msg + 8, frame1) == 0);
+  EXPECT(len == (int) strlen(msg));
+  // the frame need not be copied: the message is the header, then the frame
+  struct iovec iov[2];
+  EXPECT(display_encodev(display, frame1, iov) == 2);
+  EXPECT(iov[0].iov_len == 8 && strncmp(iov[0].iov_base, "DISPLAY\n", 8) == 0);
+  EXPECT(iov[1].iov_base == frame1 && iov[1].iov_len == strlen(frame1));
+  // there is nothing to acknowledge in text mode
+  EXPECT(display_ack(display, 1) == false);
+
+  // delta mode - the first frame is sent in full
+  EXPECT(display_setMode(display, DISPLAY_DELTA));
+  msg = display_encode(display, frame1, &len);
+  EXPECT(strncmp(msg, "FRAME 1\n", 8) == 0);
+  EXPECT(strcmp(msg + 8, frame1) == 0);
+  // without an acknowledgement there is no base, so the next is in full too
+  msg = display_encode(display, frame2, &len);
+  EXPECT(strncmp(msg, "FRAME 2\n", 8) == 0);
+
+  // acknowledgements must name a frame we sent
+  EXPECT(display_ack(display, 0) == false);
+  EXPECT(display_ack(display, 3) == false);
+  EXPECT(display_ack(display, 1));
+
+  // a delta against frame 1 rebuilds frame 2
+  msg = display_encode(display, frame2, &len);
+  EXPECT(strncmp(msg, "DELTA 3 1\n", 10) == 0);
+  EXPECT(len < (int) strlen(frame2));
+  char client[64];
+  strcpy(client, frame1);
+  EXPECT(display_applyDelta(client, nR, nC, msg + 10));
+  EXPECT(strcmp(client, frame2) == 0);
+
+  // an identical frame gives an empty delta
+  EXPECT(display_ack(display, 3));
+  msg = display_encode(display, frame2, &len);
+  EXPECT(strcmp(msg, "DELTA 4 3\n") == 0);
+
+  // a resync forces the next frame to be sent in full
+  display_resync(display);
+  msg = display_encode(display, frame1, &len);
+  EXPECT(strncmp(msg, "FRAME 5\n", 8) == 0);
+
+  // a base that has fallen out of the history is no longer usable
+  EXPECT(display_ack(display, 5));
+  for (int i = 0; i < display_History; i++) {
+    display_encode(display, frame1, &len);
+  }
+  EXPECT(display_ack(display, 5) == false);
+  msg = display_encode(display, frame2, &len);
+  EXPECT(strncmp(msg, "FRAME ", 6) == 0);
+
+  // a run that begins with blanks keeps them, as most rows of a grid do
+  const char *dark = "+---+\n|  @|\n+---+\n";
+  char runs[64];
+  EXPECT(display_diff(dark, frame2, nR, nC, runs, sizeof(runs)) > 0);
+  EXPECT(strncmp(runs, "1 1  ", 5) == 0);
+  strcpy(client, frame2);
+  EXPECT(display_applyDelta(client, nR, nC, runs));
+  EXPECT(strcmp(client, dark) == 0);
+  strcpy(client, frame1);
+  EXPECT(display_applyDelta(client, nR, nC, "1 1    \n"));
+  EXPECT(strcmp(client, "+---+\n|   |\n+---+\n") == 0);
+
+  // malformed or out-of-bounds runs are rejected
+  strcpy(client, frame1);
+  EXPECT(display_applyDelta(client, nR, nC, "") == true);
+  EXPECT(display_applyDelta(client, nR, nC, "1 2 .@\n") == true);
+  EXPECT(strcmp(client, frame2) == 0);
+  EXPECT(display_applyDelta(client, nR, nC, "3 0 .\n") == false);
+  EXPECT(display_applyDelta(client, nR, nC, "0 4 ..\n") == false);
+  EXPECT(display_applyDelta(client, nR, nC, "0 0 +") == false);
+  EXPECT(display_applyDelta(client, nR, nC, "x y z\n") == false);
+  EXPECT(display_applyDelta(client, nR, nC, "0 0\n") == false);
+  EXPECT(display_applyDelta(client, nR, nC, "0 0") == false);
+
+  // rle mode - frames are compressed, and decode to the original
+  EXPECT(display_setMode(display, DISPLAY_RLE));
+  EXPECT(display_getMode(display) == DISPLAY_RLE);
+  msg = display_encode(display, frame1, &len);
+  EXPECT(strcmp(msg, "RLE\n+---+\n|.@.|\n+---+\n") == 0);
+  EXPECT(display_decodeRLE(msg + 4, client, (int) strlen(frame1)));
+  // an encoded frame is a single buffer
+  EXPECT(display_encodev(display, frame1, iov) == 1);
+  EXPECT(iov[0].iov_len == strlen(msg) && strcmp(iov[0].iov_base, msg) == 0);
+  EXPECT(strcmp(client, frame1) == 0);
+  display_delete(display);
+
+  // a large, mostly blank frame shrinks several-fold
+  const int bigR = 40, bigC = 100;
+  char *big = malloc(bigR * (bigC + 1) + 1);
+  char *decoded = malloc(bigR * (bigC + 1) + 1);
+  for (int r = 0; r < bigR; r++) {
+    char *row = big + r * (bigC + 1);
+    memset(row, ' ', bigC);
+    row[bigC] = '\n';
+  }
+  memset(big + 10 * (bigC + 1) + 20, '-', 30);
+  memset(big + 11 * (bigC + 1) + 20, '.', 30);
+  big[11 * (bigC + 1) + 25] = '7';   // digits and marks must survive the encoding
+  big[11 * (bigC + 1) + 26] = '~';
+  big[bigR * (bigC + 1)] = '\0';
+  display = display_new(bigR, bigC);
+  display_setMode(display, DISPLAY_RLE);
+  msg = display_encode(display, big, &len);
+  EXPECT(len * 10 < bigR * (bigC + 1));
+  EXPECT(display_decodeRLE(msg + 4, decoded, bigR * (bigC + 1)));
+  EXPECT(strcmp(decoded, big) == 0);
+  display_delete(display);
+  free(big);
+  free(decoded);
+
+  // malformed rle is rejected
+  EXPECT(display_decodeRLE("~3", client, 3) == false);
+  EXPECT(display_decodeRLE("~a", client, 1) == false);
+  EXPECT(display_decodeRLE("~0a", client, 0) == false);
+  EXPECT(display_decodeRLE("~4a", client, 3) == false);
+  EXPECT(display_decodeRLE("~2a", client, 3) == false);
+  EXPECT(display_decodeRLE("~2a3", client, 3) == true);
+  EXPECT(strcmp(client, "aa3") == 0);
+
+  // basemap mode - the map once, then drawn cells and occupants
+  const char *map =   "+------------------+\n|..................|\n+------------------+\n";
+  const char *view1 = "+--                 \n|.A*                \n+--                 \n";
+  const char *view2 = "+----               \n|..A.               \n+----               \n";
+  const char *view3 = "+------------------+\n|.................B|\n+------------------+\n";
+  const char *blank = "                    \n                    \n                    \n";
+  char frames[2][80];
+  int seq, base, ntoggle, skip;
+  display = display_new(3, 20);
+  EXPECT(display_setMode(display, DISPLAY_BASEMAP) == false);
+  EXPECT(display_encodeBase(display, &len) == NULL);
+  EXPECT(display_setBase(display, map));
+  EXPECT(display_setMode(display, DISPLAY_BASEMAP));
+  // the map is sent once
+  msg = display_encodeBase(display, &len);
+  EXPECT(msg != NULL && strncmp(msg, "MAP\n", 4) == 0 && strcmp(msg + 4, map) == 0);
+  EXPECT(display_encodeBase(display, &len) == NULL);
+  // with nothing acknowledged, the view is built on a blank frame
+  msg = display_encode(display, view1, &len);
+  EXPECT(sscanf(msg, "VIEW %d %d %d\n%n", &seq, &base, &ntoggle, &skip) == 3);
+  EXPECT(seq == 1 && base == 0 && ntoggle == 3);
+  strcpy(frames[0], blank);
+  EXPECT(display_applyView(frames[0], map, 3, 20, ntoggle, msg + skip));
+  EXPECT(strcmp(frames[0], view1) == 0);
+  // after an ack, only the changes travel
+  EXPECT(display_ack(display, 1));
+  msg = display_encode(display, view2, &len);
+  EXPECT(sscanf(msg, "VIEW %d %d %d\n%n", &seq, &base, &ntoggle, &skip) == 3);
+  EXPECT(seq == 2 && base == 1);
+  strcpy(frames[1], frames[0]);
+  EXPECT(display_applyView(frames[1], map, 3, 20, ntoggle, msg + skip));
+  EXPECT(strcmp(frames[1], view2) == 0);
+  // frame 2 was never acknowledged, so frame 3 is still built on frame 1
+  msg = display_encode(display, view3, &len);
+  EXPECT(sscanf(msg, "VIEW %d %d %d\n%n", &seq, &base, &ntoggle, &skip) == 3);
+  EXPECT(seq == 3 && base == 1);
+  EXPECT(display_applyView(frames[0], map, 3, 20, ntoggle, msg + skip));
+  EXPECT(strcmp(frames[0], view3) == 0);
+  // a resync sends the map again
+  display_resync(display);
+  EXPECT(display_encodeBase(display, &len) != NULL);
+  // malformed toggles are rejected
+  EXPECT(display_applyView(frames[0], map, 3, 20, 1, "") == false);
+  EXPECT(display_applyView(frames[0], map, 3, 20, 1, "0 18 3\n") == false);
+  EXPECT(display_applyView(frames[0], map, 3, 20, 1, "0 0\n") == false);
+  display_delete(display);
+
+  // binary mode - cells are packed two to a byte, other chars in a side table
+  display = display_new(3, 20);
+  EXPECT(display_setMode(display, DISPLAY_BINARY));
+  msg = display_encode(display, view1, &len);
+  EXPECT(strncmp(msg, "BINARY A\n", 9) == 0);
+  EXPECT(len == 9 + (3 * 20 + 1) / 2);
+  EXPECT((unsigned char) msg[9] == 0x31);       // '+' then '-'
+  EXPECT((unsigned char) msg[9 + 10] == 0x24);  // '|' then '.'
+  EXPECT(display_decodeBinary(msg, len, frames[0], 3, 20));
+  EXPECT(strcmp(frames[0], view1) == 0);
+  // a frame of only fixed codes has no side table
+  msg = display_encode(display, map, &len);
+  EXPECT(strncmp(msg, "BINARY\n", 7) == 0);
+  EXPECT(display_decodeBinary(msg, len, frames[0], 3, 20));
+  EXPECT(strcmp(frames[0], map) == 0);
+  // an odd number of cells, and more players than the side table holds
+  const char *crowd = "ABCDEFGHI\n";
+  display_delete(display);
+  display = display_new(1, 9);
+  display_setMode(display, DISPLAY_BINARY);
+  msg = display_encode(display, crowd, &len);
+  EXPECT(strncmp(msg, "DISPLAY\n", 8) == 0);
+  msg = display_encode(display, "@ABCDEFG*\n", &len);
+  EXPECT(len == (int) strlen("BINARY ABCDEFG\n") + 5);
+  EXPECT(display_decodeBinary(msg, len, frames[0], 1, 9));
+  EXPECT(strcmp(frames[0], "@ABCDEFG*\n") == 0);
+  // malformed messages are rejected
+  EXPECT(display_decodeBinary(msg, len - 1, frames[0], 1, 9) == false);
+  EXPECT(display_decodeBinary("BINARY\n\x77\x77\x77\x77\x70", 12, frames[0], 1, 9) == true);
+  EXPECT(display_decodeBinary("BINARY\n\x8F\x77\x77\x77\x70", 12, frames[0], 1, 9) == false);
+  EXPECT(display_decodeBinary("BINARYX\n", 8, frames[0], 1, 0) == false);
+  display_delete(display);
+
+  // viewport mode - a window around the centre, kept inside the grid
+  display = display_new(3, 20);
+  EXPECT(display_setMode(display, DISPLAY_VIEWPORT) == false);
+  EXPECT(display_setWindow(display, 0, 5) == false);
+  EXPECT(display_setWindow(display, 1, 5));
+  EXPECT(display_setMode(display, DISPLAY_VIEWPORT));
+  display_setCentre(display, 1, 3);
+  msg = display_encode(display, view2, &len);
+  EXPECT(strcmp(msg, "WINDOW 1 1 1 5\n..A. \n") == 0);
+  // near an edge, the window stops at the edge
+  display_setCentre(display, 2, 0);
+  msg = display_encode(display, view2, &len);
+  EXPECT(strcmp(msg, "WINDOW 2 0 1 5\n+----\n") == 0);
+  display_setCentre(display, 0, 19);
+  msg = display_encode(display, map, &len);
+  EXPECT(strcmp(msg, "WINDOW 0 15 1 5\n----+\n") == 0);
+  // out-of-bounds centres are ignored, and big windows fit the grid
+  display_setCentre(display, 3, 0);
+  msg = display_encode(display, map, &len);
+  EXPECT(strncmp(msg, "WINDOW 0 15 ", 12) == 0);
+  EXPECT(display_setWindow(display, 10, 100));
+  msg = display_encode(display, map, &len);
+  EXPECT(strncmp(msg, "WINDOW 0 0 3 20\n", 16) == 0);
+  EXPECT(strcmp(msg + 16, map) == 0);
+  display_delete(display);
+
+  printf("unit test complete\n");
+
+  // print a summary
+  if (display_unit_failed > 0) {
+    printf("FAILED %d of %d tests\n", display_unit_failed, display_unit_tested);
+    return display_unit_failed;
+  } else {
+    printf("PASSED all of %d tests\n", display_unit_tested);
+    return 0;
+  }
+}
@@ -13,26 +13,57 @@
  #include "file.h"
  #include "memory.h"
  #include <math.h>
-
-/**************** file-local global variables ****************/
-/* none */
+ #if defined(__x86_64__) || defined(__i386__)
+ #include <immintrin.h>
+ #define GRID_X86 // SSE2/AVX2 rendering kernels are available
+ #endif
 
 /**************** local types ****************/
-/* none */
+/* A rendering kernel draws one row of the grid into 'out':
+ * for each of the n points, ' ' if not seen, '.' if a gold pile that is
+ * not visible, otherwise the character in 'c'.
+ * 'seen' and 'visible' are masks holding 0x00 (false) or 0xFF (true).
+ */
+typedef void (*render_kernel_t)(const char *c, const unsigned char *seen,
+                                const unsigned char *visible, int n, char *out);
+
+/**************** file-local functions ****************/
+static void render_scalar(const char *c, const unsigned char *seen,
+                          const unsigned char *visible, int n, char *out);
+#ifdef GRID_X86
+static void render_sse2(const char *c, const unsigned char *seen,
+                        const unsigned char *visible, int n, char *out);
+static void render_avx2(const char *c, const unsigned char *seen,
+                        const unsigned char *visible, int n, char *out);
+#endif
 
-/**************** global types ****************/
-typedef struct point {
-  char c;     // char at the point
-  bool seen_before;   // has the player ever seen this point before
-  bool visible_now;   // is the point visible from a player's current position
-  int gold_number;  // amount of gold (gold piles)
-} point_t;
+/**************** file-local global variables ****************/
+static render_kernel_t render_kernel = NULL; // chosen on first render
 
+/**************** global types ****************/
+/* The grid is stored as planes, one array per attribute, each holding
+ * nR rows of nC points; point (x,y) is at index y*nC + x in every plane.
+ */
  typedef struct grid_struct {
    int nR; // number of rows
    int nC; // number of columns
    int room_spot; // number of room spots
-   point_t*** grid; // 2d array of pointers to points
+   char *c;                 // char at each point
+   unsigned char *seen;     // 0xFF if the player has ever seen the point
+   unsigned char *visible;  // 0xFF if the point is visible from the player's position
+   int *gold;               // amount of gold at each point (gold piles)
+   unsigned long epoch;       // bumped on every change to the grid
+   unsigned long *row_epoch;  // epoch at which each row last changed
+   char *text;                // cached rendering of the grid (NULL until rendered)
+   unsigned long text_epoch;  // our epoch when text was last rendered
+   unsigned long text_main_epoch; // main grid epoch when text was last rendered
+   int text_x;                // player x when text was last rendered
+   int text_y;                // player y when text was last rendered
+   unsigned long text_version; // bumped by each render that changes text
+   char *row_was;             // a row of text as it was before drawing it again
+   int vis_x;                 // x visibility was last calculated from; -1 if none
+   int vis_y;                 // y visibility was last calculated from
+   unsigned long vis_epoch;   // our epoch when visibility was last calculated
  } grid_struct_t;
 
  typedef struct position {
@@ -49,6 +80,12 @@ typedef struct point {
 static bool calculate_vision(grid_struct_t *grid_struct, int x1, int y1, int x2, int y2);
 static bool calculate_helper_y(grid_struct_t *grid_struct, double x, int y);
 static bool calculate_helper_x(grid_struct_t *grid_struct, int x, double y);
+static void mark_row(grid_struct_t *grid_struct, int row);
+static char *text_alloc(grid_struct_t *grid_struct);
+static render_kernel_t choose_kernel(void);
+static void render_row(grid_struct_t *grid_struct, int r, char *out);
+static void render_row_player(grid_struct_t *main_grid, grid_struct_t *player_grid,
+                              position_t *player_pos, int r, char *out);
 
 /**************** global functions ****************/
 /* that is, visible outside this file */
@@ -61,6 +98,17 @@ grid_struct_new(char *filename)
   // allocate memory; error message on error
   grid_struct_t *grid = count_malloc_assert(sizeof(grid_struct_t), "grid_struct_t");
   grid->room_spot = 0;
+  grid->epoch = 0;
+  grid->text = NULL;
+  grid->text_epoch = 0;
+  grid->text_main_epoch = 0;
+  grid->text_x = -1;
+  grid->text_y = -1;
+  grid->text_version = 0;
+  grid->row_was = NULL;
+  grid->vis_x = -1;
+  grid->vis_y = -1;
+  grid->vis_epoch = 0;
 
   FILE *grid_file;
   if ((grid_file = fopen(filename, "r")) == NULL) {
@@ -82,11 +130,15 @@ grid_struct_new(char *filename)
   }
   grid->nC = max;
 
-  // allocate memory for the 2d array
-  grid->grid = count_malloc_assert(grid->nR * sizeof(point_t**), "grid_struct_t");
-  for(int i = 0; i < grid->nR; i++) {
-    grid->grid[i] = count_malloc_assert(grid->nC * sizeof(point_t*), "grid_struct_t");
-  }
+  // allocate memory for the planes; every point starts as unseen solid rock
+  int n = grid->nR * grid->nC;
+  grid->c = count_malloc_assert(n + 1, "grid_struct_t");
+  memset(grid->c, ' ', n);
+  grid->seen = count_calloc_assert(n + 1, 1, "grid_struct_t");
+  grid->visible = count_calloc_assert(n + 1, 1, "grid_struct_t");
+  grid->gold = count_calloc_assert(n + 1, sizeof(int), "grid_struct_t");
+  // every row starts out clean, at epoch zero
+  grid->row_epoch = count_calloc_assert(grid->nR, sizeof(unsigned long), "grid row epochs");
 
   fclose(grid_file);
   return grid;
@@ -107,24 +159,32 @@ grid_load(grid_struct_t *grid_struct, char* filename, bool seen)
     fprintf(stderr, "Unable to load map file.\n");
     return false;
   }
+  // every point starts out seen (or not); short lines stay solid rock
+  int n = grid_struct->nR * grid_struct->nC;
+  memset(grid_struct->seen, seen ? 0xFF : 0, n);
+  memset(grid_struct->visible, seen ? 0xFF : 0, n);
   // loop through each char in the map file
   char *line;
   int i = 0;
-  while ((line = freadlinep(map)) != NULL) {
-    for (int j = 0; j < strlen(line); j ++) {
-      // instantiate a point using the char
-      point_t *p = point_new(line[j], seen, 0);
+  while ((line = freadlinep(map)) != NULL && i < grid_struct->nR) {
+    int len = strlen(line);
+    for (int j = 0; j < len && j < grid_struct->nC; j ++) {
       // mark it if the char is a room spot
       if (line[j] == '.') {
         grid_struct->room_spot = grid_struct->room_spot +1;
       }
       // add to grid array
-      grid_struct->grid[i][j] = p;
+      grid_struct->c[i * grid_struct->nC + j] = line[j];
+      grid_struct->gold[i * grid_struct->nC + j] = 0;
     }
     i++;
     free(line);
   }
+  free(line);
   fclose(map);
+  // every point may have changed: draw every row again, and calculate
+  // visibility again
+  grid_invalidate(grid_struct);
   return true;
 }
 
@@ -175,9 +235,13 @@ grid_set_character(grid_struct_t *grid_struct, char newChar, position_t *pos)
   }
 
   // store a copy of the current char
-  char oldChar = grid_struct->grid[pos->y][pos->x]->c;
-  // update with new char
-  grid_struct->grid[pos->y][pos->x]->c = newChar;
+  char *point = &grid_struct->c[pos->y * grid_struct->nC + pos->x];
+  char oldChar = *point;
+  // update with new char, and note the row needs to be rendered again
+  *point = newChar;
+  if (oldChar != newChar) {
+    mark_row(grid_struct, pos->y);
+  }
   return oldChar;
 }
 
@@ -197,9 +261,9 @@ grid_set_gold(grid_struct_t *grid_struct, int newGold, position_t *pos)
   }
 
   // store a copy of the current amount of gold
-  int oldGold = grid_struct->grid[pos->y][pos->x]->gold_number;
+  int oldGold = grid_struct->gold[pos->y * grid_struct->nC + pos->x];
   // update with new amount of gold
-  grid_struct->grid[pos->y][pos->x]->gold_number = newGold;
+  grid_struct->gold[pos->y * grid_struct->nC + pos->x] = newGold;
   return oldGold;
 }
 
@@ -245,7 +309,7 @@ grid_get_point_c(grid_struct_t *grid_struct, int x, int y)
   if (grid_struct == NULL || x < 0 || x >= grid_struct->nC || y < 0 || y >= grid_struct->nR) {
     return '\0';
   }
-  return grid_struct->grid[y][x]->c;
+  return grid_struct->c[y * grid_struct->nC + x];
 }
 
 /**************** grid_get_point_gold ****************/
@@ -257,7 +321,7 @@ grid_get_point_gold(grid_struct_t *grid_struct, int x, int y)
   if (grid_struct == NULL || x < 0 || x >= grid_struct->nC || y < 0 || y >= grid_struct->nR) {
     return -1;
   }
-  return grid_struct->grid[y][x]->gold_number;
+  return grid_struct->gold[y * grid_struct->nC + x];
 }
 
 /**************** grid_string ****************/
@@ -266,35 +330,13 @@ char*
 grid_string(grid_struct_t *grid_struct)
 {
   // check parameters
-  if(grid_struct == NULL) {
+  const char *text = grid_render(grid_struct);
+  if(text == NULL) {
     return NULL;
   }
-
-  // allocate memory; error message on error
-  char *grid_text = count_malloc_assert((grid_struct->nR)*(grid_struct->nC+1)*sizeof(char*),
-                                              "grid as string");
-  bool first_char = true; // track if we are reading the first char
-  for (int i = 0; i < grid_struct->nR; i++) {
-    for (int j = 0; j < grid_struct->nC; j++) {
-      // Get the character at row = i, column = j
-      char a;
-      if(grid_struct->grid[i][j]->seen_before) {
-        a = grid_struct->grid[i][j]->c;
-      } else {
-        a = ' ';
-      }
-
-      if (first_char) {
-        strcpy(grid_text, &a);
-        first_char = false;
-      }
-      else {
-        strcat(grid_text, &a);
-      }
-    }
-    // Start on a new line for the next iteration of the for loop
-    strcat(grid_text, "\n");
-  }
+  // hand the caller their own copy of the cached text
+  char *grid_text = count_malloc_assert(strlen(text) + 1, "grid as string");
+  strcpy(grid_text, text);
   return grid_text;
 }
 
@@ -302,55 +344,154 @@ grid_string(grid_struct_t *grid_struct)
 /* see grid.h for documentation */
 char*
 grid_string_player(grid_struct_t *main_grid, grid_struct_t *player_grid, position_t* player_pos)
+{
+  // check parameters
+  const char *text = grid_render_player(main_grid, player_grid, player_pos);
+  if(text == NULL) {
+    return NULL;
+  }
+  // hand the caller their own copy of the cached text
+  char *grid_text = count_malloc_assert(strlen(text) + 1, "grid as string");
+  strcpy(grid_text, text);
+  return grid_text;
+}
+
+/**************** grid_render ****************/
+/* see grid.h for documentation */
+const char*
+grid_render(grid_struct_t *grid_struct)
+{
+  // check parameters
+  if(grid_struct == NULL) {
+    return NULL;
+  }
+  // first render draws every row
+  bool all = (grid_struct->text == NULL);
+  if (all) {
+    text_alloc(grid_struct);
+  }
+  // only draw the rows that changed since the last render, and note
+  // whether the text did
+  bool changed = all;
+  for (int r = 0; r < grid_struct->nR; r++) {
+    if (all || grid_struct->row_epoch[r] > grid_struct->text_epoch) {
+      char *out = grid_struct->text + r * (grid_struct->nC + 1);
+      memcpy(grid_struct->row_was, out, grid_struct->nC);
+      render_row(grid_struct, r, out);
+      changed = changed || memcmp(grid_struct->row_was, out, grid_struct->nC) != 0;
+    }
+  }
+  grid_struct->text_epoch = grid_struct->epoch;
+  if (changed) {
+    grid_struct->text_version++;
+  }
+  return grid_struct->text;
+}
+
+/**************** grid_render_player ****************/
+/* see grid.h for documentation */
+const char*
+grid_render_player(grid_struct_t *main_grid, grid_struct_t *player_grid, position_t* player_pos)
 {
   // check parameters
   if(main_grid == NULL || player_grid == NULL || player_pos == NULL) {
     return NULL;
   }
+  if(main_grid->nR != player_grid->nR || main_grid->nC != player_grid->nC) {
+    return NULL;
+  }
+  // first render draws every row
+  bool all = (player_grid->text == NULL);
+  if (all) {
+    text_alloc(player_grid);
+  }
+  int old_y = player_grid->text_y;  // row that held our '@' last time
+  int new_y = pos_get_y(player_pos);
+  bool moved = (player_grid->text_x != pos_get_x(player_pos) || old_y != new_y);
+
+  // a row is drawn again if the occupants/terrain changed on the main grid,
+  // if our own visibility of it changed, or if our '@' entered or left it;
+  // but the text changes only if what the player sees in it did
+  bool changed = all;
+  for (int r = 0; r < main_grid->nR; r++) {
+    if (all
+        || main_grid->row_epoch[r] > player_grid->text_main_epoch
+        || player_grid->row_epoch[r] > player_grid->text_epoch
+        || (moved && (r == old_y || r == new_y))) {
+      char *out = player_grid->text + r * (main_grid->nC + 1);
+      memcpy(player_grid->row_was, out, main_grid->nC);
+      render_row_player(main_grid, player_grid, player_pos, r, out);
+      changed = changed || memcmp(player_grid->row_was, out, main_grid->nC) != 0;
+    }
+  }
+  if (changed) {
+    player_grid->text_version++;
+  }
+  player_grid->text_epoch = player_grid->epoch;
+  player_grid->text_main_epoch = main_grid->epoch;
+  player_grid->text_x = pos_get_x(player_pos);
+  player_grid->text_y = new_y;
+  return player_grid->text;
+}
 
-  // allocate memory; error message on error
-  char *grid_text = count_malloc_assert((main_grid->nR)*(main_grid->nC+1)*sizeof(char*),
-                                            "grid as string");
-  bool first_char = true; // track if we are reading the first char
-  // loop through points in grid
-  for (int i = 0; i < main_grid->nR; i++) {
-    for (int j = 0; j < main_grid->nC; j++) {
-      // Get the character at row = i, column = j
-      char a;
-      // if this is the current player, display as '@'
-      if(pos_get_x(player_pos) == j && pos_get_y(player_pos) == i) {
-        a = '@';
-      } else if(player_grid->grid[i][j]->seen_before) {
-          // if a gold spot
-          if(main_grid->grid[i][j]->c == '*') {
-            // print the gold only if we can see it in our current position
-            if(player_grid->grid[i][j]->visible_now) {
-              a = '*';
-            // otherwise, print a room spot
-            } else {
-              a = '.';
-            }
-          // if not a gold spot, print the char at the point
-          } else {
-              a = main_grid->grid[i][j]->c;
-          }
-      // if the point is not visible, print an empty space
-      } else {
-        a = ' ';
-      }
+/**************** grid_version ****************/
+/* see grid.h for documentation */
+unsigned long
+grid_version(const grid_struct_t *grid_struct)
+{
+  return (grid_struct == NULL) ? 0 : grid_struct->text_version;
+}
 
-      if (first_char) {
-        strcpy(grid_text, &a);
-        first_char = false;
-      }
-      else {
-        strcat(grid_text, &a);
-      }
+/**************** grid_invalidate ****************/
+/* see grid.h for documentation */
+void
+grid_invalidate(grid_struct_t *grid_struct)
+{
+  if(grid_struct == NULL) { // check parameters
+    return;
+  }
+  for (int r = 0; r < grid_struct->nR; r++) {
+    mark_row(grid_struct, r);
+  }
+}
+
+/**************** grid_set_simd ****************/
+/* see grid.h for documentation */
+bool
+grid_set_simd(bool enable)
+{
+  render_kernel = enable ? choose_kernel() : render_scalar;
+  return render_kernel != render_scalar;
+}
+
+/**************** grid_set_kernel ****************/
+/* see grid.h for documentation */
+bool
+grid_set_kernel(grid_kernel_t kernel)
+{
+  switch (kernel) {
+  case GRID_SCALAR:
+    render_kernel = render_scalar;
+    return true;
+#ifdef GRID_X86
+  case GRID_SSE2:
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+      render_kernel = render_sse2;
+      return true;
+    }
+    return false;
+  case GRID_AVX2:
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+      render_kernel = render_avx2;
+      return true;
     }
-    // Start on a new line for the next iteration of the for loop
-    strcat(grid_text, "\n");
+    return false;
+#endif
+  default:
+    return false;
   }
-  return grid_text;
 }
 
 /**************** grid_print ****************/
@@ -381,20 +522,40 @@ grid_visibility(grid_struct_t *grid_struct, position_t *pos)
           || pos_get_y(pos) < 0 || pos_get_y(pos) >= grid_struct->nR) {
     return;
   }
+  // from the same place, in the same grid, nothing more can be seen
+  if (pos_get_x(pos) == grid_struct->vis_x && pos_get_y(pos) == grid_struct->vis_y
+      && grid_struct->epoch == grid_struct->vis_epoch) {
+    return;
+  }
 
   // otherwise, look through all points in the grid
   for(int r = 0; r < grid_struct->nR; r++) {
+    bool changed = false;   // did anything in this row change?
+    unsigned char *seen = &grid_struct->seen[r * grid_struct->nC];
+    unsigned char *visible = &grid_struct->visible[r * grid_struct->nC];
     for(int c = 0; c < grid_struct->nC; c++) {
+      unsigned char was_seen = seen[c];
+      unsigned char was_visible = visible[c];
       // calculate whether they can see this point froom their current position
       if(calculate_vision(grid_struct, pos_get_x(pos), pos_get_y(pos), c, r)) {
         // if so, mark the point's visibility as true
-        grid_struct->grid[r][c]->seen_before = true;
-        grid_struct->grid[r][c]->visible_now = true;
+        seen[c] = 0xFF;
+        visible[c] = 0xFF;
       } else {
-        grid_struct->grid[r][c]->visible_now = false;
+        visible[c] = 0;
+      }
+      if (was_seen != seen[c] || was_visible != visible[c]) {
+        changed = true;
       }
     }
+    // only rows whose visibility changed need to be rendered again
+    if (changed) {
+      mark_row(grid_struct, r);
+    }
   }
+  grid_struct->vis_x = pos_get_x(pos);
+  grid_struct->vis_y = pos_get_y(pos);
+  grid_struct->vis_epoch = grid_struct->epoch;
 }
 
 /**************** grid_delete ****************/
@@ -405,45 +566,16 @@ grid_delete(grid_struct_t *grid_struct)
   if(grid_struct == NULL) {
     return;
   }
-  // for each point in the grid
-  for (int r = 0; r < grid_struct->nR; r++) {
-    for (int c = 0; c < grid_struct->nC; c++) {
-      point_delete(grid_struct->grid[r][c]); // free each *point_t
-    }
-    free(grid_struct->grid[r]); // free each **point_t
-  }
-  free(grid_struct->grid); // free the ***point_t
+  free(grid_struct->c);
+  free(grid_struct->seen);
+  free(grid_struct->visible);
+  free(grid_struct->gold);
+  free(grid_struct->row_epoch);
+  free(grid_struct->text);
+  free(grid_struct->row_was);
   free(grid_struct);
 }
 
-/**************** point_new ****************/
-/* see grid.h for documentation */
-point_t*
-point_new(char c, bool seen, int gold_number)
-{
-  // allocate memory; error message on error
-  point_t *point = count_malloc_assert(sizeof(point_t), "point_t");
-  if (point == NULL) {
-    return NULL;
-  }
-  point->c = c;
-  point->seen_before = seen;
-  point->visible_now = seen;
-  point->gold_number = gold_number;
-  return point;
-}
-
-/**************** point_delete ****************/
-/* see grid.h for documentation */
-void
-point_delete(point_t *point)
-{
-  if(point == NULL) { // check parameters
-    return;
-  }
-  free(point);
-}
-
 /**************** position_new ****************/
 /* see grid.h for documentation */
 position_t*
@@ -508,6 +640,189 @@ position_delete(position_t *pos)
  * INTERNAL FUNCTIONS
  ***********************************************************************/
 
+/**************** mark_row ****************/
+/* Helper method to record that a row of the grid has changed, so the
+ * next render draws that row again.  Every change starts a new epoch.
+ */
+static void
+mark_row(grid_struct_t *grid_struct, int row)
+{
+  grid_struct->epoch++;
+  grid_struct->row_epoch[row] = grid_struct->epoch;
+}
+
+/**************** text_alloc ****************/
+/* Helper method to allocate the cached rendering of a grid:
+ * nR rows of nC chars plus a newline each, then a terminating null.
+ */
+static char *
+text_alloc(grid_struct_t *grid_struct)
+{
+  int len = grid_struct->nR * (grid_struct->nC + 1);
+  grid_struct->text = count_malloc_assert(len + 1, "grid as string");
+  for (int r = 0; r < grid_struct->nR; r++) {
+    grid_struct->text[r * (grid_struct->nC + 1) + grid_struct->nC] = '\n';
+  }
+  grid_struct->text[len] = '\0';
+  grid_struct->row_was = count_malloc_assert(grid_struct->nC + 1, "grid row");
+  return grid_struct->text;
+}
+
+/**************** render_row ****************/
+/* Helper method to draw row r of a grid (as seen by the spectator)
+ * into the nC chars at 'out'.
+ */
+static void
+render_row(grid_struct_t *grid_struct, int r, char *out)
+{
+  if (render_kernel == NULL) {
+    render_kernel = choose_kernel();
+  }
+  // the spectator sees every point it has seen, gold included
+  int row = r * grid_struct->nC;
+  render_kernel(&grid_struct->c[row], &grid_struct->seen[row],
+                &grid_struct->seen[row], grid_struct->nC, out);
+}
+
+/**************** render_row_player ****************/
+/* Helper method to draw row r of the grid as known by a player
+ * into the nC chars at 'out'; takes into account the visibility.
+ */
+static void
+render_row_player(grid_struct_t *main_grid, grid_struct_t *player_grid,
+                  position_t *player_pos, int r, char *out)
+{
+  if (render_kernel == NULL) {
+    render_kernel = choose_kernel();
+  }
+  // occupants come from the main grid, visibility from the player's grid
+  int row = r * main_grid->nC;
+  render_kernel(&main_grid->c[row], &player_grid->seen[row],
+                &player_grid->visible[row], main_grid->nC, out);
+  // if this is the current player's row, display them as '@'
+  if (pos_get_y(player_pos) == r && pos_get_x(player_pos) >= 0
+      && pos_get_x(player_pos) < main_grid->nC) {
+    out[pos_get_x(player_pos)] = '@';
+  }
+}
+
+/**************** choose_kernel ****************/
+/* Helper method to pick the fastest rendering kernel this CPU supports.
+ */
+static render_kernel_t
+choose_kernel(void)
+{
+#ifdef GRID_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return render_avx2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return render_sse2;
+  }
+#endif
+  return render_scalar;
+}
+
+/**************** render_scalar ****************/
+/* Rendering kernel that draws one point at a time; see render_kernel_t.
+ */
+static void
+render_scalar(const char *c, const unsigned char *seen,
+              const unsigned char *visible, int n, char *out)
+{
+  for (int j = 0; j < n; j++) {
+    // if the point has not been seen, print an empty space
+    if (!seen[j]) {
+      out[j] = ' ';
+    // print the gold only if we can see it in our current position;
+    // otherwise, print a room spot
+    } else if (c[j] == '*' && !visible[j]) {
+      out[j] = '.';
+    // if not a gold spot, print the char at the point
+    } else {
+      out[j] = c[j];
+    }
+  }
+}
+
+#ifdef GRID_X86
+/**************** render_sse2 ****************/
+/* Rendering kernel that draws 16 points at a time with SSE2 masks,
+ * finishing any leftover points with render_scalar; see render_kernel_t.
+ */
+__attribute__((target("sse2")))
+static void
+render_sse2(const char *c, const unsigned char *seen,
+            const unsigned char *visible, int n, char *out)
+{
+  const __m128i gold = _mm_set1_epi8('*');
+  const __m128i room = _mm_set1_epi8('.');
+  const __m128i rock = _mm_set1_epi8(' ');
+  int j = 0;
+  for (; j + 16 <= n; j += 16) {
+    __m128i ch = _mm_loadu_si128((const __m128i *)(c + j));
+    __m128i s = _mm_loadu_si128((const __m128i *)(seen + j));
+    __m128i v = _mm_loadu_si128((const __m128i *)(visible + j));
+    // gold piles we cannot see right now are drawn as room spots
+    __m128i hide = _mm_andnot_si128(v, _mm_cmpeq_epi8(ch, gold));
+    ch = _mm_or_si128(_mm_andnot_si128(hide, ch), _mm_and_si128(hide, room));
+    // points never seen are drawn as solid rock
+    ch = _mm_or_si128(_mm_and_si128(s, ch), _mm_andnot_si128(s, rock));
+    _mm_storeu_si128((__m128i *)(out + j), ch);
+  }
+  render_scalar(c + j, seen + j, visible + j, n - j, out + j);
+}
+
+/**************** render_avx2 ****************/
+/* Rendering kernel that draws 32 points at a time with AVX2 blends,
+ * finishing any leftover points itself; see render_kernel_t.
+ * (Handing the leftovers to render_sse2 would mix VEX and legacy SSE
+ * instructions, and the transition costs more than the whole row.)
+ */
+__attribute__((target("avx2")))
+static void
+render_avx2(const char *c, const unsigned char *seen,
+            const unsigned char *visible, int n, char *out)
+{
+  const __m256i gold = _mm256_set1_epi8('*');
+  const __m256i room = _mm256_set1_epi8('.');
+  const __m256i rock = _mm256_set1_epi8(' ');
+  int j = 0;
+  for (; j + 32 <= n; j += 32) {
+    __m256i ch = _mm256_loadu_si256((const __m256i *)(c + j));
+    __m256i s = _mm256_loadu_si256((const __m256i *)(seen + j));
+    __m256i v = _mm256_loadu_si256((const __m256i *)(visible + j));
+    // gold piles we cannot see right now are drawn as room spots
+    __m256i hide = _mm256_andnot_si256(v, _mm256_cmpeq_epi8(ch, gold));
+    ch = _mm256_blendv_epi8(ch, room, hide);
+    // points never seen are drawn as solid rock
+    ch = _mm256_blendv_epi8(rock, ch, s);
+    _mm256_storeu_si256((__m256i *)(out + j), ch);
+  }
+  // same again, 16 points at a time
+  for (; j + 16 <= n; j += 16) {
+    __m128i ch = _mm_loadu_si128((const __m128i *)(c + j));
+    __m128i s = _mm_loadu_si128((const __m128i *)(seen + j));
+    __m128i v = _mm_loadu_si128((const __m128i *)(visible + j));
+    __m128i hide = _mm_andnot_si128(v, _mm_cmpeq_epi8(ch, _mm256_castsi256_si128(gold)));
+    ch = _mm_blendv_epi8(ch, _mm256_castsi256_si128(room), hide);
+    ch = _mm_blendv_epi8(_mm256_castsi256_si128(rock), ch, s);
+    _mm_storeu_si128((__m128i *)(out + j), ch);
+  }
+  // and the last few points one at a time
+  for (; j < n; j++) {
+    if (!seen[j]) {
+      out[j] = ' ';
+    } else if (c[j] == '*' && !visible[j]) {
+      out[j] = '.';
+    } else {
+      out[j] = c[j];
+    }
+  }
+}
+#endif // GRID_X86
+
 /**************** calculate_vision ****************/
 /* Helper method to calculate visibility between two points
  *
@@ -543,7 +858,7 @@ calculate_vision(grid_struct_t *grid_struct, int x1, int y1, int x2, int y2)
        curr_y = y1 + y;
      }
      // if not a room spot, return false
-     if(grid_struct->grid[curr_y][x1]->c != '.')  {
+     if(grid_struct->c[curr_y * grid_struct->nC + x1] != '.')  {
        return false;
      }
    }
@@ -558,7 +873,7 @@ calculate_vision(grid_struct_t *grid_struct, int x1, int y1, int x2, int y2)
        curr_x = x1 + x;
      }
      // if not a room spot, return false
-     if(grid_struct->grid[y1][curr_x]->c != '.')  {
+     if(grid_struct->c[y1 * grid_struct->nC + curr_x] != '.')  {
        return false;
      }
    }
@@ -645,13 +960,13 @@ calculate_helper_x(grid_struct_t *grid_struct, int x, double y)
  // if line segment intersects a gridpoint exactly
  if(c == f) {
    // if gridpoint is not a 'room spot', return false
-   if(grid_struct->grid[c][x]->c != '.')  {
+   if(grid_struct->c[c * grid_struct->nC + x] != '.')  {
      return false;
    }
   // if line segment passes between pairs of map gridpoints
   } else {
    // if both gridpoints are not a 'room spot', return false
-   if(grid_struct->grid[c][x]->c != '.' && grid_struct->grid[f][x]->c != '.')  {
+   if(grid_struct->c[c * grid_struct->nC + x] != '.' && grid_struct->c[f * grid_struct->nC + x] != '.')  {
      return false;
    }
   }
@@ -687,12 +1002,12 @@ calculate_helper_y(grid_struct_t *grid_struct, double x, int y)
   // if line segment intersects a gridpoint exactly
   if(c == f) {
    // if gridpoint is not a 'room spot', return false
-   if(grid_struct->grid[y][c]->c != '.')  {
+   if(grid_struct->c[y * grid_struct->nC + c] != '.')  {
      return false;
    }
   } else {
    // if both gridpoints are not a 'room spot', return false
-   if(grid_struct->grid[y][c]->c != '.' && grid_struct->grid[y][f]->c != '.')  {
+   if(grid_struct->c[y * grid_struct->nC + c] != '.' && grid_struct->c[y * grid_struct->nC + f] != '.')  {
      return false;
    }
   }
@@ -15,8 +15,6 @@
 /**************** global types ****************/
 typedef struct grid_struct grid_struct_t;  // opaque to users of the module
 
-typedef struct point point_t;
-
 typedef struct position position_t;
 
 /**************** functions ****************/
@@ -107,6 +105,60 @@ char* grid_string(grid_struct_t *grid_struct);
  */
 char* grid_string_player(grid_struct_t *main_grid, grid_struct_t *player_grid, position_t* player_pos);
 
+/* ***************** grid_render ********************** */
+/* Like grid_string, but return the grid's own cached rendering.
+ * Only the rows that changed since the previous call are drawn again.
+ *
+ * We RETURN: pointer to the cached text, which the caller must NOT free and
+ * which is only valid until the next render or grid_delete; otherwise NULL.
+ */
+const char* grid_render(grid_struct_t *grid_struct);
+
+/* ***************** grid_render_player ********************** */
+/* Like grid_string_player, but return the player grid's own cached rendering.
+ * Only the rows touched by changes to the main grid, changes to the player's
+ * visibility, or the player's own move are drawn again.
+ *
+ * We RETURN: pointer to the cached text, which the caller must NOT free and
+ * which is only valid until the next render or grid_delete; otherwise NULL.
+ */
+const char* grid_render_player(grid_struct_t *main_grid, grid_struct_t *player_grid, position_t* player_pos);
+
+/* ***************** grid_version ********************** */
+/* Return the version of the grid's cached rendering (from grid_render or
+ * grid_render_player): 0 before the first render, then one more with
+ * each render after which the text differs.  So a client shown the text
+ * at one version need not be shown it again until the version changes.
+ */
+unsigned long grid_version(const grid_struct_t *grid_struct);
+
+/* ***************** grid_invalidate ********************** */
+/* Mark every row of the grid as changed, so the next render
+ * draws the whole grid again.
+ */
+void grid_invalidate(grid_struct_t *grid_struct);
+
+/* ***************** grid_set_simd ********************** */
+/* Choose how rows are rendered: with the fastest SSE2/AVX2 kernel this
+ * CPU supports (the default), or with the plain one-point-at-a-time loop.
+ * Both produce the same text; this is mostly useful for benchmarks.
+ *
+ * We RETURN: true if a SIMD kernel is now in use; otherwise we return false.
+ */
+bool grid_set_simd(bool enable);
+
+/* ***************** grid_set_kernel ********************** */
+/* The rendering kernels grid_set_kernel can force. */
+typedef enum { GRID_SCALAR, GRID_SSE2, GRID_AVX2 } grid_kernel_t;
+
+/* Force rows to be rendered with one particular kernel, so that tests
+ * can check each SIMD kernel against the scalar loop.
+ *
+ * We RETURN: true if the kernel is now in use; false, leaving the
+ * current kernel unchanged, if this CPU (or build) does not support it.
+ */
+bool grid_set_kernel(grid_kernel_t kernel);
+
 /* ***************** grid_print ********************** */
 /* Print the grid.
  */
@@ -114,6 +166,8 @@ void grid_print(grid_struct_t *grid_struct);
 
 /* ***************** grid_visibility ********************** */
 /* Calculte the visibility from a position in the grid.
+ * From the position it was last calculated from, in an unchanged grid,
+ * it is already known, and this returns at once.
  */
 void grid_visibility(grid_struct_t *grid_struct, position_t *pos);
 
@@ -122,18 +176,6 @@ void grid_visibility(grid_struct_t *grid_struct, position_t *pos);
  */
 void grid_delete(grid_struct_t *grid_struct);
 
-/* ***************** point_new ********************** */
-/* Create a new pointer to a point.
- *
- * We RETURN: pointer to a point if possible; otherwise we return NULL.
- */
-point_t* point_new(char c, bool seen, int gold_number);
-
-/* ***************** point_delete ********************** */
-/* Free the point.
- */
-void point_delete(point_t *point);
-
 /* ***************** position_new ********************** */
 /* Create a new pointer to a position.
  *
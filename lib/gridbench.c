@@ -0,0 +1,87 @@
+/*
+ * gridbench.c - benchmark for the Nuggets Project's grid rendering
+ *
+ * Renders every row of a player's view of a map, over and over, first with
+ * the plain one-point-at-a-time loop and then with the SIMD kernel,
+ * and prints the time per frame of each.
+ * usage: ./gridbench [map.txt] [frames]
+ *
+ * CS50, Team JEN, March 2021
+ */
+
+#define _POSIX_C_SOURCE 200809L  // for clock_gettime
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "grid.h"
+#include "memory.h"
+
+static double render_frames(grid_struct_t *main_grid, grid_struct_t *player_grid,
+                            position_t *pos, int frames);
+
+/* **************************************** */
+int main(const int argc, const char *argv[])
+{
+  char *map = argc > 1 ? (char*) argv[1] : "../maps/big.txt";
+  int frames = argc > 2 ? atoi(argv[2]) : 20000;
+  if (frames <= 0) {
+    fprintf(stderr, "usage: %s [map.txt] [frames]\n", argv[0]);
+    return 1;
+  }
+
+  // the spectator's grid has seen everything; scatter some gold around it
+  grid_struct_t *main_grid = grid_struct_new(map);
+  if (main_grid == NULL || !grid_load(main_grid, map, true)) {
+    return 1;
+  }
+  for (int y = 0; y < grid_get_nR(main_grid); y++) {
+    for (int x = 0; x < grid_get_nC(main_grid); x++) {
+      if (grid_get_point_c(main_grid, x, y) == '.' && (x * 3 + y) % 11 == 0) {
+        position_t *spot = position_new(x, y);
+        grid_set_character(main_grid, '*', spot);
+        position_delete(spot);
+      }
+    }
+  }
+  // a player who knows the whole map, and can see only part of it
+  grid_struct_t *player_grid = grid_struct_new(map);
+  grid_load(player_grid, map, true);
+  position_t *pos = position_new(0, 0);
+
+  printf("map %s: %d rows, %d columns, %d frames\n", map,
+         grid_get_nR(main_grid), grid_get_nC(main_grid), frames);
+  grid_set_simd(false);
+  double plain = render_frames(main_grid, player_grid, pos, frames);
+  printf("scalar: %8.0f ns/frame\n", plain);
+  if (grid_set_simd(true)) {
+    double simd = render_frames(main_grid, player_grid, pos, frames);
+    printf("simd:   %8.0f ns/frame (%.1fx speedup)\n", simd, plain / simd);
+  } else {
+    printf("simd:   not supported on this CPU\n");
+  }
+
+  grid_delete(main_grid);
+  grid_delete(player_grid);
+  position_delete(pos);
+  return 0;
+}
+
+/* Render 'frames' full frames of the player's view;
+ * return the average nanoseconds per frame.
+ */
+static double
+render_frames(grid_struct_t *main_grid, grid_struct_t *player_grid,
+              position_t *pos, int frames)
+{
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int i = 0; i < frames; i++) {
+    // force every row to be drawn again
+    grid_invalidate(player_grid);
+    grid_render_player(main_grid, player_grid, pos);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+  return ns / frames;
+}
@@ -82,6 +82,134 @@ int main()
   EXPECT(grid_set_character(NULL, '^', newCharPos) == '\0');
   EXPECT(grid_set_gold(NULL, 0, newGoldPos) == -1);
 
+  // test rendering - the cached text is laid out as nR lines of nC chars
+  const char *text = grid_render(test_grid);
+  EXPECT(text != NULL);
+  EXPECT(strlen(text) == 5 * (14 + 1));
+  EXPECT(text[2 * 15 + 6] == '^');
+  // a change to the grid is picked up by the next render
+  grid_set_character(test_grid, '.', newCharPos);
+  text = grid_render(test_grid);
+  EXPECT(text[2 * 15 + 6] == '.');
+  char *copy = grid_string(test_grid);
+  EXPECT(strcmp(copy, text) == 0);
+  free(copy);
+  // the version changes only when the text does
+  EXPECT(grid_version(NULL) == 0);
+  unsigned long version = grid_version(test_grid);
+  EXPECT(version > 0);
+  grid_render(test_grid);
+  EXPECT(grid_version(test_grid) == version);
+  grid_set_character(test_grid, '^', newCharPos);   // changed, then back
+  grid_set_character(test_grid, '.', newCharPos);
+  grid_render(test_grid);
+  EXPECT(grid_version(test_grid) == version);
+  grid_set_character(test_grid, '^', newCharPos);
+  grid_render(test_grid);
+  EXPECT(grid_version(test_grid) == version + 1);
+  grid_set_character(test_grid, '.', newCharPos);
+  grid_render(test_grid);
+
+  // test player rendering - a warm cache must match a cold render
+  grid_struct_t *player1 = grid_struct_new("../maps/small.txt");
+  grid_load(player1, "../maps/small.txt", false);
+  grid_struct_t *player2 = grid_struct_new("../maps/small.txt");
+  grid_load(player2, "../maps/small.txt", false);
+  position_t *playerPos = position_new(6, 2);
+  grid_visibility(player1, playerPos);
+  text = grid_render_player(test_grid, player1, playerPos);
+  EXPECT(text != NULL);
+  EXPECT(text[2 * 15 + 6] == '@');
+  // drop some gold in view, move the player, then render again
+  position_t *goldPos = position_new(8, 3);
+  grid_set_character(test_grid, '*', goldPos);
+  pos_update(playerPos, 7, 2);
+  grid_visibility(player1, playerPos);
+  version = grid_version(player1);
+  text = grid_render_player(test_grid, player1, playerPos);
+  EXPECT(grid_version(player1) == version + 1);     // the player moved
+  EXPECT(text[2 * 15 + 6] == '.');
+  EXPECT(text[2 * 15 + 7] == '@');
+  EXPECT(text[3 * 15 + 8] == '*');
+  grid_visibility(player2, playerPos);
+  copy = grid_string_player(test_grid, player2, playerPos);
+  EXPECT(strcmp(copy, text) == 0);
+  // from the same place, visibility is known; after a reload, it is not
+  grid_visibility(player2, playerPos);
+  EXPECT(strcmp(grid_render_player(test_grid, player2, playerPos), copy) == 0);
+  grid_load(player2, "../maps/small.txt", false);
+  char *unseen = grid_string_player(test_grid, player2, playerPos);
+  EXPECT(unseen[3 * 15 + 8] == ' ');
+  free(unseen);
+  grid_visibility(player2, playerPos);
+  unseen = grid_string_player(test_grid, player2, playerPos);
+  EXPECT(strcmp(unseen, copy) == 0);
+  free(unseen);
+  free(copy);
+  // rendering without a player grid, or against one of another size, fails
+  EXPECT(grid_render_player(test_grid, NULL, playerPos) == NULL);
+  grid_struct_t *other = grid_struct_new("../maps/big.txt");
+  grid_load(other, "../maps/big.txt", false);
+  EXPECT(grid_render_player(test_grid, other, playerPos) == NULL);
+  grid_delete(other);
+  EXPECT(grid_render(NULL) == NULL);
+  grid_delete(player1);
+  grid_delete(player2);
+  position_delete(playerPos);
+  position_delete(goldPos);
+
+  // test a map with lines of different lengths - short lines are padded
+  grid_struct_t *ragged = grid_struct_new("../maps/contrib/fox1.txt");
+  grid_load(ragged, "../maps/contrib/fox1.txt", true);
+  text = grid_render(ragged);
+  EXPECT(strlen(text) == grid_get_nR(ragged) * (grid_get_nC(ragged) + 1));
+  grid_delete(ragged);
+
+  // test the SIMD rendering kernel against the plain loop, on a big map
+  // (rows wider than 32 points, with gold both visible and hidden)
+  grid_struct_t *big = grid_struct_new("../maps/big.txt");
+  grid_load(big, "../maps/big.txt", true);
+  grid_struct_t *bigPlayer = grid_struct_new("../maps/big.txt");
+  grid_load(bigPlayer, "../maps/big.txt", false);
+  position_t *bigPos = position_new(5, 3);
+  for (int y = 0; y < grid_get_nR(big); y++) {
+    for (int x = 0; x < grid_get_nC(big); x++) {
+      if (grid_get_point_c(big, x, y) == '.' && (x + y) % 7 == 0) {
+        position_t *spot = position_new(x, y);
+        grid_set_character(big, '*', spot);
+        position_delete(spot);
+      }
+    }
+  }
+  grid_visibility(bigPlayer, bigPos);
+  EXPECT(grid_set_kernel(GRID_SCALAR));
+  char *plain = grid_string_player(big, bigPlayer, bigPos);
+  char *plainAll = grid_string(big);
+  // force each SIMD kernel in turn; each must draw what the scalar loop drew
+  grid_kernel_t kernels[] = { GRID_SSE2, GRID_AVX2 };
+  const char *names[] = { "SSE2", "AVX2" };
+  for (int k = 0; k < 2; k++) {
+    if (!grid_set_kernel(kernels[k])) {
+      printf("%s kernel not supported on this CPU; skipped\n", names[k]);
+      continue;
+    }
+    grid_invalidate(bigPlayer);
+    grid_invalidate(big);
+    char *simd = grid_string_player(big, bigPlayer, bigPos);
+    char *simdAll = grid_string(big);
+    EXPECT(strcmp(plain, simd) == 0);
+    EXPECT(strcmp(plainAll, simdAll) == 0);
+    EXPECT(strchr(simd, '@') != NULL);
+    free(simd);
+    free(simdAll);
+  }
+  grid_set_simd(true);
+  free(plain);
+  free(plainAll);
+  grid_delete(big);
+  grid_delete(bigPlayer);
+  position_delete(bigPos);
+
   // test grid_delete
   grid_delete(test_grid);
   position_delete(newGoldPos);
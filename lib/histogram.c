@@ -0,0 +1,186 @@
+/*
+ * histogram.c - histogram module, a histogram of durations
+ *
+ * see histogram.h for more information.
+ *
+ * Team JEN, Winter 2021
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include "histogram.h"
+#include "memory.h"
+
+/**************** local constants ****************/
+/* Values below Exact each have a bucket; above that, each power of two
+ * [2^e, 2^(e+1)) is split into Steps buckets, by the 3 bits after the top.
+ */
+static const int Exact = 16;
+static const int Steps = 8;
+#define Buckets (16 + (64 - 4) * 8)
+
+/**************** global types ****************/
+typedef struct histogram {
+  uint64_t count;               // durations counted
+  uint64_t min, max;            // the shortest and longest counted
+  uint64_t bucket[Buckets];     // durations counted in each bucket
+} histogram_t;
+
+/**************** local functions ****************/
+/* not visible outside this file */
+static int bucket_of(const uint64_t value);
+static uint64_t bucket_low(const int b);
+
+/**************** histogram_new ****************/
+/* see histogram.h for documentation */
+histogram_t *
+histogram_new(void)
+{
+  histogram_t *histogram = count_calloc(1, sizeof(histogram_t));
+  if (histogram == NULL) {
+    return NULL;
+  }
+  histogram->min = UINT64_MAX;
+  return histogram;
+}
+
+/**************** histogram_add ****************/
+/* see histogram.h for documentation */
+void
+histogram_add(histogram_t *histogram, const uint64_t value)
+{
+  if (histogram == NULL) {
+    return;
+  }
+  histogram->bucket[bucket_of(value)]++;
+  histogram->count++;
+  if (value < histogram->min) {
+    histogram->min = value;
+  }
+  if (value > histogram->max) {
+    histogram->max = value;
+  }
+}
+
+/**************** histogram_count ****************/
+/* see histogram.h for documentation */
+uint64_t
+histogram_count(const histogram_t *histogram)
+{
+  return (histogram == NULL) ? 0 : histogram->count;
+}
+
+/**************** histogram_percentile ****************/
+/* see histogram.h for documentation */
+uint64_t
+histogram_percentile(const histogram_t *histogram, const double percent)
+{
+  if (histogram == NULL || histogram->count == 0) {
+    return 0;
+  }
+  // the rank of the duration wanted, counting from 1
+  uint64_t rank = (uint64_t) (percent / 100.0 * histogram->count + 0.5);
+  if (rank < 1) {
+    rank = 1;
+  }
+  if (rank > histogram->count) {
+    rank = histogram->count;
+  }
+  // the ends are known exactly
+  if (rank == 1) {
+    return histogram->min;
+  }
+  if (rank == histogram->count) {
+    return histogram->max;
+  }
+  uint64_t seen = 0;
+  int b = 0;
+  for (; b < Buckets - 1; b++) {
+    seen += histogram->bucket[b];
+    if (seen >= rank) {
+      break;
+    }
+  }
+  // the middle of the bucket, within what was seen
+  uint64_t low = bucket_low(b);
+  uint64_t high = (b < Buckets - 1) ? bucket_low(b + 1) - 1 : UINT64_MAX;
+  uint64_t value = low + (high - low) / 2;
+  if (value < histogram->min) {
+    value = histogram->min;
+  }
+  if (value > histogram->max) {
+    value = histogram->max;
+  }
+  return value;
+}
+
+/**************** histogram_print ****************/
+/* see histogram.h for documentation */
+void
+histogram_print(const histogram_t *histogram, FILE *fp, const char *label)
+{
+  if (histogram == NULL || fp == NULL) {
+    return;
+  }
+  if (histogram->count == 0) {
+    fprintf(fp, "%s: none\n", label == NULL ? "" : label);
+    return;
+  }
+  fprintf(fp, "%s: %" PRIu64 " counted, in microseconds: min %.1f, p50 %.1f, "
+          "p90 %.1f, p99 %.1f, p99.9 %.1f, max %.1f\n",
+          label == NULL ? "" : label, histogram->count,
+          histogram->min / 1e3,
+          histogram_percentile(histogram, 50) / 1e3,
+          histogram_percentile(histogram, 90) / 1e3,
+          histogram_percentile(histogram, 99) / 1e3,
+          histogram_percentile(histogram, 99.9) / 1e3,
+          histogram->max / 1e3);
+}
+
+/**************** histogram_delete ****************/
+/* see histogram.h for documentation */
+void
+histogram_delete(histogram_t *histogram)
+{
+  if (histogram != NULL) {
+    count_free(histogram);
+  }
+}
+
+/***********************************************************************
+ * INTERNAL FUNCTIONS
+ ***********************************************************************/
+
+/**************** bucket_of ****************/
+/* Helper method to find the bucket a value is counted in: its top bit,
+ * e, picks the power of two, and the next 3 bits the step within it.
+ */
+static int
+bucket_of(const uint64_t value)
+{
+  if (value < Exact) {
+    return (int) value;
+  }
+  int e = 63;
+  while ((value >> e) == 0) {
+    e--;
+  }
+  int step = (int) (value >> (e - 3)) & (Steps - 1);
+  return Exact + (e - 4) * Steps + step;
+}
+
+/**************** bucket_low ****************/
+/* Helper method to return the least value counted in bucket b.
+ */
+static uint64_t
+bucket_low(const int b)
+{
+  if (b < Exact) {
+    return b;
+  }
+  int e = 4 + (b - Exact) / Steps;
+  uint64_t step = (b - Exact) % Steps;
+  return (Steps + step) << (e - 3);
+}
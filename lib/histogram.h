@@ -0,0 +1,71 @@
+/*
+ * histogram module - a histogram of durations, for percentiles
+ *
+ * Counts durations, in nanoseconds, in buckets of log-linear width: a
+ * bucket for each value below 16, then eight buckets for each power of
+ * two above that, so any value is known to within 12.5%.  Adding a value
+ * is a few shifts and an increment, and the histogram never grows, so a
+ * server can add one every frame and report percentiles at the end.
+ *
+ * Team JEN, Winter 2021
+ */
+
+#ifndef __HISTOGRAM_H
+#define __HISTOGRAM_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/**************** global types ****************/
+typedef struct histogram histogram_t;  // opaque to users of the module
+
+/**************** functions ****************/
+
+/**************** histogram_new ****************/
+/* Create a new, empty histogram.
+ *
+ * We return:
+ *   pointer to the new histogram; NULL if error.
+ * Caller is responsible for:
+ *   later calling histogram_delete.
+ */
+histogram_t *histogram_new(void);
+
+/**************** histogram_add ****************/
+/* Count one duration, in nanoseconds.
+ * We do nothing if the histogram is NULL.
+ */
+void histogram_add(histogram_t *histogram, const uint64_t value);
+
+/**************** histogram_count ****************/
+/* Return the number of durations counted; 0 if the histogram is NULL.
+ */
+uint64_t histogram_count(const histogram_t *histogram);
+
+/**************** histogram_percentile ****************/
+/* Return the duration, in nanoseconds, that 'percent' percent of those
+ * counted are no longer than.
+ *
+ * Caller provides:
+ *   valid histogram, and a percent from 0 to 100.
+ * We return:
+ *   the middle of the bucket that duration falls in, but never less than
+ *   the shortest duration counted nor more than the longest, which are
+ *   exact; 0 if none were counted, or if the histogram is NULL.
+ */
+uint64_t histogram_percentile(const histogram_t *histogram, const double percent);
+
+/**************** histogram_print ****************/
+/* Print one line to fp, starting with 'label': the number of durations
+ * counted, then the shortest, the median, the 90th, 99th, and 99.9th
+ * percentiles, and the longest, in microseconds.
+ * We do nothing if the histogram or fp is NULL.
+ */
+void histogram_print(const histogram_t *histogram, FILE *fp, const char *label);
+
+/**************** histogram_delete ****************/
+/* Delete the histogram; NULL is ignored.
+ */
+void histogram_delete(histogram_t *histogram);
+
+#endif // __HISTOGRAM_H
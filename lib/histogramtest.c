@@ -0,0 +1,115 @@
+/*
+ * histogramtest.c - unit test program for the Nuggets Project's histogram module
+ *
+ * Code adapted from ringtest.c
+ * Read the README or the TESTING.md file for more information.
+ *
+ * CS50, Team JEN, March 2021
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "histogram.h"
+#include "memory.h"
+
+// file-local global variables
+static int histogram_unit_tested = 0;     // number of test cases run
+static int histogram_unit_failed = 0;     // number of test cases failed
+
+// a macro for shorthand calls to expect()
+#define EXPECT(cond) { unit_expect((cond), __LINE__); }
+
+// Checks 'condition', increments histogram_unit_tested, prints FAIL or PASS
+void unit_expect(bool condition, int linenum)
+{
+  histogram_unit_tested++;
+  if (condition) {
+    printf("PASS test %03d at line %d\n", histogram_unit_tested, linenum);
+  } else {
+    printf("FAIL test %03d at line %d\n", histogram_unit_tested, linenum);
+    histogram_unit_failed++;
+  }
+}
+
+// is 'value' within 12.5% of 'exact'?
+static bool near(const uint64_t value, const uint64_t exact);
+
+/* **************************************** */
+int main()
+{
+  printf("starting unit test for histogram...\n");
+
+  // error cases
+  histogram_add(NULL, 1);                     // does nothing
+  EXPECT(histogram_count(NULL) == 0);
+  EXPECT(histogram_percentile(NULL, 50) == 0);
+  histogram_print(NULL, stdout, "null");      // does nothing
+  histogram_delete(NULL);                     // does nothing
+
+  // empty
+  histogram_t *histogram = histogram_new();
+  EXPECT(histogram != NULL);
+  EXPECT(histogram_count(histogram) == 0);
+  EXPECT(histogram_percentile(histogram, 50) == 0);
+  histogram_print(histogram, stdout, "empty");
+
+  // small values are exact
+  for (uint64_t v = 1; v <= 10; v++) {
+    histogram_add(histogram, v);
+  }
+  EXPECT(histogram_count(histogram) == 10);
+  EXPECT(histogram_percentile(histogram, 0) == 1);
+  EXPECT(histogram_percentile(histogram, 50) == 5);
+  EXPECT(histogram_percentile(histogram, 90) == 9);
+  EXPECT(histogram_percentile(histogram, 100) == 10);
+  histogram_delete(histogram);
+
+  // larger values are near, and never outside what was counted
+  histogram = histogram_new();
+  for (uint64_t v = 1; v <= 100000; v++) {
+    histogram_add(histogram, v * 1000);
+  }
+  EXPECT(histogram_count(histogram) == 100000);
+  EXPECT(near(histogram_percentile(histogram, 50), 50000000));
+  EXPECT(near(histogram_percentile(histogram, 90), 90000000));
+  EXPECT(near(histogram_percentile(histogram, 99), 99000000));
+  EXPECT(near(histogram_percentile(histogram, 99.9), 99900000));
+  EXPECT(histogram_percentile(histogram, 0) == 1000);
+  EXPECT(histogram_percentile(histogram, 100) == 100000000);
+  histogram_print(histogram, stdout, "1us..100ms");
+  histogram_delete(histogram);
+
+  // one long outlier shows in the tail, not the median
+  histogram = histogram_new();
+  for (int i = 0; i < 999; i++) {
+    histogram_add(histogram, 20000);
+  }
+  histogram_add(histogram, 5000000000ull);
+  EXPECT(near(histogram_percentile(histogram, 50), 20000));
+  EXPECT(near(histogram_percentile(histogram, 99), 20000));
+  EXPECT(histogram_percentile(histogram, 100) == 5000000000ull);
+  histogram_add(histogram, UINT64_MAX);       // the last bucket
+  EXPECT(histogram_percentile(histogram, 100) == UINT64_MAX);
+  histogram_delete(histogram);
+
+  printf("unit test complete\n");
+
+  // print a summary
+  if (histogram_unit_failed > 0) {
+    printf("FAILED %d of %d tests\n", histogram_unit_failed, histogram_unit_tested);
+    return histogram_unit_failed;
+  } else {
+    printf("PASSED all of %d tests\n", histogram_unit_tested);
+    return 0;
+  }
+}
+
+static bool
+near(const uint64_t value, const uint64_t exact)
+{
+  uint64_t diff = (value > exact) ? value - exact : exact - value;
+  return diff * 8 <= exact;
+}
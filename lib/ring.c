@@ -0,0 +1,142 @@
+/*
+ * ring.c - ring module, a bounded lock-free queue of fixed-size records
+ *
+ * see ring.h for more information.
+ *
+ * Team JEN, Winter 2021
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "ring.h"
+#include "memory.h"
+
+/**************** local types ****************/
+/* A slot is free for the producer of turn t when its seq is t, and full
+ * for the consumer of turn t when its seq is t + 1.  Popping it makes it
+ * free for the producer of turn t + capacity.
+ */
+typedef struct slot {
+  atomic_size_t seq;  // turn of the slot, as above
+} slot_t;
+
+/**************** global types ****************/
+typedef struct ring {
+  size_t mask;          // capacity - 1; capacity is a power of 2
+  size_t size;          // size of a record
+  size_t stride;        // bytes per slot: its slot_t, then its record
+  char *slots;          // capacity slots, one after another
+  atomic_size_t tail;   // next turn to push; shared by producers
+  size_t head;          // next turn to pop; the consumer's alone
+} ring_t;
+
+/**************** local functions ****************/
+/* not visible outside this file */
+static slot_t* slot_at(const ring_t *ring, const size_t turn);
+
+/**************** ring_new ****************/
+/* see ring.h for documentation */
+ring_t*
+ring_new(const int capacity, const int size)
+{
+  if (capacity <= 0 || size <= 0) {
+    return NULL;
+  }
+  size_t n = 1;
+  while (n < (size_t) capacity) {
+    n *= 2;
+  }
+  ring_t *ring = count_malloc_assert(sizeof(ring_t), "ring_t");
+  ring->mask = n - 1;
+  ring->size = size;
+  // keep every slot's sequence number aligned
+  size_t align = _Alignof(slot_t);
+  ring->stride = (sizeof(slot_t) + size + align - 1) / align * align;
+  ring->slots = count_malloc_assert(n * ring->stride, "ring slots");
+  for (size_t t = 0; t < n; t++) {
+    atomic_init(&slot_at(ring, t)->seq, t);
+  }
+  atomic_init(&ring->tail, 0);
+  ring->head = 0;
+  return ring;
+}
+
+/**************** ring_push ****************/
+/* see ring.h for documentation */
+bool
+ring_push(ring_t *ring, const void *record)
+{
+  if (ring == NULL || record == NULL) {
+    return false;
+  }
+  size_t turn = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  slot_t *slot;
+  while (true) {
+    slot = slot_at(ring, turn);
+    size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    long diff = (long) (seq - turn);    // signed, in case the turns wrap
+    if (diff == 0) {
+      // the slot is free for this turn; claim the turn, if no one beat us
+      if (atomic_compare_exchange_weak_explicit(&ring->tail, &turn, turn + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        break;
+      }
+      // on failure, 'turn' now holds the newer tail; try that
+    } else if (diff < 0) {
+      return false;   // the consumer has not yet popped this slot: full
+    } else {
+      turn = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    }
+  }
+  memcpy((char *) slot + sizeof(slot_t), record, ring->size);
+  // publish the record to the consumer
+  atomic_store_explicit(&slot->seq, turn + 1, memory_order_release);
+  return true;
+}
+
+/**************** ring_pop ****************/
+/* see ring.h for documentation */
+bool
+ring_pop(ring_t *ring, void *record)
+{
+  if (ring == NULL || record == NULL) {
+    return false;
+  }
+  size_t turn = ring->head;
+  slot_t *slot = slot_at(ring, turn);
+  if (atomic_load_explicit(&slot->seq, memory_order_acquire) != turn + 1) {
+    return false;     // empty, or its producer has not finished copying
+  }
+  memcpy(record, (char *) slot + sizeof(slot_t), ring->size);
+  // free the slot for the producer one lap later
+  atomic_store_explicit(&slot->seq, turn + ring->mask + 1, memory_order_release);
+  ring->head = turn + 1;
+  return true;
+}
+
+/**************** ring_delete ****************/
+/* see ring.h for documentation */
+void
+ring_delete(ring_t *ring)
+{
+  if (ring != NULL) {
+    free(ring->slots);
+    free(ring);
+  }
+}
+
+/***********************************************************************
+ * INTERNAL FUNCTIONS
+ ***********************************************************************/
+
+/**************** slot_at ****************/
+/* Helper method to find the slot used in the given turn.
+ */
+static slot_t*
+slot_at(const ring_t *ring, const size_t turn)
+{
+  return (slot_t *) (ring->slots + (turn & ring->mask) * ring->stride);
+}
@@ -0,0 +1,66 @@
+/*
+ * ring module - a bounded, lock-free queue of fixed-size records
+ *
+ * Any number of threads may push records into a ring at once, without
+ * locks, while one thread (the consumer) pops them, in the order they
+ * were pushed.  The server's receiver threads use a ring to hand the
+ * commands they decode to the game thread.
+ *
+ * Each slot carries a sequence number that says whether it is free for
+ * the producer whose turn it is, or full for the consumer; producers
+ * claim a turn with one atomic compare-and-swap on the tail.
+ *
+ * Team JEN, Winter 2021
+ */
+
+#ifndef __RING_H
+#define __RING_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+/**************** global types ****************/
+typedef struct ring ring_t;  // opaque to users of the module
+
+/**************** functions ****************/
+
+/**************** ring_new ****************/
+/* Create a new, empty ring.
+ *
+ * Caller provides:
+ *   the number of records it may hold (> 0; rounded up to a power of 2),
+ *   the size of each record, in bytes (> 0).
+ * We return:
+ *   pointer to the new ring; NULL if error.
+ * Caller is responsible for:
+ *   later calling ring_delete.
+ */
+ring_t* ring_new(const int capacity, const int size);
+
+/**************** ring_push ****************/
+/* Copy a record into the ring.  Safe to call from many threads at once.
+ *
+ * Caller provides:
+ *   valid ring, and a pointer to a record of the ring's record size.
+ * We return:
+ *   true if the record was queued; false if the ring is full, or on error.
+ */
+bool ring_push(ring_t *ring, const void *record);
+
+/**************** ring_pop ****************/
+/* Copy the oldest record out of the ring, and remove it.
+ * Only one thread may pop from a ring.
+ *
+ * Caller provides:
+ *   valid ring, and room for a record of the ring's record size.
+ * We return:
+ *   true if a record was copied; false if the ring is empty, or on error.
+ */
+bool ring_pop(ring_t *ring, void *record);
+
+/**************** ring_delete ****************/
+/* Free the ring, and any records it holds.
+ */
+void ring_delete(ring_t *ring);
+
+#endif // __RING_H
@@ -0,0 +1,149 @@
+/*
+ * ringtest.c - unit test program for the Nuggets Project's ring module
+ *
+ * Code adapted from gridtest.c
+ * Read the README or the TESTING.md file for more information.
+ *
+ * CS50, Team JEN, March 2021
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include "ring.h"
+#include "memory.h"
+
+// file-local global variables
+static int ring_unit_tested = 0;     // number of test cases run
+static int ring_unit_failed = 0;     // number of test cases failed
+
+// a macro for shorthand calls to expect()
+#define EXPECT(cond) { unit_expect((cond), __LINE__); }
+
+// Checks 'condition', increments ring_unit_tested, prints FAIL or PASS
+void unit_expect(bool condition, int linenum)
+{
+  ring_unit_tested++;
+  if (condition) {
+    printf("PASS test %03d at line %d\n", ring_unit_tested, linenum);
+  } else {
+    printf("FAIL test %03d at line %d\n", ring_unit_tested, linenum);
+    ring_unit_failed++;
+  }
+}
+
+// a record, as a receiver thread might push: who sent it, and a count
+typedef struct record {
+  int producer;
+  int count;
+  char text[12];
+} record_t;
+
+static const int Producers = 4;
+static const int PerProducer = 20000;
+
+// pushes PerProducer records into the ring, retrying while it is full
+static void *produce(void *arg);
+static ring_t *shared;
+
+/* **************************************** */
+int main()
+{
+  printf("starting unit test for ring...\n");
+  record_t in, out;
+  memset(&in, 0, sizeof(in));
+
+  // error cases
+  EXPECT(ring_new(0, sizeof(record_t)) == NULL);
+  EXPECT(ring_new(4, 0) == NULL);
+  EXPECT(ring_push(NULL, &in) == false);
+  EXPECT(ring_pop(NULL, &out) == false);
+
+  // a ring of 3 holds 4 records: capacity rounds up to a power of 2
+  ring_t *ring = ring_new(3, sizeof(record_t));
+  EXPECT(ring != NULL);
+  EXPECT(ring_pop(ring, &out) == false);
+  for (int i = 0; i < 4; i++) {
+    in.count = i;
+    EXPECT(ring_push(ring, &in));
+  }
+  EXPECT(ring_push(ring, &in) == false);   // full
+
+  // records come out in the order they went in
+  EXPECT(ring_pop(ring, &out) && out.count == 0);
+  EXPECT(ring_pop(ring, &out) && out.count == 1);
+
+  // popping frees slots, so the ring wraps around
+  in.count = 4;
+  strcpy(in.text, "wraps");
+  EXPECT(ring_push(ring, &in));
+  EXPECT(ring_pop(ring, &out) && out.count == 2);
+  EXPECT(ring_pop(ring, &out) && out.count == 3);
+  EXPECT(ring_pop(ring, &out) && out.count == 4 && strcmp(out.text, "wraps") == 0);
+  EXPECT(ring_pop(ring, &out) == false);   // empty
+  ring_delete(ring);
+
+  // many producers at once: every record arrives exactly once, and each
+  // producer's records arrive in the order that producer pushed them
+  shared = ring_new(64, sizeof(record_t));
+  pthread_t threads[Producers];
+  int ids[Producers];
+  for (int p = 0; p < Producers; p++) {
+    ids[p] = p;
+    pthread_create(&threads[p], NULL, produce, &ids[p]);
+  }
+  int next[Producers];
+  memset(next, 0, sizeof(next));
+  int received = 0;
+  bool ordered = true;
+  while (received < Producers * PerProducer) {
+    if (ring_pop(shared, &out)) {
+      if (out.count != next[out.producer]) {
+        ordered = false;
+      }
+      next[out.producer] = out.count + 1;
+      received++;
+    } else {
+      sched_yield();    // empty; let the producers run
+    }
+  }
+  for (int p = 0; p < Producers; p++) {
+    pthread_join(threads[p], NULL);
+  }
+  EXPECT(ordered);
+  bool all = true;
+  for (int p = 0; p < Producers; p++) {
+    all = all && next[p] == PerProducer;
+  }
+  EXPECT(all);
+  EXPECT(ring_pop(shared, &out) == false);
+  ring_delete(shared);
+
+  printf("unit test complete\n");
+
+  // print a summary
+  if (ring_unit_failed > 0) {
+    printf("FAILED %d of %d tests\n", ring_unit_failed, ring_unit_tested);
+    return ring_unit_failed;
+  } else {
+    printf("PASSED all of %d tests\n", ring_unit_tested);
+    return 0;
+  }
+}
+
+static void *
+produce(void *arg)
+{
+  record_t record;
+  memset(&record, 0, sizeof(record));
+  record.producer = *(int *) arg;
+  for (int i = 0; i < PerProducer; i++) {
+    record.count = i;
+    while (!ring_push(shared, &record)) {
+      sched_yield();    // full; let the consumer run
+    }
+  }
+  return NULL;
+}
@@ -12,6 +12,7 @@
  #include "grid.h"
  #include "memory.h"
  #include "message.h"
+ #include "display.h"
 
 /**************** file-local global variables ****************/
 /* none */
@@ -30,6 +31,9 @@ typedef struct server_player {
   position_t *pos;    // current player position
   grid_struct_t *grid;    // player grid that tracks visibility
   bool in_passage;    // whether the player is currently in a passage way
+  display_t *display;   // how this client's DISPLAY frames are encoded
+  unsigned long shown;  // grid_version of the last DISPLAY sent; 0 if none
+  int gold_shown;       // gold remaining in the last GOLD sent; -1 if none
 } server_player_t;
 
 /**************** global functions ****************/
@@ -68,6 +72,15 @@ grid_struct_t* server_player_getGrid(const server_player_t *player) {
 bool server_player_getInPassage(const server_player_t *player) {
   return player ? player->in_passage : false;
 }
+display_t* server_player_getDisplay(const server_player_t *player) {
+  return player ? player->display : NULL;
+}
+unsigned long server_player_getShown(const server_player_t *player) {
+  return player ? player->shown : 0;
+}
+int server_player_getGoldShown(const server_player_t *player) {
+  return player ? player->gold_shown : -1;
+}
 
 /* *********************************************************************** */
 /* setter methods - see server_player.h for more information */
@@ -134,6 +147,27 @@ bool server_player_setInPassage(server_player_t *player, bool b) {
   }
   return false;
 }
+bool server_player_setDisplay(server_player_t *player, display_t* display) {
+  if(player != NULL) {
+    player->display = display;
+    return true;
+  }
+  return false;
+}
+bool server_player_setShown(server_player_t *player, unsigned long version) {
+  if(player != NULL) {
+    player->shown = version;
+    return true;
+  }
+  return false;
+}
+bool server_player_setGoldShown(server_player_t *player, int remaining) {
+  if(player != NULL) {
+    player->gold_shown = remaining;
+    return true;
+  }
+  return false;
+}
 
 /**************** server_player_new ****************/
 /* see server_player.h for documentation */
@@ -151,6 +185,9 @@ server_player_new(addr_t address, char *name, char symbol, bool active, position
   player->pos = pos;
   player->grid = NULL;
   player->in_passage = false;
+  player->display = NULL;
+  player->shown = 0;
+  player->gold_shown = -1;
   return player;
 }
 
@@ -163,6 +200,7 @@ server_player_delete(server_player_t *player)
     free(player->name);
     free(player->pos);
     grid_delete(player->grid);
+    display_delete(player->display);
     free(player);
   }
 }
@@ -174,6 +212,7 @@ server_spectator_delete(server_player_t *player)
 {
   if(player != NULL) {
     free(player->name);
+    display_delete(player->display);
     free(player);
   }
 }
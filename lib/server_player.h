@@ -11,6 +11,8 @@
 #include <stdbool.h>
 #include <string.h>
 #include "message.h"
+#include "grid.h"
+#include "display.h"
 
 /**************** global types ****************/
 typedef struct server_player server_player_t; // opaque to users of the module
@@ -27,6 +29,9 @@ bool server_player_getActive(const server_player_t *player);
 position_t* server_player_getPos(const server_player_t *player);
 grid_struct_t* server_player_getGrid(const server_player_t *player);
 bool server_player_getInPassage(const server_player_t *player);
+display_t* server_player_getDisplay(const server_player_t *player);
+unsigned long server_player_getShown(const server_player_t *player);
+int server_player_getGoldShown(const server_player_t *player);
 
 // setter functions - change variables of player struct
 // returns true on success, returns false on any error
@@ -39,6 +44,13 @@ bool server_player_setActive(server_player_t *player, bool b);
 bool server_player_setPos(server_player_t *player, position_t* pos);
 bool server_player_setGrid(server_player_t *player, grid_struct_t* grid);
 bool server_player_setInPassage(server_player_t *player, bool b);
+bool server_player_setDisplay(server_player_t *player, display_t* display);
+
+// what this client was last sent, so the server need not send it again:
+// the grid_version of the DISPLAY (0 if none), and the gold remaining in
+// the GOLD message (-1 if none)
+bool server_player_setShown(server_player_t *player, unsigned long version);
+bool server_player_setGoldShown(server_player_t *player, int remaining);
 
 /**************** server_player_new ****************/
 /* Initalizes a new player_t structure.
@@ -57,6 +57,8 @@ int main()
   EXPECT(pos_get_y(server_player_getPos(player)) == 1);
   EXPECT(server_player_getGrid(player) == NULL);
   EXPECT(server_player_getInPassage(player) == false);
+  EXPECT(server_player_getShown(player) == 0);
+  EXPECT(server_player_getGoldShown(player) == -1);
 
   // test setter function - name
   char* newname = malloc(10);
@@ -106,6 +108,12 @@ int main()
   server_player_setInPassage(player, true);
   EXPECT(server_player_getInPassage(player) == true);
 
+  // test setter functions - what was last shown
+  server_player_setShown(player, 42);
+  EXPECT(server_player_getShown(player) == 42);
+  server_player_setGoldShown(player, 250);
+  EXPECT(server_player_getGoldShown(player) == 250);
+
   // test player_delete
   server_player_delete(player);
 
@@ -138,6 +146,8 @@ int main()
   EXPECT(server_player_getPos(NULL) == NULL);
   EXPECT(server_player_getGrid(NULL) == NULL);
   EXPECT(server_player_getInPassage(NULL) == false);
+  EXPECT(server_player_getShown(NULL) == 0);
+  EXPECT(server_player_getGoldShown(NULL) == -1);
 
   // testing error cases with setter functions
   EXPECT(server_player_setName(NULL, NULL) == false);
@@ -149,6 +159,8 @@ int main()
   EXPECT(server_player_setPos(NULL, NULL) == false);
   EXPECT(server_player_setGrid(NULL, NULL) == false);
   EXPECT(server_player_setInPassage(NULL, false) == false);
+  EXPECT(server_player_setShown(NULL, 0) == false);
+  EXPECT(server_player_setGoldShown(NULL, 0) == false);
 
   printf("unit test complete\n");
 
@@ -0,0 +1,193 @@
+/*
+ * snapshot.c - snapshot module to keep recent history of the spectator's view
+ *
+ * see snapshot.h for more information.
+ *
+ * Team JEN, Winter 2021
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "snapshot.h"
+#include "display.h"
+#include "memory.h"
+
+/**************** global types ****************/
+typedef struct snapshot {
+  int nR;             // number of rows in the grid
+  int nC;             // number of columns in the grid
+  int len;            // length of a view: nR * (nC + 1)
+  int interval;       // ticks between keyframes
+  int tick;           // newest tick recorded (0 if none)
+  int key_tick;       // tick of the keyframe (0 if none)
+  char *keyframe;     // the view at key_tick
+  char *last;         // the view at tick
+  int count;          // number of deltas since the keyframe
+  char *log;          // the deltas, one after another
+  int *offset;        // delta i is log[offset[i]] up to log[offset[i+1]]
+  int log_size;       // room in the log
+} snapshot_t;
+
+/**************** local functions ****************/
+/* not visible outside this file */
+static void new_keyframe(snapshot_t *snapshot, const char *frame);
+
+/**************** snapshot_new ****************/
+/* see snapshot.h for documentation */
+snapshot_t*
+snapshot_new(const int nR, const int nC, const int interval)
+{
+  if (nR <= 0 || nC <= 0 || interval <= 0) {
+    return NULL;
+  }
+  snapshot_t *snapshot = count_malloc_assert(sizeof(snapshot_t), "snapshot_t");
+  snapshot->nR = nR;
+  snapshot->nC = nC;
+  snapshot->len = nR * (nC + 1);
+  snapshot->interval = interval;
+  snapshot->tick = 0;
+  snapshot->key_tick = 0;
+  snapshot->keyframe = count_malloc_assert(snapshot->len + 1, "snapshot keyframe");
+  snapshot->last = count_malloc_assert(snapshot->len + 1, "snapshot view");
+  snapshot->count = 0;
+  // a delta is never longer than a view, or we take a keyframe instead
+  snapshot->log_size = snapshot->len + 1;
+  snapshot->log = count_malloc_assert(snapshot->log_size, "snapshot log");
+  snapshot->offset = count_calloc_assert(interval + 1, sizeof(int), "snapshot log");
+  return snapshot;
+}
+
+/**************** snapshot_record ****************/
+/* see snapshot.h for documentation */
+int
+snapshot_record(snapshot_t *snapshot, const char *frame)
+{
+  if (snapshot == NULL || frame == NULL) {
+    return 0;
+  }
+  // the first view, and every interval-th, is a keyframe
+  if (snapshot->tick == 0 || snapshot->count + 1 >= snapshot->interval) {
+    if (snapshot->tick == 0 || memcmp(frame, snapshot->last, snapshot->len) != 0) {
+      new_keyframe(snapshot, frame);
+    }
+    return snapshot->tick;
+  }
+
+  // make sure the log has room for one more delta as long as a view
+  int start = snapshot->offset[snapshot->count];
+  if (start + snapshot->len + 1 > snapshot->log_size) {
+    snapshot->log_size = 2 * snapshot->log_size + snapshot->len;
+    snapshot->log = realloc(snapshot->log, snapshot->log_size);
+    assertp(snapshot->log, "snapshot log");
+  }
+  int n = display_diff(frame, snapshot->last, snapshot->nR, snapshot->nC,
+                       snapshot->log + start, snapshot->len);
+  if (n == 0) {
+    return snapshot->tick;    // nothing changed
+  }
+  if (n < 0) {
+    // the delta would be as long as the view itself
+    new_keyframe(snapshot, frame);
+    return snapshot->tick;
+  }
+  snapshot->log[start + n] = '\0';
+  snapshot->count++;
+  snapshot->offset[snapshot->count] = start + n + 1;
+  memcpy(snapshot->last, frame, snapshot->len);
+  return ++snapshot->tick;
+}
+
+/**************** snapshot_tick ****************/
+/* see snapshot.h for documentation */
+int
+snapshot_tick(const snapshot_t *snapshot)
+{
+  return snapshot ? snapshot->tick : 0;
+}
+
+/**************** snapshot_keyframe ****************/
+/* see snapshot.h for documentation */
+const char*
+snapshot_keyframe(const snapshot_t *snapshot, int *tick)
+{
+  if (snapshot == NULL || tick == NULL || snapshot->tick == 0) {
+    return NULL;
+  }
+  *tick = snapshot->key_tick;
+  return snapshot->keyframe;
+}
+
+/**************** snapshot_count ****************/
+/* see snapshot.h for documentation */
+int
+snapshot_count(const snapshot_t *snapshot)
+{
+  return snapshot ? snapshot->count : 0;
+}
+
+/**************** snapshot_delta ****************/
+/* see snapshot.h for documentation */
+const char*
+snapshot_delta(const snapshot_t *snapshot, const int i, int *len)
+{
+  if (snapshot == NULL || len == NULL || i < 0 || i >= snapshot->count) {
+    return NULL;
+  }
+  // each delta is stored with a terminating '\0', not part of its length
+  *len = snapshot->offset[i + 1] - snapshot->offset[i] - 1;
+  return snapshot->log + snapshot->offset[i];
+}
+
+/**************** snapshot_rebuild ****************/
+/* see snapshot.h for documentation */
+bool
+snapshot_rebuild(const snapshot_t *snapshot, char *frame)
+{
+  if (snapshot == NULL || frame == NULL || snapshot->tick == 0) {
+    return false;
+  }
+  memcpy(frame, snapshot->keyframe, snapshot->len + 1);
+  for (int i = 0; i < snapshot->count; i++) {
+    if (!display_applyDelta(frame, snapshot->nR, snapshot->nC,
+                            snapshot->log + snapshot->offset[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**************** snapshot_delete ****************/
+/* see snapshot.h for documentation */
+void
+snapshot_delete(snapshot_t *snapshot)
+{
+  if (snapshot != NULL) {
+    free(snapshot->keyframe);
+    free(snapshot->last);
+    free(snapshot->log);
+    free(snapshot->offset);
+    free(snapshot);
+  }
+}
+
+/***********************************************************************
+ * INTERNAL FUNCTIONS
+ ***********************************************************************/
+
+/**************** new_keyframe ****************/
+/* Helper method to make 'frame' the keyframe at a new tick,
+ * forgetting the deltas recorded since the old keyframe.
+ */
+static void
+new_keyframe(snapshot_t *snapshot, const char *frame)
+{
+  snapshot->tick++;
+  snapshot->key_tick = snapshot->tick;
+  memcpy(snapshot->keyframe, frame, snapshot->len);
+  snapshot->keyframe[snapshot->len] = '\0';
+  memcpy(snapshot->last, frame, snapshot->len);
+  snapshot->last[snapshot->len] = '\0';
+  snapshot->count = 0;
+  snapshot->offset[0] = 0;
+}
@@ -0,0 +1,95 @@
+/*
+ * snapshot module - recent history of the spectator's view of the game
+ *
+ * The server records the full view of the main grid once per tick (each
+ * refresh).  A snapshot_t keeps a keyframe, the whole view at some tick,
+ * and the deltas from each tick to the next since then, in the format of
+ * the body of a DELTA message (see display.h).  Every 'interval' ticks
+ * the newest view becomes the new keyframe, so memory stays bounded.
+ *
+ * Late-joining and reconnecting spectators, and replay viewers, can then
+ * be sent the keyframe and the deltas as they are stored, with no further
+ * rendering or diffing.
+ *
+ * Team JEN, Winter 2021
+ */
+
+#ifndef __SNAPSHOT_H
+#define __SNAPSHOT_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+/**************** global types ****************/
+typedef struct snapshot snapshot_t;  // opaque to users of the module
+
+/**************** functions ****************/
+
+/**************** snapshot_new ****************/
+/* Create a new, empty snapshot for a grid of nR rows and nC columns.
+ *
+ * Caller provides:
+ *   the number of rows and columns in the grid (both > 0),
+ *   the number of ticks between keyframes (> 0).
+ * We return:
+ *   pointer to the new snapshot; NULL if error.
+ * Caller is responsible for:
+ *   later calling snapshot_delete.
+ */
+snapshot_t* snapshot_new(const int nR, const int nC, const int interval);
+
+/**************** snapshot_record ****************/
+/* Record the view at a new tick.  A view equal to the last one recorded
+ * is not a new tick, and is ignored.
+ *
+ * Caller provides:
+ *   valid snapshot, and the view: nR lines of nC chars and a newline.
+ * We return:
+ *   the number of the tick recorded, counting from 1;
+ *   the current tick if the view was unchanged; 0 on error.
+ */
+int snapshot_record(snapshot_t *snapshot, const char *frame);
+
+/**************** snapshot_tick ****************/
+/* We return: the newest tick recorded; 0 if none, or snapshot is NULL.
+ */
+int snapshot_tick(const snapshot_t *snapshot);
+
+/**************** snapshot_keyframe ****************/
+/* We return:
+ *   the view at the keyframe tick, which we store in *tick; the memory
+ *   belongs to the snapshot, and is valid until the next snapshot_record.
+ *   NULL if nothing was recorded yet, or on error.
+ */
+const char* snapshot_keyframe(const snapshot_t *snapshot, int *tick);
+
+/**************** snapshot_count ****************/
+/* We return: the number of deltas recorded since the keyframe.
+ */
+int snapshot_count(const snapshot_t *snapshot);
+
+/**************** snapshot_delta ****************/
+/* Get delta number i since the keyframe, 0 <= i < snapshot_count;
+ * it takes the view at tick (keyframe tick + i) to the next tick.
+ *
+ * We return:
+ *   the runs that changed, as for display_applyDelta, and their length in
+ *   *len; the memory belongs to the snapshot, and is valid until the next
+ *   snapshot_record.  NULL if i is out of range, or on error.
+ */
+const char* snapshot_delta(const snapshot_t *snapshot, const int i, int *len);
+
+/**************** snapshot_rebuild ****************/
+/* Rebuild the newest view from the keyframe and deltas, as a late joiner
+ * would.  'frame' must have room for nR * (nC + 1) + 1 chars.
+ *
+ * We return: true on success; false if nothing was recorded, or on error.
+ */
+bool snapshot_rebuild(const snapshot_t *snapshot, char *frame);
+
+/**************** snapshot_delete ****************/
+/* Free the snapshot and everything it recorded.
+ */
+void snapshot_delete(snapshot_t *snapshot);
+
+#endif // __SNAPSHOT_H
@@ -0,0 +1,120 @@
+/*
+ * snapshottest.c - unit test program for the Nuggets Project's snapshot module
+ *
+ * Code adapted from gridtest.c
+ * Read the README or the TESTING.md file for more information.
+ *
+ * CS50, Team JEN, March 2021
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "snapshot.h"
+#include "display.h"
+#include "memory.h"
+
+// file-local global variables
+static int snapshot_unit_tested = 0;     // number of test cases run
+static int snapshot_unit_failed = 0;     // number of test cases failed
+
+// a macro for shorthand calls to expect()
+#define EXPECT(cond) { unit_expect((cond), __LINE__); }
+
+// Checks 'condition', increments snapshot_unit_tested, prints FAIL or PASS
+void unit_expect(bool condition, int linenum)
+{
+  snapshot_unit_tested++;
+  if (condition) {
+    printf("PASS test %03d at line %d\n", snapshot_unit_tested, linenum);
+  } else {
+    printf("FAIL test %03d at line %d\n", snapshot_unit_tested, linenum);
+    snapshot_unit_failed++;
+  }
+}
+
+// a 3x10 view, in which player A walks along the room
+static const int nR = 3;
+static const int nC = 10;
+static const char *views[] = {
+  "+--------+\n|A....*..|\n+--------+\n",
+  "+--------+\n|.A...*..|\n+--------+\n",
+  "+--------+\n|..A..*..|\n+--------+\n",
+  "+--------+\n|...A.*..|\n+--------+\n",
+  "+--------+\n|....A*..|\n+--------+\n",
+  "+--------+\n|.....A..|\n+--------+\n",
+};
+
+/* **************************************** */
+int main()
+{
+  printf("starting unit test for snapshot...\n");
+  char frame[64];
+  int tick, len;
+
+  // error cases
+  EXPECT(snapshot_new(0, nC, 4) == NULL);
+  EXPECT(snapshot_new(nR, nC, 0) == NULL);
+  EXPECT(snapshot_record(NULL, views[0]) == 0);
+  EXPECT(snapshot_tick(NULL) == 0);
+
+  // nothing recorded yet
+  snapshot_t *snapshot = snapshot_new(nR, nC, 4);
+  EXPECT(snapshot != NULL);
+  EXPECT(snapshot_tick(snapshot) == 0);
+  EXPECT(snapshot_keyframe(snapshot, &tick) == NULL);
+  EXPECT(snapshot_rebuild(snapshot, frame) == false);
+
+  // the first view is a keyframe
+  EXPECT(snapshot_record(snapshot, views[0]) == 1);
+  EXPECT(strcmp(snapshot_keyframe(snapshot, &tick), views[0]) == 0);
+  EXPECT(tick == 1);
+  EXPECT(snapshot_count(snapshot) == 0);
+
+  // later views are deltas from the one before
+  EXPECT(snapshot_record(snapshot, views[1]) == 2);
+  EXPECT(snapshot_record(snapshot, views[1]) == 2);   // unchanged: no new tick
+  EXPECT(snapshot_record(snapshot, views[2]) == 3);
+  EXPECT(snapshot_count(snapshot) == 2);
+  const char *delta = snapshot_delta(snapshot, 0, &len);
+  EXPECT(strcmp(delta, "1 1 .A\n") == 0);
+  EXPECT(len == (int) strlen(delta));
+  EXPECT(snapshot_delta(snapshot, 2, &len) == NULL);
+
+  // a late joiner rebuilds the newest view from the keyframe and deltas
+  EXPECT(snapshot_rebuild(snapshot, frame));
+  EXPECT(strcmp(frame, views[2]) == 0);
+  memcpy(frame, snapshot_keyframe(snapshot, &tick), nR * (nC + 1) + 1);
+  for (int i = 0; i < snapshot_count(snapshot); i++) {
+    EXPECT(display_applyDelta(frame, nR, nC, snapshot_delta(snapshot, i, &len)));
+  }
+  EXPECT(strcmp(frame, views[2]) == 0);
+
+  // every interval-th tick is a new keyframe, and the deltas start over
+  EXPECT(snapshot_record(snapshot, views[3]) == 4);
+  EXPECT(snapshot_record(snapshot, views[4]) == 5);
+  EXPECT(snapshot_keyframe(snapshot, &tick) != NULL);
+  EXPECT(tick == 5);
+  EXPECT(snapshot_count(snapshot) == 0);
+  EXPECT(snapshot_record(snapshot, views[5]) == 6);
+  EXPECT(snapshot_rebuild(snapshot, frame));
+  EXPECT(strcmp(frame, views[5]) == 0);
+
+  // a view too different for a delta is a keyframe
+  EXPECT(snapshot_record(snapshot, "ABCDEFGHIJ\nKLMNOPQRST\nUVWXYZABCD\n") == 7);
+  EXPECT(snapshot_keyframe(snapshot, &tick) != NULL);
+  EXPECT(tick == 7);
+
+  snapshot_delete(snapshot);
+
+  printf("unit test complete\n");
+
+  // print a summary
+  if (snapshot_unit_failed > 0) {
+    printf("FAILED %d of %d tests\n", snapshot_unit_failed, snapshot_unit_tested);
+    return snapshot_unit_failed;
+  } else {
+    printf("PASSED all of %d tests\n", snapshot_unit_tested);
+    return 0;
+  }
+}
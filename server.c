@@ -7,6 +7,7 @@
  *
  */
 
+#define _POSIX_C_SOURCE 200809L   // for clock_gettime
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -14,14 +15,90 @@
 #include <ctype.h>
 #include <time.h>
 #include <unistd.h>
+#include <stdint.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/eventfd.h>
 #include "memory.h"
 #include "message.h"
 #include "log.h"
-#include "hashtable.h"
+#include "clienttable.h"
 #include "set.h"
 #include "grid.h"
+#include "display.h"
+#include "snapshot.h"
+#include "ring.h"
+#include "histogram.h"
 #include "server_player.h"
 
+// number of threads receiving and decoding messages (see start_ingress);
+// 0 to receive them on the game thread, in the message loop
+#ifndef INGRESS
+#define INGRESS 0
+#endif
+
+// 1 to receive and send with io_uring, where the kernel allows it
+// (see message_initBackend); 0 to use epoll
+#ifndef URING
+#define URING 0
+#endif
+
+// the name of a Unix-domain socket on which to take messages too, from
+// clients on this host (see message_openLocal); NULL for UDP only
+#ifndef LOCAL
+#define LOCAL NULL
+#endif
+
+// how much the message module logs of each message (see message_setLogLevel);
+// message_LogErrors keeps the log, and its cost, off the message path
+#ifndef MESSAGELOG
+#define MESSAGELOG message_LogAll
+#endif
+
+// 1 to measure the latency from a message's arrival, as the kernel saw
+// it, to the frames it triggered being sent (see message_setTimestamps)
+#ifndef LATENCY
+#define LATENCY 0
+#endif
+
+// ticks per second at which to refresh the clients, with every change
+// made since the last tick (see handleTick); 0 to refresh after each
+// batch of messages
+#ifndef TICK
+#define TICK 0
+#endif
+
+// most chars kept of what follows the command word in a message
+#define MaxCommandText 64
+
+// most clients whose messages are sequenced before they join the game;
+// with the players and the spectator, within message_MaxPeers
+#define MaxWaiting 4
+
+/* the commands a client may send; see decode_message
+*/
+typedef enum command_type {
+  CMD_PLAY, CMD_SPECTATE, CMD_KEY, CMD_OPTION, CMD_ACK, CMD_RESYNC, CMD_UNKNOWN
+} command_type_t;
+
+/* a message decoded into a compact command, ready for the game to act on
+*/
+typedef struct command {
+  addr_t from;          // who sent it
+  command_type_t type;  // which command
+  char text[MaxCommandText + 1];  // what followed the command word
+  struct timespec arrived;  // when its message arrived; zero if unknown
+} command_t;
+
+/* a thread receiving messages and decoding them into commands
+*/
+typedef struct receiver {
+  pthread_t thread;     // the receiver thread
+  int sock;             // the socket it receives on; 0 for our own UDP socket
+  char *message;        // the message it is decoding
+} receiver_t;
+
 /* struct that stores data about the overall game
 */
 typedef struct game {
@@ -33,44 +110,89 @@ typedef struct game {
   int n_active_players;   // current number of active players
   char curr_symbol;     // current symbol to assign a player
   grid_struct_t *main_grid;   // game grid that sees all
-  hashtable_t *players;   // stores all players; key is their address
+  char *base_map;   // text of the map as loaded, before any gold or players
+  snapshot_t *snapshot;   // recent history of the spectator's view
+  clienttable_t *players;   // stores all players; key is their address
   set_t* symbol_to_player;  // stores all players; key is their symbol
   server_player_t *spectator;  // pointer to the spectator watching the game
+  bool in_batch;    // handling a batch of messages; defer refreshes to its end
+  bool refresh_pending;   // a refresh was deferred to the end of the batch
+  int tick;           // the timer refreshing the clients each tick; 0 if none
+  ring_t *commands;   // commands decoded by the receiver threads, if any
+  int wakeup;         // eventfd the receiver threads wake the game thread with
+  int local;          // our Unix-domain socket, if any; else -1
+  histogram_t *latency;     // arrival-to-send times of refreshes, if measured
+  struct timespec arrival;  // when the message being handled arrived, or zero
+  struct timespec oldest;   // earliest arrival awaiting a refresh, or zero
+  addr_t waiting[MaxWaiting]; // sequenced clients yet to join, oldest first
+  int n_waiting;      // number of clients in waiting
 } game_t;
 
 // global variable
 static game_t* game;
 
+// the receiver threads, if any; see start_ingress
+static receiver_t *receivers;       // the receiver threads
+static int ingress_count = 0;       // number of receiver threads
+static atomic_bool ingress_stopping; // set when the game is over
+
 // local constants
 static const int MaxNameLength = 50;   // max number of chars in playerName
 static const int MaxPlayers = 26;      // maximum number of players
 static const int GoldTotal = 250;      // amount of gold in the game
 static const int GoldMinNumPiles = 10; // minimum number of gold piles
 static const int GoldMaxNumPiles = 30; // maximum number of gold piles
+static const int SnapshotInterval = 64; // ticks between snapshot keyframes
+static const int IngressThreads = INGRESS; // threads receiving messages
+static const char *LocalName = LOCAL;  // Unix-domain socket's name, or NULL
+static const int CommandRingSize = 1024;  // commands queued for the game thread
+static const bool MeasureLatency = LATENCY; // histogram of refresh latency
+static const int TickRate = TICK;      // refreshes per second; 0 for each batch
 
 // function prototypes
 int play_game();
-static bool handleMessage(void *arg, const addr_t from, const char *message);
-static void parse_message(const char *message, addr_t *address);
+static bool handleBatch(void *arg, const int n, const addr_t from[], char *messages[]);
+static bool handleCommands(void *arg);
+static void finish_batch();
+static bool handleTick(void *arg);
+static void note_arrival();
+static void record_latency();
+static void parse_message(char *message, addr_t *address);
+static void decode_message(char *message, const addr_t from, command_t *command);
+static void apply_command(const command_t *command, addr_t *address);
+
+static bool start_ingress();
+static void stop_ingress();
+static void *receive_commands(void *arg);
 
 static position_t* generate_position(grid_struct_t *grid_struct, char valid_symbol);
 static int generate_gold(grid_struct_t *grid_struct);
 static int add_player(addr_t *address, char* player_name);
 
 static bool move(addr_t *address, int x, int y);
+static void run(addr_t *address, int x, int y);
+static bool step(server_player_t *curr, int x, int y);
 static server_player_t *get_player(addr_t *address);
+static server_player_t *get_client(addr_t *address);
+static void set_option(addr_t *address, char *option);
+static void sequence_waiting(addr_t *address);
+static void stop_waiting(addr_t *address);
+static display_t *new_display();
+static void send_replay(server_player_t *client);
 static void pickup_gold(server_player_t *curr, position_t *pos, bool overwrite);
 
 static void send_grid(addr_t address);
-static void send_gold(server_player_t* player);
-static void send_display(server_player_t* player);
+static void send_gold(server_player_t* player, const bool always);
+static void send_display(server_player_t* player, const bool always);
 static void refresh();
-static void refresh_helper(void *arg, const char *key, void *item);
+static void publish();
+static void refresh_helper(void *arg, const addr_t *address, void *item);
+static void visibility_helper(void *arg, const addr_t *address, void *item);
 
 static char* game_result_string();
-static void game_result_string_helper(void *arg, const char *key, void *item);
+static void game_result_string_helper(void *arg, const addr_t *address, void *item);
 static void send_game_result(char* result_string);
-static void send_game_result_helper(void *arg, const char *key, void *item);
+static void send_game_result_helper(void *arg, const addr_t *address, void *item);
 
 game_t* game_new(char *map_filename);
 void game_delete(game_t *game);
@@ -105,6 +227,9 @@ main(const int argc, const char *argv[])
         return 1;
       }
       game->main_grid = main_grid;
+      game->base_map = grid_string(main_grid);
+      game->snapshot = snapshot_new(grid_get_nR(main_grid), grid_get_nC(main_grid),
+                                    SnapshotInterval);
 
     // no seed
     if (argc == 2) {
@@ -153,20 +278,47 @@ play_game()
 {
   log_init(stderr);
   // initialize the message module
-  int ourPort = message_init(stderr);
+  message_setLogLevel(MESSAGELOG);
+  int ourPort = message_initBackend(stderr, URING ? message_Uring : message_Poll,
+                                    IngressThreads > 0);
   if (ourPort == 0) {
     log_v("failure to initalize message module.");
     return 1;
   }
+  if (MeasureLatency) {
+    message_setTimestamps(true);
+    game->latency = histogram_new();
+  }
+  // refresh the clients on a fixed schedule, if asked to and we can
+  if (TickRate > 0 && (game->tick = message_addTimer(1.0 / TickRate, true, handleTick)) > 0) {
+    log_d("refreshing clients %d times a second", TickRate);
+  }
   // announce the port number
   printf("waiting on port %d for contact....\n", ourPort);
+  // and, for clients on this host, the Unix-domain socket
+  if (LocalName != NULL && (game->local = message_openLocal(LocalName)) > 0) {
+    printf("waiting on local socket %s for contact....\n", LocalName);
+  }
   // address of the other side of this communication
   addr_t other = message_noAddr(); // no correspondent yet
 
-  // Loop, waiting for messages; If message recieved, take care of it
-  // using handleMessage function. We use the 'arg' parameter to carry a pointer
-  // to 'other', which allows handleMessage to use it appropriately.
-  bool ok = message_loop(&other, 0, NULL, NULL, handleMessage);
+  bool ok;
+  if (IngressThreads > 0 && start_ingress()) {
+    // Receiver threads decode the messages; loop, waiting for them to
+    // wake us, and take care of the commands using handleCommands.
+    ok = message_loop(&other, 0, NULL, NULL, NULL);
+    stop_ingress();
+  } else {
+    // Loop, waiting for messages; when messages are recieved, take care of
+    // them using handleBatch function. We use the 'arg' parameter to carry a pointer
+    // to 'other', which allows handleBatch to use it appropriately.
+    ok = message_loopBatch(&other, 0, NULL, NULL, handleBatch);
+  }
+  if (game->tick > 0) {
+    message_cancelTimer(game->tick);
+    game->tick = 0;
+  }
+  histogram_print(game->latency, stderr, "refresh latency");
 
   // shut down the modules
   message_done();
@@ -175,25 +327,35 @@ play_game()
   return ok? 0 : 1; // status code depends on result of message_loop
 }
 
-/**************** handleMessage ****************/
-/* Datagram received; parse the message.
+/**************** handleBatch ****************/
+/* Datagrams received; parse each message in order.
  * We use 'arg' to carry an addr_t referring to the 'other' correspondent.
- * If 'other' is a valid client, leave it unchanged.
- * If 'other' is not a valid client, update *from to this sender.
+ * Each sender in turn becomes the correspondent.
+ * Clients are refreshed once, after the whole batch, rather than after
+ * each move; so a burst of keystrokes costs one refresh.
  * Return true if the message loop should exit, otherwise false.
  * e.g., return true if fatal error, or if game play has concluded.
  */
 static bool
-handleMessage(void *arg, const addr_t from, const char *message)
+handleBatch(void *arg, const int n, const addr_t from[], char *messages[])
 {
   addr_t *otherp = (addr_t *)arg;
   if (otherp == NULL) { // defensive
-    log_v("handleMessage called with arg=NULL");
+    log_v("handleBatch called with arg=NULL");
     return true;
   }
-  // this sender becomes our correspondent, henceforth
-  *otherp = from;
-  parse_message(message, otherp);
+  game->in_batch = true;
+  for (int i = 0; i < n; i++) {
+    // once the last gold is picked up, the game is over
+    if (game->gold_remaining == 0 || game->playing_game == false) {
+      break;
+    }
+    // this sender becomes our correspondent, henceforth
+    *otherp = from[i];
+    message_arrival(messages[i], &game->arrival);
+    parse_message(messages[i], otherp);
+  }
+  finish_batch();
 
   // if game has ended, return true to exit the message loop
   if(game->playing_game == false) {
@@ -202,6 +364,192 @@ handleMessage(void *arg, const addr_t from, const char *message)
   return false;
 }
 
+/**************** handleCommands ****************/
+/* The receiver threads have queued commands; apply each in order,
+ * as handleBatch does for the messages it is given.
+ * We use 'arg' to carry an addr_t referring to the 'other' correspondent.
+ * Return true if the message loop should exit, otherwise false.
+ */
+static bool
+handleCommands(void *arg)
+{
+  addr_t *otherp = (addr_t *)arg;
+  if (otherp == NULL) { // defensive
+    log_v("handleCommands called with arg=NULL");
+    return true;
+  }
+  // reset the wakeup before we look, so no command is left behind
+  uint64_t wakeups;
+  if (read(game->wakeup, &wakeups, sizeof(wakeups)) < 0) {
+    return false;   // woken for nothing
+  }
+
+  // take at most a batch at a time, as the message loop would, so that
+  // however fast the commands come, the clients are refreshed, and the
+  // timers fire, in between
+  game->in_batch = true;
+  command_t command;
+  int applied = 0;
+  while (game->gold_remaining > 0 && game->playing_game
+         && applied < message_BatchSize && ring_pop(game->commands, &command)) {
+    // this sender becomes our correspondent, henceforth
+    *otherp = command.from;
+    game->arrival = command.arrived;
+    apply_command(&command, otherp);
+    applied++;
+  }
+  finish_batch();
+  if (applied == message_BatchSize) {
+    // there may be more; come back for them
+    uint64_t one = 1;
+    if (write(game->wakeup, &one, sizeof(one)) < 0) {
+      log_v("handleCommands: cannot wake ourselves");
+    }
+  }
+
+  // if game has ended, return true to exit the message loop
+  return game->playing_game == false;
+}
+
+/**************** finish_batch ****************/
+/* Done handling a batch of messages or commands;
+ * do the one refresh deferred to its end, if any, unless it waits for
+ * the next tick; the end of the game waits for nothing.
+ */
+static void
+finish_batch()
+{
+  game->arrival = (struct timespec) { 0, 0 };
+  game->in_batch = false;
+  if (game->refresh_pending && (game->tick == 0 || game->gold_remaining == 0)) {
+    game->refresh_pending = false;
+    publish();
+  }
+}
+
+/**************** handleTick ****************/
+/* A tick: refresh the clients once, with every change made since the
+ * last tick, if there were any.  So the refreshes, and the frames sent,
+ * per second are bounded by the tick rate, not by the keystrokes.
+ * Return true if the message loop should exit, otherwise false.
+ */
+static bool
+handleTick(void *arg)
+{
+  if (game->refresh_pending) {
+    game->refresh_pending = false;
+    publish();
+  }
+  return game->playing_game == false;
+}
+
+/**************** start_ingress ****************/
+/* Start IngressThreads receiver threads, each receiving on its own socket
+ * that shares our port (the first on our own socket), and one more on our
+ * Unix-domain socket, if any, decoding messages into commands, and
+ * queueing them for the game thread; see receive_commands.  Receiving,
+ * parsing and logging each message thus no longer hold up the game.
+ *
+ * We RETURN: true if at least one thread was started; otherwise false,
+ * and the game thread should receive the messages itself.
+ */
+static bool
+start_ingress()
+{
+  game->commands = ring_new(CommandRingSize, sizeof(command_t));
+  game->wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (game->commands == NULL || game->wakeup < 0
+      || !message_watch(game->wakeup, handleCommands)) {
+    log_v("start_ingress: cannot queue commands; receiving on the game thread");
+    ring_delete(game->commands);
+    game->commands = NULL;
+    if (game->wakeup >= 0) {
+      close(game->wakeup);
+    }
+    game->wakeup = -1;
+    return false;
+  }
+  atomic_init(&ingress_stopping, false);
+  int nthreads = IngressThreads + (game->local > 0 ? 1 : 0);
+  receivers = count_calloc_assert(nthreads, sizeof(receiver_t), "receivers");
+  for (int i = 0; i < nthreads; i++) {
+    receiver_t *receiver = &receivers[i];
+    // the first thread receives on our own socket, the last on our local one
+    if (i == IngressThreads) {
+      receiver->sock = game->local;
+    } else {
+      receiver->sock = (i == 0) ? 0 : message_openReceiver();
+    }
+    if (receiver->sock < 0) {
+      log_d("start_ingress: only %d receiver threads", i);
+      break;
+    }
+    receiver->message = count_malloc_assert(message_MaxBytes, "receiver buffer");
+    if (pthread_create(&receiver->thread, NULL, receive_commands, receiver) != 0) {
+      message_closeReceiver(receiver->sock);
+      free(receiver->message);
+      log_d("start_ingress: only %d receiver threads", i);
+      break;
+    }
+    ingress_count++;
+  }
+  return ingress_count > 0;
+}
+
+/**************** stop_ingress ****************/
+/* Stop the receiver threads, once the game is over, and free
+ * what they used.
+ */
+static void
+stop_ingress()
+{
+  atomic_store(&ingress_stopping, true);
+  for (int i = 0; i < ingress_count; i++) {
+    message_stopReceiver(receivers[i].sock);
+  }
+  for (int i = 0; i < ingress_count; i++) {
+    pthread_join(receivers[i].thread, NULL);
+    message_closeReceiver(receivers[i].sock);
+    free(receivers[i].message);
+  }
+  ingress_count = 0;
+  free(receivers);
+  message_unwatch(game->wakeup);
+  close(game->wakeup);
+  game->wakeup = -1;
+  ring_delete(game->commands);
+  game->commands = NULL;
+}
+
+/**************** receive_commands ****************/
+/* A receiver thread, 'arg' being its receiver_t: receive each message
+ * on its socket, decode it into a command, queue it for the game thread,
+ * and wake the game thread.  We never touch the game itself.
+ */
+static void *
+receive_commands(void *arg)
+{
+  receiver_t *receiver = arg;
+  addr_t from;
+  command_t command;
+  while (message_receive(receiver->sock, receiver->message, &from) >= 0) {
+    decode_message(receiver->message, from, &command);
+    message_arrival(receiver->message, &command.arrived);
+    // if the game thread is behind, wait for it to catch up
+    while (!ring_push(game->commands, &command)) {
+      if (atomic_load(&ingress_stopping)) {
+        return NULL;
+      }
+      sched_yield();
+    }
+    uint64_t one = 1;
+    if (write(game->wakeup, &one, sizeof(one)) < 0) {
+      log_v("receive_commands: cannot wake the game thread");
+    }
+  }
+  return NULL;
+}
+
 /**************** parse_message ****************/
 /* Parse the message recieved and respond appropriately
  * by calling the proper helper function.
@@ -215,66 +563,140 @@ handleMessage(void *arg, const addr_t from, const char *message)
  *   send an error message back to the client.
  */
 static void
-parse_message(const char *message, addr_t *address)
+parse_message(char *message, addr_t *address)
+{
+  command_t command;
+  decode_message(message, *address, &command);
+  apply_command(&command, address);
+}
+
+/**************** decode_message ****************/
+/* Decode the message recieved into a command: which command it is,
+ * and what followed the command word, with a player's name already
+ * truncated and cleaned up.  This does not touch the game, so the
+ * receiver threads can call it.
+ *
+ * Caller provides:
+ *   valid message string, which we may modify,
+ *   the address of the client who sent it,
+ *   valid pointer to the command to fill in.
+ */
+static void
+decode_message(char *message, const addr_t from, command_t *command)
 {
   // Player to Server Commands
   char *play = "PLAY";
   char *key = "KEY";
   char *spectate = "SPECTATE";
+  // Client to Server Commands for the protocol extensions
+  char *option = "OPTION";
+  char *ack = "ACK";
+  char *resync = "RESYNC";
 
   // find the command by looping through message string
-  // until a space char is reached
-  char *command = (char*) message;
-  char *remainder = (char*) message;
-  while (!isspace(*remainder)) {
+  // until a space char (or the end of the message) is reached
+  char *cmd = message;
+  char *remainder = message;
+  while (*remainder != '\0' && !isspace(*remainder)) {
     remainder++;
   }
   // found end of word, put end of string character
-  *remainder = '\0';
-  //increment remainder to find start of the rest of message
-  remainder++;
+  if (*remainder != '\0') {
+    *remainder = '\0';
+    //increment remainder to find start of the rest of message
+    remainder++;
+  }
+
+  command->from = from;
+  if (strcmp(cmd, play) == 0) {
+    command->type = CMD_PLAY;
+    // truncate player name to MaxNameLength
+    if(strlen(remainder) > MaxNameLength) {
+      remainder[MaxNameLength] = '\0';
+    }
+    // update nongraph/nonblank chars to underscores
+    for(int i = 0; i < strlen(remainder); i++) {
+      char c = remainder[i];
+      if(!isgraph(c) && !isblank(c)) {
+        remainder[i] = '_';
+      }
+    }
+  } else if (strcmp(cmd, spectate) == 0) {
+    command->type = CMD_SPECTATE;
+  } else if (strcmp(cmd, key) == 0) {
+    command->type = CMD_KEY;
+  } else if (strcmp(cmd, option) == 0) {
+    command->type = CMD_OPTION;
+  } else if (strcmp(cmd, ack) == 0) {
+    command->type = CMD_ACK;
+  } else if (strcmp(cmd, resync) == 0) {
+    command->type = CMD_RESYNC;
+  } else {
+    command->type = CMD_UNKNOWN;
+  }
+  strncpy(command->text, remainder, MaxCommandText);
+  command->text[MaxCommandText] = '\0';
+}
+
+/**************** apply_command ****************/
+/* Act on a decoded command, and respond appropriately
+ * by calling the proper helper function.
+ *
+ * Caller provides:
+ *   valid command, from decode_message
+ *   valid address pointer of the player who sent the message
+ * Notes:
+ *   On any command that isn't appropriate, we
+ *   send an error message back to the client.
+ */
+static void
+apply_command(const command_t *command, addr_t *address)
+{
+  // a copy of what followed the command word, which we may modify
+  char remainder[MaxCommandText + 1];
+  strcpy(remainder, command->text);
 
   // 1) Command to ADD A NEW PLAYER
-  if (strcmp(command, play) == 0) {
+  if (command->type == CMD_PLAY) {
+    // a client that asked for sequencing has now joined, or is turned away
+    stop_waiting(address);
+
     // write error message, too many players
     if (game->player_number >= MaxPlayers) {
       // write error message, too many players
-      message_send(*address, "QUIT Game is full: no more players can join.");
+      message_sendControl(*address, "QUIT Game is full: no more players can join.");
+      message_sequence(*address, false);
 
     // write error message, name not provided
     } else if(strlen(remainder) == 0) {
-      message_send(*address, "QUIT Sorry - you must provide player's name.");
+      message_sendControl(*address, "QUIT Sorry - you must provide player's name.");
+      message_sequence(*address, false);
     }
 
     // otherwise, we can add this player to the game
     else {
-      // truncate player name to MaxNameLength
-      if(strlen(remainder) > MaxNameLength) {
-        remainder[MaxNameLength] = '\0';
-      }
-      // update nongraph/nonblank chars to underscores
-      for(int i = 0; i < strlen(remainder); i++) {
-        char c = remainder[i];
-        if(!isgraph(c) && !isblank(c)) {
-          remainder[i] = '_';
-        }
-      }
       // add player to game using their parsed player name
       if (add_player(address, remainder) != 0) {
-        message_send(*address, "QUIT Game is full: no more space on the grid for players to join.");
+        message_sendControl(*address, "QUIT Game is full: no more space on the grid for players to join.");
+        message_sequence(*address, false);
       }
     }
 
   // 2) Command to ADD A NEW SPECTATOR
-  } else if (strcmp(command, spectate) == 0) {
+  } else if (command->type == CMD_SPECTATE) {
+    stop_waiting(address);
+
     // initalize new spectator
     addr_t new = *address;
-    server_player_t *new_spectator = server_player_new(new, spectate, '!', false, NULL);
+    server_player_t *new_spectator = server_player_new(new, "SPECTATE", '!', false, NULL);
     server_player_setGrid(new_spectator, game->main_grid);
+    server_player_setDisplay(new_spectator, new_display());
 
     // if there is already a spectator, replace them
    if (game->spectator != NULL) {
-     message_send(server_player_getAddress(game->spectator), "QUIT You have been replaced by a new spectator.");
+     addr_t old = server_player_getAddress(game->spectator);
+     message_sendControl(old, "QUIT You have been replaced by a new spectator.");
+     message_sequence(old, false);
      server_spectator_delete(game->spectator);
     }
     game->spectator = new_spectator;
@@ -284,7 +706,7 @@ parse_message(const char *message, addr_t *address)
     refresh();
 
   // 3) Command to HANDLE A KEY PRESS
-  } else if (strcmp(command, key) == 0) {
+  } else if (command->type == CMD_KEY) {
     // read what the key is
     char c = *remainder;
 
@@ -293,16 +715,16 @@ parse_message(const char *message, addr_t *address)
 
       // send appropriate message depending on if client is spectator or player
       if(game->spectator != NULL && message_eqAddr(server_player_getAddress(game->spectator), *address)) {
-        message_send(*address, "QUIT Thanks for watching!");
+        message_sendControl(*address, "QUIT Thanks for watching!");
+        message_sequence(*address, false);
         server_spectator_delete(game->spectator);
         game->spectator = NULL;
       } else {
-        message_send(*address, "QUIT Thanks for playing!");
+        message_sendControl(*address, "QUIT Thanks for playing!");
+        message_sequence(*address, false);
 
         // get pointer to player who just quit using their address
-        char portnum1[100];
-        sprintf(portnum1, "%d",ntohs((*address).sin_port));
-        server_player_t *curr = hashtable_find(game->players, portnum1);
+        server_player_t *curr = clienttable_find(game->players, address);
         server_player_setActive(curr, false); // no longer active
         game->n_active_players--;
 
@@ -325,7 +747,7 @@ parse_message(const char *message, addr_t *address)
           break;
         // Move to the left (until not possible)
         case 'H':
-          while(move(address, -1, 0));
+          run(address, -1, 0);
           break;
 
         // Move right
@@ -334,7 +756,7 @@ parse_message(const char *message, addr_t *address)
           break;
         // Move right (until not possible)
         case 'L':
-          while(move(address, 1, 0));
+          run(address, 1, 0);
           break;
 
         // Move up
@@ -343,7 +765,7 @@ parse_message(const char *message, addr_t *address)
           break;
         // Move up (until not possible)
         case 'K':
-          while(move(address, 0, -1));
+          run(address, 0, -1);
           break;
 
         // Move down
@@ -352,7 +774,7 @@ parse_message(const char *message, addr_t *address)
           break;
         // Move down (until not possible)
         case 'J':
-          while(move(address, 0, 1));
+          run(address, 0, 1);
           break;
 
         // move diagonally up and left
@@ -361,7 +783,7 @@ parse_message(const char *message, addr_t *address)
           break;
         // move diagonally up and left (until not possible)
         case 'Y':
-          while(move(address, -1, -1));
+          run(address, -1, -1);
           break;
 
         // move diagonally up and right
@@ -370,7 +792,7 @@ parse_message(const char *message, addr_t *address)
           break;
         // move diagonally up and right (until not possible)
         case 'U':
-          while(move(address, 1, -1));
+          run(address, 1, -1);
           break;
 
         // move diagonally down and left
@@ -379,7 +801,7 @@ parse_message(const char *message, addr_t *address)
           break;
         // move diagonally down and left (until not possible)
         case 'B':
-          while(move(address, -1, 1));
+          run(address, -1, 1);
           break;
 
         // move diagonally down and right
@@ -388,7 +810,7 @@ parse_message(const char *message, addr_t *address)
           break;
         // move diagonally down and right (until not possible)
         case 'N':
-          while(move(address, 1, 1));
+          run(address, 1, 1);
           break;
 
         // bad key, send error message
@@ -398,6 +820,22 @@ parse_message(const char *message, addr_t *address)
       }
     }
 
+  // 4) Command to CHOOSE HOW DISPLAY FRAMES ARE ENCODED
+  } else if (command->type == CMD_OPTION) {
+    set_option(address, remainder);
+
+  // 5) Command to ACKNOWLEDGE A NUMBERED FRAME
+  } else if (command->type == CMD_ACK) {
+    display_ack(server_player_getDisplay(get_client(address)), atoi(remainder));
+
+  // 6) Command to ASK FOR A FULL FRAME
+  } else if (command->type == CMD_RESYNC) {
+    server_player_t *client = get_client(address);
+    if (client != NULL) {
+      display_resync(server_player_getDisplay(client));
+      send_display(client, true);
+    }
+
   // recieved a message that does not match our game syntax, send error
   } else {
     message_send(*address, "ERROR unable to understand message");
@@ -524,11 +962,10 @@ add_player(addr_t *address, char* player_name)
     pos = generate_position(game->main_grid, '.');
   }
   server_player_t *new_player = server_player_new(*address, player_name, game->curr_symbol, true, pos);
+  server_player_setDisplay(new_player, new_display());
 
-  // add player to hashtable (portnum->player)
-  char portnum[100];
-  sprintf(portnum, "%d",ntohs((*address).sin_port));
-  hashtable_insert(game->players, portnum, new_player);
+  // add player to the table of clients (address->player)
+  clienttable_insert(game->players, address, new_player);
   game->n_active_players++;
 
   // add player to set (symbol->player)
@@ -539,7 +976,7 @@ add_player(addr_t *address, char* player_name)
   // send player the accept message
   char player_info[5];
   sprintf(player_info, "OK %c", server_player_getSymbol(new_player));
-  message_send(*address, player_info);
+  message_sendControl(*address, player_info);
 
   // add the player symbol to main grid
   grid_set_character(game->main_grid, server_player_getSymbol(new_player), pos);
@@ -589,7 +1026,8 @@ pickup_gold(server_player_t *curr, position_t *pos, bool overwrite)
   game->gold_remaining -= gold_picked_up;
   // update player's gold count
   server_player_setGoldNumber(curr, server_player_getGoldNumber(curr) + gold_picked_up);
-  server_player_setGoldPickedUp(curr, gold_picked_up);
+  // add to any gold picked up since the player was last sent a GOLD message
+  server_player_setGoldPickedUp(curr, server_player_getGoldPickedUp(curr) + gold_picked_up);
 
   if (gold_picked_up > 0) {
     game->gold_pile_number --;
@@ -597,7 +1035,7 @@ pickup_gold(server_player_t *curr, position_t *pos, bool overwrite)
 }
 
 /**************** move ****************/
-/* Handle player movement across the board.
+/* Handle player movement across the board, by one step.
  *
  * Caller provides:
 `*   valid address_t pointer, representing the player's address
@@ -609,8 +1047,53 @@ pickup_gold(server_player_t *curr, position_t *pos, bool overwrite)
 static bool
 move(addr_t *address, int x, int y)
 {
-  // Get the position to the direction of the player
+  if (!step(get_player(address), x, y)) {
+    return false;
+  }
+  refresh();
+  return true;
+}
+
+/**************** run ****************/
+/* Handle a run: move the player step by step in one direction until
+ * they cannot go on, picking up gold and swapping with any player met
+ * along the way, as repeated moves would; but refresh the clients once,
+ * with where the run ended and all the gold it picked up, if the player
+ * moved at all.
+ *
+ * Caller provides: as for move.
+ */
+static void
+run(addr_t *address, int x, int y)
+{
   server_player_t *curr = get_player(address);
+  bool moved = false;
+  while (step(curr, x, y)) {
+    moved = true;
+  }
+  if (moved) {
+    refresh();
+  }
+}
+
+/**************** step ****************/
+/* Move a player by one step, if they can, without refreshing the
+ * clients; the player, and any player they swap with, remember what
+ * they can see from where they end up.
+ *
+ * Caller provides:
+`*   valid server_player_t pointer, representing the player
+ *   valid int values representing how much to increment in x and y
+ * We return:
+ *    True if the player moved, false if they could not.
+ */
+static bool
+step(server_player_t *curr, int x, int y)
+{
+  if (curr == NULL) {
+    return false;
+  }
+  // Get the position to the direction of the player
   int new_x = pos_get_x(server_player_getPos(curr)) + x;
   int new_y = pos_get_y(server_player_getPos(curr)) + y;
 
@@ -645,6 +1128,8 @@ move(addr_t *address, int x, int y)
       // update each player's positions appropriately
       server_player_setPos(player2, curr_pos_p1);
       server_player_setPos(curr, new);
+      // the other player remembers what they see from where they now stand
+      grid_visibility(server_player_getGrid(player2), curr_pos_p1);
 
     } else {
       // If the next point is a passage, adjust the grid accordingly
@@ -680,14 +1165,15 @@ move(addr_t *address, int x, int y)
       server_player_setPos(curr, new);
     }
 
-    refresh();
+    // the player remembers what they see from where they now stand
+    grid_visibility(server_player_getGrid(curr), new);
     return true;
   }
   return false;
 }
 
 /**************** get_player ****************/
-/* Searches the hashtable of players to find the player
+/* Searches the table of players to find the player
  * that corresponds to the provided address.
  * User provides:
  *      valid address of the player we are searching for
@@ -695,13 +1181,201 @@ move(addr_t *address, int x, int y)
  */
 static server_player_t *get_player(addr_t *address)
 {
-  // search hashtable for player with the address
-  char portnum1[100];
-  sprintf(portnum1, "%d",ntohs((*address).sin_port));
-  server_player_t *curr = hashtable_find(game->players, portnum1);
+  // search the table for the player with the address; this formats
+  // and allocates nothing, as it is done for every keystroke
+  server_player_t *curr = clienttable_find(game->players, address);
   return curr;
 }
 
+/**************** get_client ****************/
+/* Find the client (the spectator, or an active player)
+ * that corresponds to the provided address.
+ * User provides:
+ *      valid address of the client we are searching for
+ * We return a pointer to the client found, otherwise NULL.
+ */
+static server_player_t *
+get_client(addr_t *address)
+{
+  if (game->spectator != NULL
+      && message_eqAddr(server_player_getAddress(game->spectator), *address)) {
+    return game->spectator;
+  }
+  server_player_t *player = get_player(address);
+  if (player != NULL && server_player_getActive(player)) {
+    return player;
+  }
+  return NULL;
+}
+
+/**************** set_option ****************/
+/* Handle an OPTION message, by which a client chooses how its
+ * DISPLAY frames are encoded, or that its messages be sequenced;
+ * then send the client a full frame in the new encoding.
+ *
+ * Caller provides:
+ *   valid address pointer of the client who sent the message
+ *   the rest of the message, after "OPTION ": a name and any arguments
+ * Notes:
+ *   A client may ask for sequencing before it joins, so that the OK or
+ *   QUIT answering its PLAY is retried too; every other option needs a
+ *   client in the game.  We send an error message back on an unknown
+ *   client or option.
+ */
+static void
+set_option(addr_t *address, char *option)
+{
+  server_player_t *client = get_client(address);
+  if (client == NULL) {
+    if (strcmp(option, "sequence") == 0) {
+      sequence_waiting(address);
+    } else {
+      message_send(*address, "ERROR you must join the game before choosing options");
+    }
+    return;
+  }
+  display_t *display = server_player_getDisplay(client);
+
+  if (strcmp(option, "delta") == 0) {
+    display_setMode(display, DISPLAY_DELTA);
+  } else if (strcmp(option, "basemap") == 0) {
+    display_setMode(display, DISPLAY_BASEMAP);
+  } else if (strcmp(option, "binary") == 0) {
+    display_setMode(display, DISPLAY_BINARY);
+  } else if (strcmp(option, "rle") == 0) {
+    display_setMode(display, DISPLAY_RLE);
+  } else if (strncmp(option, "viewport ", strlen("viewport ")) == 0) {
+    // a window size, and for the spectator, optionally a fixed centre
+    int rows, cols, row, col;
+    int nargs = sscanf(option + strlen("viewport "), "%d %d %d %d", &rows, &cols, &row, &col);
+    if ((nargs != 2 && nargs != 4) || !display_setWindow(display, rows, cols)) {
+      message_send(*address, "ERROR usage: OPTION viewport rows cols [row col]");
+      return;
+    }
+    if (nargs == 4) {
+      display_setCentre(display, row, col);
+    }
+    display_setMode(display, DISPLAY_VIEWPORT);
+  } else if (strcmp(option, "replay") == 0) {
+    // the whole map is for the spectator's eyes only
+    if (client != game->spectator) {
+      message_send(*address, "ERROR only the spectator may replay the game");
+      return;
+    }
+    send_replay(client);
+  } else if (strcmp(option, "text") == 0) {
+    display_setMode(display, DISPLAY_TEXT);
+  } else if (strcmp(option, "sequence") == 0) {
+    // number every message from now on, and make sure QUIT arrives
+    if (!message_sequence(*address, true)) {
+      message_send(*address, "ERROR too many clients with sequenced messages");
+      return;
+    }
+  } else {
+    message_send(*address, "ERROR unknown option");
+    return;
+  }
+  send_display(client, true);
+}
+
+/**************** sequence_waiting ****************/
+/* Sequence the messages to a client that has not yet joined the game,
+ * so that the OK or QUIT answering its PLAY or SPECTATE is retried.
+ * We remember up to MaxWaiting such clients; when one more asks, we
+ * stop sequencing to the one that asked longest ago, so that clients
+ * who never join cannot use up the message module's peers.
+ *
+ * Caller provides:
+ *   valid address pointer of the client who sent the OPTION
+ */
+static void
+sequence_waiting(addr_t *address)
+{
+  for (int i = 0; i < game->n_waiting; i++) {
+    if (message_eqAddr(game->waiting[i], *address)) {
+      return;   // asked already
+    }
+  }
+  if (game->n_waiting == MaxWaiting) {
+    addr_t oldest = game->waiting[0];
+    stop_waiting(&oldest);
+    message_sequence(oldest, false);
+  }
+  if (!message_sequence(*address, true)) {
+    message_send(*address, "ERROR too many clients with sequenced messages");
+    return;
+  }
+  game->waiting[game->n_waiting++] = *address;
+}
+
+/**************** stop_waiting ****************/
+/* Forget that a client asked for sequencing before joining, once it
+ * joins or is turned away; its messages stay sequenced.
+ * We do nothing if the client is not waiting.
+ */
+static void
+stop_waiting(addr_t *address)
+{
+  for (int i = 0; i < game->n_waiting; i++) {
+    if (message_eqAddr(game->waiting[i], *address)) {
+      game->n_waiting--;
+      memmove(&game->waiting[i], &game->waiting[i + 1],
+              (game->n_waiting - i) * sizeof(addr_t));
+      return;
+    }
+  }
+}
+
+/**************** new_display ****************/
+/* Create the display for a new client, which knows the static map
+ * so that the client can later choose to be sent it just once.
+ * We return the new display.
+ */
+static display_t *
+new_display()
+{
+  display_t *display = display_new(grid_get_nR(game->main_grid),
+                                   grid_get_nC(game->main_grid));
+  display_setBase(display, game->base_map);
+  return display;
+}
+
+/**************** send_replay ****************/
+/* Send the spectator the recent history of the game, as recorded in
+ * the snapshot: the keyframe, then the delta of each tick since.
+ * These are sent just as they are stored, with no rendering.
+ *
+ * Caller provides:
+ *   valid pointer to the spectator.
+ */
+static void
+send_replay(server_player_t *client)
+{
+  // make sure the history is up to date
+  snapshot_record(game->snapshot, grid_render(game->main_grid));
+
+  int tick;
+  const char *keyframe = snapshot_keyframe(game->snapshot, &tick);
+  if (keyframe == NULL) {
+    return;
+  }
+  char header[32];
+  struct iovec iov[2];
+  iov[0].iov_base = header;
+  iov[0].iov_len = sprintf(header, "KEYFRAME %d\n", tick);
+  iov[1].iov_base = (char *) keyframe;
+  iov[1].iov_len = grid_get_nR(game->main_grid) * (grid_get_nC(game->main_grid) + 1);
+  message_sendv(server_player_getAddress(client), iov, 2);
+
+  for (int i = 0; i < snapshot_count(game->snapshot); i++) {
+    int len;
+    iov[1].iov_base = (char *) snapshot_delta(game->snapshot, i, &len);
+    iov[1].iov_len = len;
+    iov[0].iov_len = sprintf(header, "TICK %d\n", tick + i + 1);
+    message_sendv(server_player_getAddress(client), iov, 2);
+  }
+}
+
 /**************** send_grid ****************/
 /* As defined in the specs, sends a grid message
  * as the following: "GRID nrows ncols"
@@ -725,19 +1399,25 @@ send_grid(addr_t address)
  *    Where n = number of gold just picked up
  *          p = number of gold in purse
  *          r = number of gold remaining
+ * The message is skipped, unless 'always', if it would tell the client
+ * nothing new: no gold picked up, and the same gold remaining as last time.
  *
  * Caller provides:
 `*   valid player pointer to the player to send the message
  */
 static void
-send_gold(server_player_t* player)
+send_gold(server_player_t* player, const bool always)
 {
   int n = server_player_getGoldPickedUp(player);
   int p = server_player_getGoldNumber(player);
   int r = game->gold_remaining;
+  if (!always && n == 0 && r == server_player_getGoldShown(player)) {
+    return;
+  }
   char gold_info[256];
   sprintf(gold_info, "GOLD %d %d %d", n, p, r);
   message_send(server_player_getAddress(player), gold_info);
+  server_player_setGoldShown(player, r);
   // reset to 0; no longer picked up new gold
   server_player_setGoldPickedUp(player, 0);
 }
@@ -750,45 +1430,113 @@ send_gold(server_player_t* player)
  *
  * Caller provides:
 `*   valid player pointer to the player to send the message
+ * The frame is skipped, unless 'always', if this client's view has not
+ * changed since the last frame it was sent: most moves change only what
+ * a few players can see, and every other client need not hear of it.
  */
 static void
-send_display(server_player_t* player)
+send_display(server_player_t* player, const bool always)
 {
-  send_gold(player); // first inform player of their gold
+  send_gold(player, always); // first inform player of their gold
 
-  char *string;
+  // the grid keeps its rendering cached between refreshes, and only
+  // redraws the rows that changed; so we must not free the string
+  const char *string;
+  unsigned long version;
+  display_t *display = server_player_getDisplay(player);
   // if a spectator, retrieve string of entire grid
   if(player == game->spectator) {
-    string = grid_string(game->main_grid);
+    string = grid_render(game->main_grid);
+    version = grid_version(game->main_grid);
   // if a regular player, retrieve string based on visibility
   } else {
+    position_t *pos = server_player_getPos(player);
     grid_struct_t *grid = server_player_getGrid(player);
-    grid_visibility(grid, server_player_getPos(player));
-    string = grid_string_player(game->main_grid, grid, server_player_getPos(player));
+    grid_visibility(grid, pos);
+    string = grid_render_player(game->main_grid, grid, pos);
+    version = grid_version(grid);
+    // a player's viewport follows them
+    display_setCentre(display, pos_get_y(pos), pos_get_x(pos));
+  }
+
+  // the rendering only gets a new version when its text changes; if this
+  // client was already sent this version, it would see nothing new
+  if (!always && version == server_player_getShown(player)) {
+    return;
   }
 
-  // create string to send the grid message
-  char *display_info = malloc(strlen(string) * sizeof(char*));
-  sprintf(display_info, "DISPLAY\n%s", string);
-  message_send(server_player_getAddress(player), display_info);
-  free(string);
-  free(display_info);
+  // a client who asked for the static map is sent it once, before any frame
+  int len;
+  const char *map_info = display_encodeBase(display, &len);
+  if (map_info != NULL && len <= message_MaxLength) {
+    message_send(server_player_getAddress(player), map_info);
+  }
+
+  // encode the frame as this client asked: in full, compressed, as a delta,
+  // or just the window around the client's centre; a full frame is sent
+  // straight from the grid's cached rendering, without copying it
+  struct iovec iov[2];
+  int iovcnt = display_encodev(display, string, iov);
+  len = 0;
+  for (int i = 0; i < iovcnt; i++) {
+    len += iov[i].iov_len;
+  }
+  // the message module sends a frame too large for one datagram in
+  // fragments; but even that has its limits
+  if (len > message_MaxLength) {
+    log_d("send_display: %d-byte frame is too large for a message", len);
+    return;
+  }
+  // a client too slow to take every frame gets the newest it can; any
+  // frame may be lost, as every frame is complete or based on one the
+  // client acknowledged
+  if (iovcnt > 0) {
+    message_sendFrame(server_player_getAddress(player), iov, iovcnt);
+  }
+  server_player_setShown(player, version);
 }
 
 /**************** refresh ****************/
+/* The game has changed; send the display to all active players and
+ * the spectator, now or, if handling a batch or refreshing on ticks,
+ * once at the end of the batch or at the next tick (see publish).
+ */
+static void
+refresh()
+{
+  note_arrival();
+
+  // while handling a batch of messages, or between ticks, refresh once,
+  // later; but players must still remember what they saw along the way
+  if (game->in_batch || game->tick > 0) {
+    clienttable_iterate(game->players, NULL, visibility_helper);
+    game->refresh_pending = true;
+    return;
+  }
+  publish();
+}
+
+/**************** publish ****************/
 /* Send the display to all active players and the spectator.
  * If there is no more gold remaining, we send the game result
  * to all players and end the game.
  */
 static void
-refresh()
+publish()
 {
+  // record this tick of the spectator's view, for later replay
+  snapshot_record(game->snapshot, grid_render(game->main_grid));
+
+  // queue every client's messages, to send them all together at the end;
+  // each display's buffers stay unchanged until then
+  message_hold();
+
   // send display to all players
-  hashtable_iterate(game->players, NULL, refresh_helper);
+  clienttable_iterate(game->players, NULL, refresh_helper);
 
   // send updates to spectator
   if(game->spectator != NULL) {
-    send_display(game->spectator);
+    send_display(game->spectator, false);
   }
 
   // if no more gold remains, send game result and end the game
@@ -798,23 +1546,79 @@ refresh()
     free(result);
     game->playing_game = false;
   }
+  message_flush();
+  record_latency();
+}
+
+/**************** note_arrival ****************/
+/* If measuring latency, note when the message now being handled arrived,
+ * if that is earlier than any other awaiting a refresh: a refresh
+ * deferred to the end of a batch is as late as its earliest message.
+ */
+static void
+note_arrival()
+{
+  struct timespec *a = &game->arrival, *o = &game->oldest;
+  if (game->latency == NULL || (a->tv_sec == 0 && a->tv_nsec == 0)) {
+    return;
+  }
+  if ((o->tv_sec == 0 && o->tv_nsec == 0) || a->tv_sec < o->tv_sec
+      || (a->tv_sec == o->tv_sec && a->tv_nsec < o->tv_nsec)) {
+    *o = *a;
+  }
+}
+
+/**************** record_latency ****************/
+/* If measuring latency, the frames of a refresh have just been sent:
+ * count the time since the earliest message awaiting it arrived.
+ * The kernel stamps arrivals by the same clock, CLOCK_REALTIME.
+ */
+static void
+record_latency()
+{
+  struct timespec *o = &game->oldest;
+  if (game->latency == NULL || (o->tv_sec == 0 && o->tv_nsec == 0)) {
+    return;
+  }
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  int64_t ns = (int64_t) (now.tv_sec - o->tv_sec) * 1000000000
+               + (now.tv_nsec - o->tv_nsec);
+  histogram_add(game->latency, ns > 0 ? ns : 0);
+  *o = (struct timespec) { 0, 0 };
 }
 
 /**************** refresh_helper ****************/
 /* Helper method for refresh().
- * Used to iterate through players in the hashtable. If
+ * Used to iterate through players in the table. If
  * the player is active, send them the display of the grid.
  */
 static void
-refresh_helper(void *arg, const char *key, void *item)
+refresh_helper(void *arg, const addr_t *address, void *item)
 {
-  if (key != NULL) {
+  if (address != NULL) {
     server_player_t* curr = item;
     // if player is active, send the player a display of the grid
     // since send_display also sends gold messages, active players
     // also recieve updates on the amount of gold they currently have
     if(server_player_getActive(curr) == true) {
-      send_display(curr);
+      send_display(curr, false);
+    }
+  }
+}
+
+/**************** visibility_helper ****************/
+/* Helper method for refresh().
+ * Used to iterate through players in the table, updating
+ * what each active player can see from where they stand.
+ */
+static void
+visibility_helper(void *arg, const addr_t *address, void *item)
+{
+  if (address != NULL) {
+    server_player_t* curr = item;
+    if(server_player_getActive(curr) == true) {
+      grid_visibility(server_player_getGrid(curr), server_player_getPos(curr));
     }
   }
 }
@@ -832,21 +1636,21 @@ game_result_string()
   char* result_string = malloc((14 + MaxNameLength * sizeof(char))*(game->player_number+1));
   char* first_line = "QUIT GAME OVER:\n";
   strcpy(result_string, first_line);
-  hashtable_iterate(game->players, result_string, game_result_string_helper);
+  clienttable_iterate(game->players, result_string, game_result_string_helper);
   return result_string;
 }
 
 /**************** game_result_string_helper ****************/
 /* Helper method for game_result_string().
- * Used for iterating through the hashtable of players
+ * Used for iterating through the table of players
  * to obtain how much gold each player has collected and add
  * that information to the result string.
  */
 static void
-game_result_string_helper(void *arg, const char *key, void *item)
+game_result_string_helper(void *arg, const addr_t *address, void *item)
 {
   char *result_string = arg;
-  if (key != NULL) {
+  if (address != NULL) {
     server_player_t* curr = item;
     char *player_string = malloc(100);
     sprintf(player_string, "%c %*d %-3s\n", server_player_getSymbol(curr), 10,
@@ -867,25 +1671,25 @@ game_result_string_helper(void *arg, const char *key, void *item)
 static void
 send_game_result(char* result_string)
 {
-  hashtable_iterate(game->players, result_string, send_game_result_helper);
+  clienttable_iterate(game->players, result_string, send_game_result_helper);
   // send updates to spectator
   if(game->spectator != NULL) {
-    message_send(server_player_getAddress(game->spectator), result_string);
+    message_sendControl(server_player_getAddress(game->spectator), result_string);
   }
 }
 
 /**************** send_game_result_helper ****************/
 /* Helper method for send_game_result()
- * Used for iterating through the hashtable of players to send the
+ * Used for iterating through the table of players to send the
  * game result string to each player at the conclusion of the game.
  */
 static void
-send_game_result_helper(void *arg, const char *key, void *item)
+send_game_result_helper(void *arg, const addr_t *address, void *item)
 {
-  if (key != NULL) {
+  if (address != NULL) {
     char* result_string = arg;
     server_player_t* curr = item;
-    message_send(server_player_getAddress(curr), result_string);
+    message_sendControl(server_player_getAddress(curr), result_string);
   }
 }
 
@@ -908,11 +1712,22 @@ game_new(char *map_filename)
   game->player_number = 0;
   game->n_active_players = 0;
   game->curr_symbol = 'A';
-  hashtable_t *ht = hashtable_new(MaxPlayers);
   game->symbol_to_player = set_new();
-  game->players = ht;
+  game->players = clienttable_new(MaxPlayers);
   game->spectator = NULL;
   game->main_grid = NULL;
+  game->base_map = NULL;
+  game->snapshot = NULL;
+  game->in_batch = false;
+  game->refresh_pending = false;
+  game->tick = 0;
+  game->commands = NULL;
+  game->wakeup = -1;
+  game->local = -1;
+  game->latency = NULL;
+  game->arrival = (struct timespec) { 0, 0 };
+  game->oldest = (struct timespec) { 0, 0 };
+  game->n_waiting = 0;
   return game;
 }
 
@@ -928,17 +1743,20 @@ game_delete(game_t *game)
   if(game != NULL) {
     free(game->map_filename);
     grid_delete(game->main_grid);
-    hashtable_delete(game->players, game_delete_helper);
+    free(game->base_map);
+    snapshot_delete(game->snapshot);
+    clienttable_delete(game->players, game_delete_helper);
     set_delete(game->symbol_to_player, NULL);
     server_spectator_delete(game->spectator);
+    histogram_delete(game->latency);
     free(game);
   }
 }
 
 /**************** game_delete_helper ****************/
 /* Helper method for game_delete.
- * Use with hashtable_delete, to delete the player stored
- * as the item in the hashtable.
+ * Use with clienttable_delete, to delete the player stored
+ * as the item in the table.
  */
 static void
 game_delete_helper(void *item)
@@ -0,0 +1,416 @@
+/*
+ * fragtest.c - unit test program for the message module's fragments
+ *
+ * Sends messages to our own port, over loopback, and checks what
+ * message_loop hands on: a long message is reassembled exactly, from
+ * fragments in any order, and a malformed fragment is dropped, never
+ * written outside the message it claims to belong to.  Then it sends
+ * long messages to a slow peer, a Unix-domain socket of its own that it
+ * does not read until they are all sent, and checks that the peer's
+ * backlog keeps every fragment of a message, and supersedes every
+ * fragment of a frame.  The test runs once with each backend
+ * (message_Poll, then message_Uring where io_uring is available).
+ *
+ * Code adapted from lib/ringtest.c
+ * Read the README or the TESTING.md file for more information.
+ *
+ * CS50, Team JEN, March 2021
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "message.h"
+#include "log.h"
+
+// file-local global variables
+static int frag_unit_tested = 0;     // number of test cases run
+static int frag_unit_failed = 0;     // number of test cases failed
+
+// a macro for shorthand calls to expect()
+#define EXPECT(cond) { unit_expect((cond), __LINE__); }
+
+// Checks 'condition', increments frag_unit_tested, prints FAIL or PASS
+void unit_expect(bool condition, int linenum)
+{
+  frag_unit_tested++;
+  if (condition) {
+    printf("PASS test %03d at line %d\n", frag_unit_tested, linenum);
+  } else {
+    printf("FAIL test %03d at line %d\n", frag_unit_tested, linenum);
+    frag_unit_failed++;
+  }
+}
+
+// what one round of messages should deliver, and what it did
+typedef struct round {
+  const char *expect;   // the long message expected, if any
+  int length;           // its length
+  int matched;          // messages delivered equal to it
+  int other;            // messages delivered that were not, besides END
+} round_t;
+
+// what a slow peer received: the fragments of each message, by id
+#define MaxIds 8
+typedef struct slow {
+  int sock;                 // the peer's socket
+  unsigned id[MaxIds];      // each message it received fragments of
+  int n[MaxIds];            // in how many fragments
+  int got[MaxIds];          // how many of them arrived
+  int ids;                  // number of messages
+} slow_t;
+
+// the bytes of a long test message
+static char *long_message(const int length);
+
+// send the datagrams made by the caller, then END, and loop until END
+static void run_round(const addr_t self, round_t *round);
+
+// send one raw fragment: a FRAG line, and 'size' bytes of body
+static void send_fragment(const addr_t self, const char *line,
+                          const char *body, const int size);
+
+static bool handleTimeout(void *arg);
+static bool handleMessage(void *arg, const addr_t from, const char *message);
+
+// open a Unix-domain socket by that name, which we do not read yet
+static int open_slow(const char *name);
+
+// read all that was sent to the slow peer, until nothing more arrives
+static void read_slow(slow_t *slow);
+static bool handleSlow(void *arg);
+static bool handleDone(void *arg);
+
+// the number of fragments of message id the slow peer received; -1 if
+// none, and sets *n to the number it was sent in
+static int slow_got(const slow_t *slow, const unsigned id, int *n);
+
+// test sending long messages to a slow peer
+static void test_slow(void);
+
+// test one backend
+static void test_backend(const message_backend_t backend);
+
+/* **************************************** */
+int main()
+{
+  printf("starting unit test for message fragments...\n");
+  log_init(NULL);
+
+  test_backend(message_Poll);
+  test_backend(message_Uring);
+
+  printf("unit test complete\n");
+
+  // print a summary
+  if (frag_unit_failed > 0) {
+    printf("FAILED %d of %d tests\n", frag_unit_failed, frag_unit_tested);
+    return frag_unit_failed;
+  } else {
+    printf("PASSED all of %d tests\n", frag_unit_tested);
+    return 0;
+  }
+}
+
+static void
+test_backend(const message_backend_t backend)
+{
+  printf("backend %s\n", backend == message_Poll ? "poll" : "uring");
+  int port = message_initBackend(NULL, backend, false);
+  EXPECT(port > 0);
+  if (port == 0) {
+    return;
+  }
+  message_setLogLevel(message_LogErrors);
+  char portStr[10];
+  sprintf(portStr, "%d", port);
+  addr_t self;
+  EXPECT(message_setAddr("localhost", portStr, &self));
+
+  // a long message is sent in fragments, and comes back whole
+  const int length = 120000;
+  char *text = long_message(length);
+  round_t round = { text, length, 0, 0 };
+  message_sendBytes(self, text, length);
+  run_round(self, &round);
+  EXPECT(round.matched == 1);
+  EXPECT(round.other == 0);
+
+  // so does one holding '\0', here in each fragment
+  round = (round_t) { text, length, 0, 0 };
+  text[10] = text[70000] = '\0';
+  message_sendBytes(self, text, length);
+  run_round(self, &round);
+  text[10] = text[70000] = 'z';
+  EXPECT(round.matched == 1);
+  EXPECT(round.other == 0);
+
+  // the longest message one datagram holds, leaving room for the '\0'
+  // that ends it, and the shortest sent in fragments, both come back whole
+  for (int len = message_MaxBytes - 1; len <= message_MaxBytes; len++) {
+    round = (round_t) { text, len, 0, 0 };
+    char save = text[len];
+    text[len] = '\0';
+    message_sendBytes(self, text, len);
+    run_round(self, &round);
+    text[len] = save;
+    EXPECT(round.matched == 1);
+    EXPECT(round.other == 0);
+  }
+
+  // fragments sent by hand, last first, are put back in order
+  round = (round_t) { text, length, 0, 0 };
+  int share = (length + 1) / 2;
+  char line[40];
+  sprintf(line, "FRAG 77 1 2 %d\n", length);
+  send_fragment(self, line, text + share, length - share);
+  sprintf(line, "FRAG 77 0 2 %d\n", length);
+  send_fragment(self, line, text, share);
+  run_round(self, &round);
+  EXPECT(round.matched == 1);
+  EXPECT(round.other == 0);
+
+  // malformed fragments are dropped, and none is put anywhere
+  round = (round_t) { NULL, 0, 0, 0 };
+  // more fragments than a 100-byte message is split into; a fragment's
+  // share would then lie past the end of the message
+  send_fragment(self, "FRAG 1 30 32 100\n", "AAAA", 4);
+  send_fragment(self, "FRAG 2 0 2 100\n", text, 50);
+  send_fragment(self, "FRAG 2 1 2 100\n", text, 50);
+  // fewer fragments than the message needs
+  sprintf(line, "FRAG 3 0 1 %d\n", length);
+  send_fragment(self, line, text, 60000);
+  // an index out of range, or a fragment of the wrong size
+  send_fragment(self, "FRAG 4 1 1 10\n", text, 10);
+  send_fragment(self, "FRAG 4 -1 1 10\n", text, 10);
+  send_fragment(self, "FRAG 5 0 1 10\n", text, 5);
+  send_fragment(self, "FRAG 5 0 1 10\n", text, 11);
+  // lengths out of range, a missing field, or no end to the FRAG line
+  send_fragment(self, "FRAG 6 0 1 0\n", text, 0);
+  send_fragment(self, "FRAG 6 0 33 2145000\n", text, 10);
+  send_fragment(self, "FRAG 6 0 1\n", text, 10);
+  send_fragment(self, "FRAG 6 0 1 10", text, 10);
+  run_round(self, &round);
+  EXPECT(round.other == 0);
+
+  // and the module still reassembles what follows them
+  round = (round_t) { text, length, 0, 0 };
+  message_sendBytes(self, text, length);
+  run_round(self, &round);
+  EXPECT(round.matched == 1);
+  EXPECT(round.other == 0);
+
+  free(text);
+  test_slow();
+  message_done();
+}
+
+static void
+test_slow(void)
+{
+  char ourName[40], slowName[40];
+  sprintf(ourName, "@fragtest%d", (int) getpid());
+  sprintf(slowName, "@fragslow%d", (int) getpid());
+  EXPECT(message_openLocal(ourName) > 0);
+  slow_t slow = { .sock = open_slow(slowName), .ids = 0 };
+  EXPECT(slow.sock >= 0);
+  addr_t peer;
+  EXPECT(message_setLocalAddr(slowName, &peer));
+  if (slow.sock < 0) {
+    return;
+  }
+
+  // a message in more fragments than a backlog holds messages; the
+  // peer takes a few, and the rest wait for it, all of them
+  const int length = message_MaxLength - 100000;
+  char *text = long_message(length);
+  message_sendBytes(peer, text, length);
+  read_slow(&slow);
+  int n = 0;
+  int got = slow_got(&slow, slow.id[0], &n);
+  EXPECT(slow.ids == 1);
+  EXPECT(got == n);
+  EXPECT(n > message_Backlog);
+
+  // three frames, each in 8 fragments, while the peer is not reading: the
+  // second supersedes what is left of the first, and the third the whole
+  // of the second
+  slow.ids = 0;
+  struct iovec iov = { .iov_base = text, .iov_len = 8 * 65000 - 1000 };
+  message_sendFrame(peer, &iov, 1);
+  message_sendFrame(peer, &iov, 1);
+  message_sendFrame(peer, &iov, 1);
+  read_slow(&slow);
+  EXPECT(slow.ids >= 1);
+  unsigned last = slow.ids > 0 ? slow.id[slow.ids - 1] : 0;
+  EXPECT(slow_got(&slow, last, &n) == 8);
+  EXPECT(slow_got(&slow, last - 1, &n) == -1);
+
+  free(text);
+  close(slow.sock);
+}
+
+/**************** long_message ****************/
+/* Return a malloc'd message of 'length' bytes, which differ from one
+ * fragment's share to the next, so a share out of place shows.
+ */
+static char *
+long_message(const int length)
+{
+  char *text = malloc(length + 1);
+  if (text == NULL) {
+    fprintf(stderr, "out of memory\n");
+    exit(1);
+  }
+  for (int i = 0; i < length; i++) {
+    text[i] = 'a' + (i * 7 + i / 1000) % 26;
+  }
+  text[length] = '\0';
+  return text;
+}
+
+/**************** run_round ****************/
+/* Send END, after whatever the caller sent, and hand on all that arrives
+ * until END does; give up if nothing arrives for a second.
+ */
+static void
+run_round(const addr_t self, round_t *round)
+{
+  message_send(self, "END");
+  EXPECT(message_loop(round, 1, handleTimeout, NULL, handleMessage));
+}
+
+/**************** send_fragment ****************/
+static void
+send_fragment(const addr_t self, const char *line,
+              const char *body, const int size)
+{
+  struct iovec iov[2];
+  iov[0].iov_base = (char *) line;
+  iov[0].iov_len = strlen(line);
+  iov[1].iov_base = (char *) body;
+  iov[1].iov_len = size;
+  message_sendv(self, iov, 2);
+}
+
+/**************** open_slow ****************/
+/* Open a Unix-domain datagram socket by that name ("@" and a name in the
+ * abstract namespace), to stand for a slow peer; -1 on error.
+ */
+static int
+open_slow(const char *name)
+{
+  addr_t addr;
+  if (!message_setLocalAddr(name, &addr)) {
+    return -1;
+  }
+  int sock = socket(AF_UNIX, SOCK_DGRAM, 0);
+  socklen_t len = offsetof(struct sockaddr_un, sun_path) + strlen(name);
+  if (sock < 0 || bind(sock, &addr.sa, len) != 0) {
+    return -1;
+  }
+  return sock;
+}
+
+/**************** read_slow ****************/
+/* The slow peer reads, at last, from within the loop, so the module
+ * sends it what waits in its backlog as room appears (every 10 ms); we
+ * stop after half a second, long after the backlog is gone.
+ */
+static void
+read_slow(slow_t *slow)
+{
+  message_watch(slow->sock, handleSlow);
+  message_addTimer(0.5, false, handleDone);
+  EXPECT(message_loop(slow, 0, NULL, NULL, handleMessage));
+  message_unwatch(slow->sock);
+}
+
+/**************** handleSlow ****************/
+/* The slow peer has datagrams to read; note each fragment.
+ */
+static bool
+handleSlow(void *arg)
+{
+  slow_t *slow = arg;
+  static char buf[65536];      // more than message_MaxBytes
+  ssize_t len;
+  while ((len = recv(slow->sock, buf, message_MaxBytes, MSG_DONTWAIT)) > 0) {
+    buf[len] = '\0';
+    unsigned id;
+    int i, n, length;
+    if (sscanf(buf, "FRAG %u %d %d %d", &id, &i, &n, &length) != 4) {
+      continue;
+    }
+    int k = 0;
+    while (k < slow->ids && slow->id[k] != id) {
+      k++;
+    }
+    if (k == slow->ids && k < MaxIds) {
+      slow->id[k] = id;
+      slow->n[k] = n;
+      slow->got[k] = 0;
+      slow->ids++;
+    }
+    if (k < MaxIds) {
+      slow->got[k]++;
+    }
+  }
+  return false;
+}
+
+/**************** handleDone ****************/
+/* The slow peer has had long enough; end the round.
+ */
+static bool
+handleDone(void *arg)
+{
+  return true;
+}
+
+/**************** slow_got ****************/
+static int
+slow_got(const slow_t *slow, const unsigned id, int *n)
+{
+  for (int k = 0; k < slow->ids; k++) {
+    if (slow->id[k] == id) {
+      *n = slow->n[k];
+      return slow->got[k];
+    }
+  }
+  return -1;
+}
+
+/**************** handleTimeout ****************/
+/* Nothing arrived for a second; END was lost, or never sent.
+ */
+static bool
+handleTimeout(void *arg)
+{
+  round_t *round = arg;
+  round->other++;
+  return true;
+}
+
+/**************** handleMessage ****************/
+/* Count the message, if it is the one expected, or not; stop at END.
+ */
+static bool
+handleMessage(void *arg, const addr_t from, const char *message)
+{
+  round_t *round = arg;
+  if (strcmp(message, "END") == 0) {
+    return true;
+  }
+  if (round->expect != NULL
+      && memcmp(message, round->expect, round->length + 1) == 0) {
+    round->matched++;
+  } else {
+    round->other++;
+  }
+  return false;
+}
@@ -13,8 +13,10 @@
  * David Kotz - May 2019
  */
 
+#define _GNU_SOURCE     // for recvmmsg and sendmmsg
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdbool.h>
 #include <unistd.h>
 #include <errno.h>
@@ -23,9 +25,21 @@
 #include <netdb.h>
 #include <arpa/inet.h>
 #include <sys/select.h>
+#include <sys/socket.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#endif
 #include <math.h>
 #include "message.h"
 #include "log.h"
+#ifdef __linux__
+#include "uring.h"
+#include "shm.h"
+#endif
 
 /**************** file-local constants ****************/
 /* See message.h for other constants (shared with users of this module).
@@ -34,6 +48,31 @@
  */
 static const int MinPort = 1024;
 static const int MaxPort = 65535;
+// Most buffers of one held message_sendv message we refer to, not copy.
+#define MaxHeldIov 4
+// Most bytes of the SEQ, CTL, or FRAG line that begins a message.
+#define HeaderBytes 40
+// Most control messages awaiting their CTLACK at once.
+#define MaxControls 32
+// Seconds between tries of a control message, and most tries of each.
+static const float RetransmitInterval = 0.2;
+static const int MaxTries = 5;
+// Most bytes of a message in each fragment (see message_MaxLength).
+static const int FragmentShare = 65000;
+// Most messages reassembled at once, and seconds we wait for the rest
+// of one before we drop it.
+#define MaxReassembly 8
+static const int ReassemblyTimeout = 2;
+
+// Seconds between tries to send the messages waiting for slow peers.
+static const float BacklogInterval = 0.01;
+// Most datagrams waiting for one peer: message_Backlog messages, each in
+// as many as message_MaxFragments fragments.
+#define BacklogDatagrams (message_Backlog * message_MaxFragments)
+
+// Tries, and seconds per try, message_openShared waits for an answer.
+static const int ShareTries = 10;
+static const float ShareInterval = 0.1;
 
 /**************** file-local global variables ****************/
 /* This is an example of a judicious use of a global variable.
@@ -47,12 +86,320 @@ static const int MaxPort = 65535;
  * but a more flexible approach would require a much more complex interface.
  */
 static int ourSocket = 0;     // socket on which to receive messages
+static int ourLocal = 0;      // Unix-domain socket, if message_openLocal
+static addr_t ourLocalName;   // its name, to remove if a pathname
+#ifdef __linux__
+static uring_t *ourUring = NULL;  // its io_uring, if message_Uring
+#endif
+static bool sharedPort = false;   // may receivers share our port?
+static message_loglevel_t logLevel = message_LogAll;  // see message_setLogLevel
+static bool timestamps = false;   // see message_setTimestamps
+
+/**************** file-local types ****************/
+/* batch_t: a batch of messages received together, their senders, and
+ * when each arrived (zero if not known; see message_setTimestamps).
+ * The buffers are all carved from one allocation, 'space'.  A message
+ * in 'buf' may instead be one reassembled from fragments.
+ */
+typedef struct batch {
+  char *space;                      // memory for all the buffers
+  char *own[message_BatchSize];     // the buffers, to receive into
+  char *buf[message_BatchSize];     // one message per buffer
+  addr_t from[message_BatchSize];   // sender of each message
+  struct timespec when[message_BatchSize];  // arrival of each message
+} batch_t;
+
+/* arrivals_t: messages handed to the handlers, and when each arrived,
+ * for message_arrival.
+ */
+typedef struct arrivals {
+  int n;                            // number of messages
+  char **buf;                       // the messages
+  struct timespec *when;            // when each arrived
+} arrivals_t;
+
+// for message_arrival: the messages the handlers on this thread have now,
+// and the last one message_receive returned on this thread
+static _Thread_local arrivals_t delivered;
+static _Thread_local const char *receivedBuf;
+static _Thread_local struct timespec receivedWhen;
+
+/* outbox_t: messages held, in order, to be sent together by message_flush.
+ * Messages from message_send and message_sendBytes, whose memory the
+ * caller may reuse at once, are copied into 'copies'; those from
+ * message_sendv refer to the caller's buffers.
+ */
+typedef struct outbox {
+  bool holding;                               // hold messages, not send?
+  int count;                                  // number of messages held
+  addr_t to[message_QueueSize];               // where each is to be sent
+  struct iovec iov[message_QueueSize][MaxHeldIov]; // buffers of each
+  char header[message_QueueSize][HeaderBytes];  // SEQ or CTL line of each
+  int iovcnt[message_QueueSize];              // number of buffers of each
+  bool latest[message_QueueSize];             // from message_sendFrame?
+  unsigned part[message_QueueSize];           // fragment of message id; 0 if whole
+  int copy[message_QueueSize];                // offset in 'copies', or -1
+  char *copies;                               // copies of the messages held
+  int used;                                   // bytes in use in 'copies'
+  int size;                                   // bytes allocated for 'copies'
+} outbox_t;
+
+static outbox_t outbox;       // initially empty, and not holding
+
+/* watch_t: another file descriptor the loop watches for input, set by
+ * message_watch; each epoll event from it is EventWatch + its index.
+ */
+typedef struct watch {
+  bool set;                           // is this watch in use?
+  int fd;                             // the file descriptor
+  bool (*handleReady)(void *arg);     // called when it has input
+} watch_t;
+
+static watch_t watches[message_MaxWatches];  // initially none set
+
+/* peer_t: a peer whose messages we sequence, and the last numbers used.
+ */
+typedef struct peer {
+  bool set;                   // is this slot in use?
+  addr_t addr;                // the peer
+  unsigned frames;            // last SEQ number sent to it
+  unsigned controls;          // last CTL number sent to it
+} peer_t;
+
+static peer_t peers[message_MaxPeers];    // initially none set
+static int npeers = 0;                    // number set
+
+/* backlog_t: the datagrams waiting for a peer slow to receive them,
+ * oldest first, each a copy; see message_send.  The fragments of one
+ * message (see send_fragments) wait one after another, and are counted,
+ * superseded, and dropped together, as one message.  Only the thread that
+ * sends uses the backlogs, so they need no lock.
+ */
+typedef struct backlog {
+  bool set;                           // is this slot in use?
+  addr_t to;                          // the peer
+  int count;                          // datagrams waiting
+  char *message[BacklogDatagrams];    // each datagram, with its header
+  int length[BacklogDatagrams];       // and its length
+  bool latest[BacklogDatagrams];      // from message_sendFrame?
+  unsigned part[BacklogDatagrams];    // fragment of message id; 0 if whole
+} backlog_t;
+
+static backlog_t backlogs[message_MaxBacklogs];  // initially none set
+static int nbacklogs = 0;                        // number set
+static int backlogTimer = 0;                     // timer sending them, or 0
+
+/* control_t: a control message sent, and not yet acknowledged.
+ * Receiver threads take CTLACKs too (in message_receive), so the
+ * controls are guarded by controlLock.
+ */
+typedef struct control {
+  bool set;                   // is this slot in use?
+  addr_t to;                  // where it was sent
+  unsigned seq;               // its CTL number
+  int tries;                  // times sent so far
+  char *message;              // a copy of the message
+} control_t;
+
+static control_t controls[MaxControls];   // initially none set
+static pthread_mutex_t controlLock = PTHREAD_MUTEX_INITIALIZER;
+static int retransmitTimer = 0;           // timer retrying them, or 0
+
+/* reassembly_t: a message being reassembled from its fragments; at most
+ * one per sender.  Once complete, it is handed to the handlers, and
+ * freed when the next batch arrives.
+ */
+typedef struct reassembly {
+  bool set;                   // is this slot in use?
+  bool complete;              // has every fragment arrived?
+  addr_t from;                // the sender
+  unsigned id;                // the sender's id for the message
+  int n;                      // number of fragments
+  int length;                 // length of the message
+  int received;               // number of fragments arrived
+  uint32_t got;               // bit i set once fragment i arrived
+  time_t started;             // when its first fragment arrived
+  char *buf;                  // the message, length+1 bytes
+} reassembly_t;
+
+static reassembly_t reassembly[MaxReassembly];  // initially none set
+static unsigned fragmentId = 0;                  // id of the last message we split
+
+/* handlers_t: the handlers, and their arg, passed to message_loop or
+ * message_loopBatch, and the buffers for the messages they handle.
+ */
+typedef struct handlers {
+  void *arg;
+  float timeout;
+  bool (*handleTimeout)(void *arg);
+  bool (*handleInput)  (void *arg);
+  bool (*handleMessage)(void *arg, const addr_t from, const char *buf);
+  bool (*handleBatch)  (void *arg, const int n, const addr_t from[], char *buf[]);
+  batch_t *batch;     // NULL if we are not handling messages
+} handlers_t;
+
+#ifdef __linux__
+/* msgtimer_t: a timer set by message_addTimer, which is a timerfd.
+ * The loop watches all of them, and stdin and the sockets, with epoll;
+ * each epoll event says which it is from: EventInput, EventSocket,
+ * EventLocal, EventWatch + (a watch's index), EventTimer + (the
+ * timer's index), or EventChannel + (a channel's index).
+ */
+typedef struct msgtimer {
+  bool set;                           // is this timer in use?
+  int fd;                             // the timerfd
+  bool periodic;                      // repeat, or fire once?
+  bool (*handleTimer)(void *arg);     // called when it fires
+} msgtimer_t;
+
+static msgtimer_t timers[message_MaxTimers];  // initially none set
+static int ourEpoll = -1;     // epoll instance, while message_loop runs
+enum { EventInput, EventSocket, EventLocal, EventWatch,
+       EventTimer = EventWatch + message_MaxWatches,
+       EventChannel = EventTimer + message_MaxTimers };
+
+/* channel_t: a peer with which we exchange messages through shared memory
+ * (see message_openShared), not a socket; the loop watches its eventfd.
+ */
+typedef struct channel {
+  bool set;                   // is this channel in use?
+  addr_t peer;                // the peer, by its Unix-domain address
+  shm_t *shm;                 // the memory we share
+} channel_t;
+
+static channel_t channels[message_MaxChannels];  // initially none set
+static int nchannels = 0;                         // number set
+#endif
 
 /**************** file-local functions ****************/
-/* stringAddr: format a string representation of an address.
- * Returns pointer to static storage and thus should not be retained.
+/* addrLen: the length of the address, for sendmsg.
+ * socketFor: the socket from which to send to the address; 0 if none.
+ */
+static socklen_t addrLen(const addr_t *addr);
+static int socketFor(const addr_t *addr);
+
+/* loop: the loop behind message_loop and message_loopBatch.
+ * batch_new, batch_delete: allocate and free the buffers for a batch.
+ * batch_receive: receive a batch of messages from the socket.
+ * batch_keep: keep those messages received that are from Internet hosts.
+ */
+static bool loop(void *arg, const float timeout,
+                 bool (*handleTimeout)(void *arg),
+                 bool (*handleInput)  (void *arg),
+                 bool (*handleMessage)(void *arg, const addr_t from, const char *buf),
+                 bool (*handleBatch)  (void *arg, const int n,
+                                       const addr_t from[], char *buf[]));
+static batch_t *batch_new(void);
+static void batch_delete(batch_t *batch);
+static int batch_receive(batch_t *batch, const int sock);
+static int batch_keep(const int nrecv, const int nbytes[],
+                      addr_t from[], char *buf[], struct timespec when[]);
+
+/* stamp_socket: have the kernel stamp messages arriving on a socket.
+ * arrival_of: the time the kernel stamped a message received; zero if none.
+ */
+static void stamp_socket(const int sock, const bool on);
+static struct timespec arrival_of(const struct msghdr *msg);
+
+/* sendv: message_sendv, or message_sendFrame if 'latest'.
+ * hold: add a message to the outbox, copying it if 'copy'.
+ * send_held: send every message in the outbox, and empty it.
+ * send_some: send some messages of the outbox from one socket.
+ * send_now: send a message at once, or add it to its peer's backlog.
+ * send_one: try to send a message at once, without waiting.
+ */
+static void sendv(const addr_t to, const struct iovec *iov, const int iovcnt,
+                  const bool latest);
+static void hold(const addr_t to, const char *header, const int hlen,
+                 const struct iovec *iov, const int iovcnt, bool copy,
+                 const bool latest, const unsigned part);
+static void send_held(void);
+static void send_some(const int sock, const int which[], const int n);
+static ssize_t send_now(const addr_t to, const char *header, const int hlen,
+                        const struct iovec *iov, const int iovcnt,
+                        const bool latest, const unsigned part);
+static ssize_t send_one(const addr_t *to, const struct iovec *iov, const int iovcnt);
+
+/* find_backlog: the backlog of messages waiting for a peer; NULL if none.
+ * wait_in_backlog: add a copy of a message to its peer's backlog.
+ * backlog_messages: the number of messages a backlog holds.
+ * drop_message: drop a message from a backlog, with all its fragments.
+ * drain: send what a backlog holds, while the peer takes it; true if
+ *   all of it went, and the backlog is gone.
+ * drain_all: the timer handler that drains every backlog.
+ * blocked: does this errno mean "no room now", rather than failure?
+ */
+static backlog_t *find_backlog(const addr_t *to);
+static void wait_in_backlog(const addr_t *to, const struct iovec *iov,
+                            const int iovcnt, const bool latest,
+                            const unsigned part);
+static int backlog_messages(const backlog_t *backlog);
+static void drop_message(backlog_t *backlog, const int m);
+static bool drain(backlog_t *backlog);
+static bool drain_all(void *arg);
+static bool blocked(const int err);
+
+/* find_peer: the peer's slot, if its messages are sequenced; else NULL.
+ * frame_header: format the SEQ line for a message to 'to', if sequenced.
+ * send_control: send (or hold) control message number seq.
+ * retransmit: the timer handler that retries unacknowledged controls.
+ * take_ack: if the message is a CTLACK, note it, and return true.
+ * controls_left: are any controls unacknowledged? resend them if asked.
+ * linger: give unacknowledged controls a last chance, at message_done.
+ */
+static peer_t *find_peer(const addr_t addr);
+static int frame_header(const addr_t to, char *header);
+static void send_control(const addr_t to, const unsigned seq, const char *message);
+static bool retransmit(void *arg);
+static bool take_ack(const addr_t from, const char *buf);
+static bool controls_left(const bool resend);
+static void linger(void);
+
+/* send_fragments: send a message too long for one datagram in fragments.
+ * reassemble: add a fragment to its message; return the message once whole.
+ * release: free the reassembled messages handed on (or all, if 'all').
+ */
+static void send_fragments(const addr_t to, const char *header, const int hlen,
+                           const struct iovec *iov, const int iovcnt,
+                           const bool latest);
+static char *reassemble(const addr_t from, const char *buf, const int len);
+static void release(const bool all);
+
+#ifdef __linux__
+/* find_channel: the channel to a peer; NULL if none.
+ * open_channel, close_channel: set up, or take down, channel c.
+ * channel_accept: take a channel a peer offers us, or decline it.
+ * channel_ready: receive and handle a batch of messages from channel c.
+ * channel_held: put held message i into a channel.
+ */
+static channel_t *find_channel(const addr_t *addr);
+static void open_channel(const int c, const addr_t peer, shm_t *shm);
+static void close_channel(const int c);
+static bool channel_accept(const struct msghdr *msg, const char *buf,
+                           const int len, const addr_t from);
+static bool channel_ready(handlers_t *h, const int c);
+static void channel_held(channel_t *channel, const int i);
+#endif
+
+/* loop_epoll, loop_select: wait for and handle events, until a handler
+ *   says to quit; with epoll on Linux, and with select elsewhere.
+ * socket_ready: receive and handle a batch of messages.
+ * deliver: hand a batch of messages to the handlers.
+ * timer_ready: handle the expiry of a timer.
+ * timers_set: is any timer set?
+ * watches_set: is any other file descriptor watched?
  */
-static const char *stringAddr(const addr_t addr);
+#ifdef __linux__
+static bool loop_epoll(handlers_t *h);
+static bool timer_ready(const int t, void *arg);
+#else
+static bool loop_select(handlers_t *h);
+#endif
+static bool socket_ready(handlers_t *h, const int sock);
+static bool deliver(handlers_t *h, const int n, addr_t from[], char *buf[],
+                    struct timespec when[]);
+static bool timers_set(void);
+static bool watches_set(void);
 
 
 /***********************************************************************/
@@ -65,6 +412,19 @@ static const char *stringAddr(const addr_t addr);
  */
 int
 message_init(FILE *logFP)
+{
+  return message_initBackend(logFP, message_Poll, false);
+}
+
+/**************** message_initBackend ****************/
+/*
+ * As message_init, and then set up io_uring if asked; we fall back to
+ * epoll (or select) if it is unavailable.
+ * See message.h for detailed description.
+ */
+int
+message_initBackend(FILE *logFP, const message_backend_t backend,
+                    const bool receivers)
 {
   log_init(logFP);
 
@@ -82,6 +442,20 @@ message_init(FILE *logFP)
     return 0;
   }
 
+  // Let receiver sockets share our port (see message_openReceiver), but
+  // only if asked: any socket of ours could then bind it
+  sharedPort = false;
+#ifdef SO_REUSEPORT
+  int one = 1;
+  if (receivers) {
+    if (setsockopt(ourSocket, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) == 0) {
+      sharedPort = true;
+    } else {
+      log_e("message_init: letting receivers share our port");
+    }
+  }
+#endif
+
   // Name socket using wildcards
   struct sockaddr_in self;  // our address
   self.sin_family = AF_INET;
@@ -106,9 +480,70 @@ message_init(FILE *logFP)
   int port = ntohs(self.sin_port);
   log_d("message_init: ready at port '%d'", port);
 
+  if (backend == message_Uring) {
+#ifdef __linux__
+    ourUring = uring_new(ourSocket);
+    if (ourUring != NULL) {
+      log_v("message_init: using io_uring");
+      return port;
+    }
+#endif
+    log_v("message_init: io_uring unavailable; falling back");
+  }
   return port;
 }
 
+/**************** message_setLogLevel ****************/
+/*
+ * Choose how much of the traffic to log.
+ * See message.h for detailed description.
+ */
+void
+message_setLogLevel(const message_loglevel_t level)
+{
+  logLevel = level;
+}
+
+/**************** message_setTimestamps ****************/
+/*
+ * Choose whether to note when each message arrives.
+ * See message.h for detailed description.
+ */
+void
+message_setTimestamps(const bool on)
+{
+  timestamps = on;
+  if (ourSocket > 0) {
+    stamp_socket(ourSocket, on);
+  }
+  if (ourLocal > 0) {
+    stamp_socket(ourLocal, on);
+  }
+}
+
+/**************** message_arrival ****************/
+/*
+ * Tell when a message arrived.
+ * See message.h for detailed description.
+ */
+bool
+message_arrival(const char *buf, struct timespec *when)
+{
+  if (buf == NULL || when == NULL) {
+    return false;
+  }
+  *when = (struct timespec) { 0, 0 };
+  for (int i = 0; i < delivered.n; i++) {
+    if (delivered.buf[i] == buf) {
+      *when = delivered.when[i];
+    }
+  }
+  if (buf == receivedBuf) {
+    *when = receivedWhen;
+  }
+  return when->tv_sec != 0 || when->tv_nsec != 0;
+}
+
 /**************** message_noAddr ****************/
 /*
  * Return an empty/nonexistent address.
@@ -117,11 +552,9 @@ message_init(FILE *logFP)
 addr_t
 message_noAddr(void)
 {
-  // addr_t is identical to sockaddr_in
-  struct sockaddr_in none;
-  none.sin_family = 0;
-  none.sin_port = 0;
-  none.sin_addr.s_addr = 0;
+  // all zero, even the padding, so message_eqAddr may compare names whole
+  addr_t none;
+  memset(&none, 0, sizeof(none));
 
   return none;
 }
@@ -134,8 +567,12 @@ message_noAddr(void)
 bool
 message_isAddr(const addr_t addr)
 {
-  // a valid address will be in Internet Family
-  return (addr.sin_family == AF_INET);
+  // a valid address will be in Internet Family, or a named Unix socket
+  // (an unnamed sender's name is all zero, as the name was before receiving)
+  if (addr.sa.sa_family == AF_UNIX) {
+    return addr.un.sun_path[0] != '\0' || addr.un.sun_path[1] != '\0';
+  }
+  return (addr.sa.sa_family == AF_INET);
 }
 
 /**************** message_eqAddr ****************/
@@ -146,10 +583,16 @@ message_isAddr(const addr_t addr)
 bool
 message_eqAddr(const addr_t a, const addr_t b)
 {
+  if (a.sa.sa_family == AF_UNIX) {
+    // names are zero-padded, and one in the abstract namespace begins
+    // with a zero, so compare the whole of them
+    return b.sa.sa_family == AF_UNIX
+      && memcmp(a.un.sun_path, b.un.sun_path, sizeof(a.un.sun_path)) == 0;
+  }
   return
-    a.sin_family == b.sin_family
-    && a.sin_port == b.sin_port
-    && a.sin_addr.s_addr == b.sin_addr.s_addr;
+    a.sa.sa_family == b.sa.sa_family
+    && a.in.sin_port == b.in.sin_port
+    && a.in.sin_addr.s_addr == b.in.sin_addr.s_addr;
 }
 
 /**************** message_setAddr ****************/
@@ -188,31 +631,102 @@ message_setAddr(const char *hostname, const char *portString, addr_t *addr)
   }
 
   // Initialize fields of the address
-  addr->sin_family = AF_INET;
-  bcopy(hostp->h_addr_list[0], &addr->sin_addr, hostp->h_length);
-  addr->sin_port = htons(port);
+  *addr = message_noAddr();
+  addr->in.sin_family = AF_INET;
+  bcopy(hostp->h_addr_list[0], &addr->in.sin_addr, hostp->h_length);
+  addr->in.sin_port = htons(port);
+
+  return true;
+}
+
+/**************** message_setLocalAddr ****************/
+/*
+ * Convert the name of a Unix-domain socket into a correspondent address.
+ * Return true if success, false if any error.
+ * See message.h for detailed description.
+ */
+bool
+message_setLocalAddr(const char *name, addr_t *addr)
+{
+  if (name == NULL || addr == NULL) {
+    log_v("message_setLocalAddr: called with NULL argument");
+    return false;
+  }
+  // leave room for the zero that ends a pathname, or begins an abstract name
+  if (name[0] == '\0' || strlen(name) >= sizeof(addr->un.sun_path)) {
+    log_s("message_setLocalAddr: bad socket name '%s'", name);
+    return false;
+  }
 
+  *addr = message_noAddr();
+  addr->un.sun_family = AF_UNIX;
+  if (name[0] == '@') {
+    // the abstract namespace: a zero, then the name
+    strcpy(addr->un.sun_path + 1, name + 1);
+  } else {
+    strcpy(addr->un.sun_path, name);
+  }
   return true;
 }
 
-/**************** stringAddr ****************/
+/**************** message_stringAddr ****************/
 /*
  * Produce a string representation of the address.
- * Returns pointer to static storage and thus should not be retained.
+ * Returns pointer to storage static to the calling thread (receiver
+ * threads log too) and thus should not be retained.
+ * See message.h for detailed description.
  */
-static const char *
-stringAddr(const addr_t addr)
+const char *
+message_stringAddr(const addr_t addr)
 {
-  // Maximum string length to hold an IP address and port, plus null.
-  // e.g., 255.255.255.255:65507
-  static char addrString[22]; // constant appears in snprintf below
+  // Maximum string length to hold an IP address and port, plus null,
+  // e.g., 255.255.255.255:65507; or a socket's name, plus null.
+  static _Thread_local char addrString[sizeof(addr.un.sun_path) + 1];
+  char host[INET_ADDRSTRLEN];
 
-  snprintf(addrString, 22, "%s:%05d",
-	   inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
+  if (addr.sa.sa_family == AF_UNIX) {
+    // an abstract name is shown as message_setLocalAddr takes it, with '@'
+    const char *name = addr.un.sun_path;
+    bool abstract = (name[0] == '\0');
+    snprintf(addrString, sizeof(addrString), "%s%.*s", abstract ? "@" : "",
+             (int) sizeof(addr.un.sun_path) - 1, name + abstract);
+  } else {
+    inet_ntop(AF_INET, &addr.in.sin_addr, host, sizeof(host));
+    snprintf(addrString, sizeof(addrString), "%s:%05d", host, ntohs(addr.in.sin_port));
+  }
 
   return addrString;
 }
 
+/**************** addrLen ****************/
+/*
+ * The length of an address, for sendmsg: a whole sockaddr_in; or a
+ * Unix-domain socket's name, which ends at its (next) zero.
+ */
+static socklen_t
+addrLen(const addr_t *addr)
+{
+  if (addr->sa.sa_family != AF_UNIX) {
+    return sizeof(addr->in);
+  }
+  const char *name = addr->un.sun_path;
+  const size_t max = sizeof(addr->un.sun_path);
+  size_t len = (name[0] == '\0') ? 1 + strnlen(name + 1, max - 1)
+                                  : strnlen(name, max - 1) + 1;
+  return offsetof(struct sockaddr_un, sun_path) + len;
+}
+
+/**************** socketFor ****************/
+/*
+ * The socket from which to send to an address: our UDP socket, or for
+ * a Unix-domain address, our Unix-domain socket; 0 if we have none.
+ */
+static int
+socketFor(const addr_t *addr)
+{
+  return (addr->sa.sa_family == AF_UNIX) ? ourLocal : ourSocket;
+}
+
 /**************** numLines ****************/
 /*
  * Return number of lines needed to print the string:
@@ -259,160 +773,2442 @@ message_send(const addr_t to, const char *message)
     log_v("message_send: called with null message");
     return; // error in usage of this function.
   }
-  if (sendto(ourSocket, message, strlen(message), 0,
-             (struct sockaddr *) &to, sizeof(to)) < 0) {
+  char header[HeaderBytes];
+  int hlen = frame_header(to, header);
+  struct iovec iov = { .iov_base = (char *) message, .iov_len = strlen(message) };
+  if (hlen + iov.iov_len >= message_MaxBytes) {
+    send_fragments(to, header, hlen, &iov, 1, false);
+    return;
+  }
+  if (outbox.holding) {
+    hold(to, header, hlen, &iov, 1, true, false, 0);
+    return;
+  }
+  if (send_now(to, header, hlen, &iov, 1, false, 0) < 0) {
     log_e("message_send: error sending to datagram socket");
-  } else {
-    log_s("message_send: TO %s", stringAddr(to));
+  } else if (logLevel >= message_LogTraffic) {
+    log_s("message_send: TO %s", message_stringAddr(to));
     log_d("message_send: %d lines:", numLines(message));
-    log_s("%s", message);
+    if (logLevel >= message_LogAll) {
+      log_s("%s", message);
+    }
   }
 }
 
-/**************** message_loop ****************/
+/**************** message_sendBytes ****************/
 /*
- * Loop forever, calling handler functions for stdin or socket,
- * as input is available from either.
- * Returns false on error or true if any of the handlers return true.
+ * Send a message of 'len' bytes to the correspondent address.
  * See message.h for detailed description.
  */
-bool
-message_loop(void *arg, const float timeout,
-             bool (*handleTimeout)(void *arg),
-             bool (*handleInput)  (void *arg),
-             bool (*handleMessage)(void *arg,
-                                   const addr_t from, const char *buf))
+void
+message_sendBytes(const addr_t to, const char *message, const int len)
 {
-  // check if we're ready for messaging
   if (ourSocket == 0) {
-    log_v("message_loop called before message_init");
-    return false; // error in usage of this function.
+    log_v("message_sendBytes: called before message_init");
+    return; // error in usage of this function.
   }
-
-  // check parameters
-  if (handleTimeout == NULL && handleInput == NULL && handleMessage == NULL) {
-    log_v("message_loop called with all handlers null");
-    return false; // error in usage of this function.
+  if (message == NULL || len < 0 || len > message_MaxLength) {
+    log_v("message_sendBytes: called with null or oversized message");
+    return; // error in usage of this function.
   }
-  if (handleTimeout == NULL && timeout > 0.0) {
-    log_v("message_loop called with null handleTimeout but timeout > 0");
-    return false; // error in usage of this function.
+  char header[HeaderBytes];
+  int hlen = frame_header(to, header);
+  struct iovec iov = { .iov_base = (char *) message, .iov_len = len };
+  if (hlen + len >= message_MaxBytes) {
+    send_fragments(to, header, hlen, &iov, 1, false);
+    return;
   }
-  if (handleTimeout != NULL && timeout <= 0.0) {
-    log_v("message_loop called with Timeout handler but timeout <= 0");
-    return false; // error in usage of this function.
+  if (outbox.holding) {
+    hold(to, header, hlen, &iov, 1, true, false, 0);
+    return;
   }
-
-  // set up for timeouts, if desired
-  struct timeval *timerp = NULL; // stays null if no timeout desired
-  struct timeval timer;          // timerp = &timer if timeout desired
-  struct timeval timeoutval;     // timeval equivalent of parameter 'timeout'
-  if (timeout > 0.0) {
-    timeoutval.tv_sec  = (int)timeout;
-    timeoutval.tv_usec = timeout - (int)timeout;
+  if (send_now(to, header, hlen, &iov, 1, false, 0) < 0) {
+    log_e("message_sendBytes: error sending to datagram socket");
+  } else if (logLevel >= message_LogTraffic) {
+    log_s("message_sendBytes: TO %s", message_stringAddr(to));
+    log_d("message_sendBytes: %d bytes", len);
   }
+}
 
-  // loop until error or some handler indicates time to quit looping
-  while (true) {
-    // for use with select()
-    fd_set rfds;        // set of file descriptors we want to read
+/**************** message_sendv ****************/
+/*
+ * Send a message gathered from iovcnt buffers to the correspondent address.
+ * See message.h for detailed description.
+ */
+void
+message_sendv(const addr_t to, const struct iovec *iov, const int iovcnt)
+{
+  sendv(to, iov, iovcnt, false);
+}
 
-    // Watch stdin (fd 0) and the socket to see when either has input.
-    int nfds = 0;             // number of file descriptors to monitor
-    FD_ZERO(&rfds);           // default to none
-    if (handleInput != NULL) {
-      FD_SET(0, &rfds);       // monitor stdin
-      nfds = 1;
-    }
-    if (handleMessage != NULL && ourSocket != 0) {
-      FD_SET(ourSocket, &rfds); // monitor the socket
-      nfds = ourSocket+1;       // highest-numbered fd in rfds
-    }
-    if (timeout > 0.0) {      // is timeout desired?
-      timer = timeoutval;     // set the timer to the timeout value
-      timerp = &timer;        // pass that timer to select
-    } else {
-      timerp = NULL;          // no timeout is desired
-    }
+/**************** message_sendFrame ****************/
+/*
+ * Send a message that supersedes the last one sent to the same peer
+ * with message_sendFrame.  See message.h for detailed description.
+ */
+void
+message_sendFrame(const addr_t to, const struct iovec *iov, const int iovcnt)
+{
+  sendv(to, iov, iovcnt, true);
+}
 
-    // Wait for input on either source
-    int select_response = select(nfds, &rfds, NULL, NULL, timerp);
-    // note: 'rfds' updated
+/**************** sendv ****************/
+/*
+ * Send a message gathered from iovcnt buffers; if 'latest', it
+ * supersedes the last one sent with message_sendFrame.
+ */
+static void
+sendv(const addr_t to, const struct iovec *iov, const int iovcnt, const bool latest)
+{
+  if (ourSocket == 0) {
+    log_v(latest ? "message_sendFrame: called before message_init"
+          : "message_sendv: called before message_init");
+    return; // error in usage of this function.
+  }
+  if (iov == NULL || iovcnt <= 0) {
+    log_v(latest ? "message_sendFrame: called with no buffers"
+          : "message_sendv: called with no buffers");
+    return; // error in usage of this function.
+  }
+  char header[HeaderBytes];
+  int hlen = frame_header(to, header);
+  int len = hlen;
+  for (int i = 0; i < iovcnt; i++) {
+    len += iov[i].iov_len;
+  }
+  if (len >= message_MaxBytes) {
+    send_fragments(to, header, hlen, iov, iovcnt, latest);
+    return;
+  }
+  if (outbox.holding) {
+    hold(to, header, hlen, iov, iovcnt, false, latest, 0);
+    return;
+  }
+  ssize_t nbytes = send_now(to, header, hlen, iov, iovcnt, latest, 0);
+  if (nbytes < 0) {
+    log_e(latest ? "message_sendFrame: error sending to datagram socket"
+          : "message_sendv: error sending to datagram socket");
+  } else if (logLevel >= message_LogTraffic) {
+    log_s(latest ? "message_sendFrame: TO %s" : "message_sendv: TO %s",
+          message_stringAddr(to));
+    log_d(latest ? "message_sendFrame: %d bytes" : "message_sendv: %d bytes",
+          (int) nbytes);
+  }
+}
 
-    if (select_response < 0) {
-      if (errno == EINTR) {
-	// select() was interrupted by a signal - most likely SIGWINCH;
-	// just ignore this and loop around to select() again.
-	log_e("message_loop: select() EINTR: interrupted by signal");
-      } else {
-	// some error occurred; this should not happen
-	log_e("message_loop: select()");
-	return false; // error
-      }
-    } else if (select_response == 0) {
-      // timeout occurred
-      log_v("message_loop: select() timed out");
-      if (handleTimeout != NULL && (*handleTimeout)(arg)) {
-        break; // handler says to exit loop
-      }
-    } else if (select_response > 0) {
-      // some data is ready on either source, or both
+/**************** message_hold ****************/
+/*
+ * Hold messages sent from now on, until message_flush.
+ * See message.h for detailed description.
+ */
+void
+message_hold(void)
+{
+  outbox.holding = true;
+}
 
-      if (FD_ISSET(0, &rfds)) {
-        // stdin has input ready
-        log_v("message_loop: input ready on stdin");
-        if (handleInput != NULL && (*handleInput)(arg)) {
-          break; // handler says to exit loop
-        }
-      }
-      if (FD_ISSET(ourSocket, &rfds)) {
-        // socket has input ready
-        log_v("message_loop: message ready on socket");
-        struct sockaddr_in sender;     // sender of this message
-        struct sockaddr *senderp = (struct sockaddr *) &sender;
-        socklen_t senderlen = sizeof(sender);  // must pass address to length
-        char buf[message_MaxBytes]; // buffer for reading data from socket
-        int nbytes = recvfrom(ourSocket, buf, message_MaxBytes-1,
-                              0, senderp, &senderlen);
-        if (nbytes < 0) {
-          // error, ignore it
-          log_e("message_loop: receiving from socket");
-        } else {
-          buf[nbytes] = '\0';     // null terminate message string
-          // where was it from?
-          if (sender.sin_family != AF_INET) {
-            // ignore it
-            log_d("message_loop: non-Internet family %d\n", sender.sin_family);
-          } else {
-	    // record it
-	    log_s("message_loop: FROM %s", stringAddr(sender));
-	    log_d("message_loop: %d lines:", numLines(buf));
-	    log_s("%s", buf);
-
-            // handle it
-            if (handleMessage != NULL && (*handleMessage)(arg, sender, buf)) {
-              break; // handler says to exit loop
-            }
-          }
-        }
-      }
+/**************** message_flush ****************/
+/*
+ * Send all the messages held, and stop holding them.
+ * See message.h for detailed description.
+ */
+void
+message_flush(void)
+{
+  send_held();
+  outbox.holding = false;
+}
+
+/**************** hold ****************/
+/*
+ * Add a message to the outbox, to be sent by send_held, after the hlen
+ * bytes of its header, if any.  If 'copy', or if the message has too many
+ * buffers to refer to, we copy it into the outbox; otherwise we refer to
+ * the caller's buffers, and keep a copy of just the header.
+ * If the outbox is full, we send what it holds first.
+ */
+static void
+hold(const addr_t to, const char *header, const int hlen,
+     const struct iovec *iov, const int iovcnt, bool copy, const bool latest,
+     const unsigned part)
+{
+  if (outbox.count == message_QueueSize) {
+    send_held();
+  }
+  int i = outbox.count++;
+  outbox.to[i] = to;
+  outbox.latest[i] = latest;
+  outbox.part[i] = part;
+  int first = (hlen > 0) ? 1 : 0;   // buffers before the caller's
+  if (first + iovcnt > MaxHeldIov) {
+    copy = true;
+  }
+  if (!copy) {
+    memcpy(outbox.header[i], header, hlen);
+    outbox.iov[i][0].iov_base = outbox.header[i];
+    outbox.iov[i][0].iov_len = hlen;
+    memcpy(outbox.iov[i] + first, iov, iovcnt * sizeof(struct iovec));
+    outbox.iovcnt[i] = first + iovcnt;
+    outbox.copy[i] = -1;
+    return;
+  }
+
+  // copy the header and buffers, one after another, to the end of 'copies'
+  int len = hlen;
+  for (int j = 0; j < iovcnt; j++) {
+    len += iov[j].iov_len;
+  }
+  if (outbox.used + len > outbox.size) {
+    int size = 2 * outbox.size > outbox.used + len ? 2 * outbox.size : outbox.used + len;
+    char *copies = realloc(outbox.copies, size);
+    if (copies == NULL) {
+      log_v("message_send: out of memory for held messages");
+      exit(99);
     }
+    outbox.copies = copies;
+    outbox.size = size;
   }
-  return true;
+  outbox.copy[i] = outbox.used;
+  memcpy(outbox.copies + outbox.used, header, hlen);
+  outbox.used += hlen;
+  for (int j = 0; j < iovcnt; j++) {
+    memcpy(outbox.copies + outbox.used, iov[j].iov_base, iov[j].iov_len);
+    outbox.used += iov[j].iov_len;
+  }
+  // 'copies' may yet move; send_held points at the copy
+  outbox.iov[i][0].iov_base = NULL;
+  outbox.iov[i][0].iov_len = len;
+  outbox.iovcnt[i] = 1;
 }
 
-/**************** message_done ****************/
+/**************** send_held ****************/
 /*
- * Clean up the message module, prior to exit.
- * See message.h for detailed description.
+ * Send every message in the outbox, in order, with as few system calls
+ * as we can: one sendmmsg, where available.  Then empty the outbox.
+ * Those to a peer with a backlog join the backlog, after we try to
+ * send what it holds.
  */
-void
-message_done(void)
+static void
+send_held(void)
 {
+  int count = outbox.count;
+  if (count == 0 || ourSocket == 0) {
+    outbox.count = 0;
+    outbox.used = 0;
+    return;
+  }
+  for (int i = 0; i < count; i++) {
+    if (outbox.copy[i] >= 0) {
+      outbox.iov[i][0].iov_base = outbox.copies + outbox.copy[i];
+    }
+  }
+  if (nbacklogs > 0) {
+    drain_all(NULL);
+  }
+
+  // those to peers still behind wait behind what they have not taken;
+  // those to peers we share memory with go in their rings; then those to
+  // Internet addresses from our UDP socket, and the rest from our
+  // Unix-domain socket; each recipient's stay in order
+  int inet[message_QueueSize], local[message_QueueSize];
+  int ninet = 0, nlocal = 0;
+  for (int i = 0; i < count; i++) {
+    if (find_backlog(&outbox.to[i]) != NULL) {
+      wait_in_backlog(&outbox.to[i], outbox.iov[i], outbox.iovcnt[i],
+                      outbox.latest[i], outbox.part[i]);
+      continue;
+    }
+#ifdef __linux__
+    channel_t *channel = find_channel(&outbox.to[i]);
+    if (channel != NULL) {
+      channel_held(channel, i);
+      continue;
+    }
+#endif
+    if (outbox.to[i].sa.sa_family == AF_UNIX) {
+      local[nlocal++] = i;
+    } else {
+      inet[ninet++] = i;
+    }
+  }
+#ifdef __linux__
+  // one wakeup for each peer, however many messages it was sent
+  for (int c = 0; c < message_MaxChannels; c++) {
+    if (channels[c].set) {
+      shm_wake(channels[c].shm);
+    }
+  }
+#endif
+  send_some(ourSocket, inet, ninet);
+  send_some(ourLocal, local, nlocal);
+  outbox.count = 0;
+  outbox.used = 0;
+}
+
+/**************** send_some ****************/
+/*
+ * Send the n messages of the outbox listed in 'which', in order, from
+ * one socket: with io_uring, if it is our UDP socket and we use it;
+ * else with sendmmsg, where available.  We never wait for room in the
+ * socket: a message for which there is none waits in its recipient's
+ * backlog, and so does every later one to that recipient.
+ */
+static void
+send_some(const int sock, const int which[], const int n)
+{
+  if (n == 0) {
+    return;
+  }
+  if (sock == 0) {
+    log_v("message_flush: no socket for Unix-domain addresses; see message_openLocal");
+    return;
+  }
+
+#ifdef __linux__
+  if (ourUring != NULL && sock == ourSocket) {
+    // submit them all, and wait for them all, with one io_uring_enter
+    struct msghdr msgs[message_QueueSize];
+    int result[message_QueueSize];
+    memset(msgs, 0, n * sizeof(struct msghdr));
+    for (int j = 0; j < n; j++) {
+      int i = which[j];
+      msgs[j].msg_name = &outbox.to[i];
+      msgs[j].msg_namelen = addrLen(&outbox.to[i]);
+      msgs[j].msg_iov = outbox.iov[i];
+      msgs[j].msg_iovlen = outbox.iovcnt[i];
+    }
+    uring_send(ourUring, n, msgs, result);
+    // they all went at once, so a later message to a peer may have left
+    // before an earlier one that must wait; UDP may reorder them anyway
+    for (int j = 0; j < n; j++) {
+      int i = which[j];
+      if (result[j] < 0 && blocked(-result[j])) {
+        wait_in_backlog(&outbox.to[i], outbox.iov[i], outbox.iovcnt[i],
+                        outbox.latest[i], outbox.part[i]);
+      } else if (result[j] < 0) {
+        errno = -result[j];
+        log_e("message_flush: error sending to datagram socket");
+      } else if (logLevel >= message_LogTraffic) {
+        log_s("message_flush: TO %s", message_stringAddr(outbox.to[i]));
+        log_d("message_flush: %d bytes", result[j]);
+      }
+    }
+    return;
+  }
+  struct mmsghdr msgs[message_QueueSize];
+  int order[message_QueueSize];     // which, less those that must wait
+  int left = n;                     // number of those
+  memset(msgs, 0, n * sizeof(struct mmsghdr));
+  for (int j = 0; j < n; j++) {
+    int i = order[j] = which[j];
+    msgs[j].msg_hdr.msg_name = &outbox.to[i];
+    msgs[j].msg_hdr.msg_namelen = addrLen(&outbox.to[i]);
+    msgs[j].msg_hdr.msg_iov = outbox.iov[i];
+    msgs[j].msg_hdr.msg_iovlen = outbox.iovcnt[i];
+  }
+  // sendmmsg stops early at an error; if for want of room, the message
+  // that failed waits, and so does every later one to the same peer,
+  // and we go on with the rest; otherwise we skip just that message
+  int sent = 0;
+  while (sent < left) {
+    int m = sendmmsg(sock, msgs + sent, left - sent, MSG_DONTWAIT);
+    if (m > 0) {
+      for (int j = sent; j < sent + m && logLevel >= message_LogTraffic; j++) {
+        log_s("message_flush: TO %s", message_stringAddr(outbox.to[order[j]]));
+        log_d("message_flush: %d bytes", (int) msgs[j].msg_len);
+      }
+      sent += m;
+    } else if (!blocked(errno)) {
+      log_e("message_flush: error sending to datagram socket");
+      sent++;
+    } else {
+      int rest = sent;
+      for (int j = sent; j < left; j++) {
+        int i = order[j];
+        if (j == sent || find_backlog(&outbox.to[i]) != NULL) {
+          wait_in_backlog(&outbox.to[i], outbox.iov[i], outbox.iovcnt[i],
+                          outbox.latest[i], outbox.part[i]);
+        } else {
+          msgs[rest] = msgs[j];
+          order[rest++] = i;
+        }
+      }
+      left = rest;
+    }
+  }
+#else
+  for (int j = 0; j < n; j++) {
+    int i = which[j];
+    if (find_backlog(&outbox.to[i]) != NULL) {
+      wait_in_backlog(&outbox.to[i], outbox.iov[i], outbox.iovcnt[i],
+                      outbox.latest[i], outbox.part[i]);
+      continue;
+    }
+    struct msghdr msg = {
+      .msg_name = &outbox.to[i],
+      .msg_namelen = addrLen(&outbox.to[i]),
+      .msg_iov = outbox.iov[i],
+      .msg_iovlen = outbox.iovcnt[i],
+    };
+    ssize_t nbytes = sendmsg(sock, &msg, MSG_DONTWAIT);
+    if (nbytes < 0 && blocked(errno)) {
+      wait_in_backlog(&outbox.to[i], outbox.iov[i], outbox.iovcnt[i],
+                      outbox.latest[i], outbox.part[i]);
+    } else if (nbytes < 0) {
+      log_e("message_flush: error sending to datagram socket");
+    } else if (logLevel >= message_LogTraffic) {
+      log_s("message_flush: TO %s", message_stringAddr(outbox.to[i]));
+      log_d("message_flush: %d bytes", (int) nbytes);
+    }
+  }
+#endif
+}
+
+/**************** send_now ****************/
+/*
+ * Send a message at once, after the hlen bytes of its header, if any;
+ * or, if the peer has a backlog, or no room for it now, add it to the
+ * peer's backlog, superseding any frame there if 'latest'; 'part' is the
+ * id of the message it is a fragment of, or 0.
+ * Return the length of the message, if sent or waiting; -1 on error.
+ */
+static ssize_t
+send_now(const addr_t to, const char *header, const int hlen,
+         const struct iovec *iov, const int iovcnt, const bool latest,
+         const unsigned part)
+{
+  struct iovec all[iovcnt + 1];
+  int first = (hlen > 0) ? 1 : 0;   // buffers before the caller's
+  all[0].iov_base = (char *) header;
+  all[0].iov_len = hlen;
+  memcpy(all + first, iov, iovcnt * sizeof(struct iovec));
+
+  // never ahead of those already waiting for the peer
+  backlog_t *backlog = find_backlog(&to);
+  ssize_t nbytes = -1;
+  if (backlog == NULL || drain(backlog)) {
+    nbytes = send_one(&to, all, first + iovcnt);
+    if (nbytes >= 0 || !blocked(errno)) {
+      return nbytes;
+    }
+  }
+  wait_in_backlog(&to, all, first + iovcnt, latest, part);
+  nbytes = 0;
+  for (int i = 0; i < first + iovcnt; i++) {
+    nbytes += all[i].iov_len;
+  }
+  return nbytes;
+}
+
+/**************** send_one ****************/
+/*
+ * Send a message at once, from the socket for its address (see
+ * send_some), or through the memory we share with it, without waiting
+ * for room in either.
+ * Return what sendmsg returns; -1, with errno EAGAIN, if there is no
+ * room now in the shared memory, EMSGSIZE, if the message is too long
+ * for it, or EDESTADDRREQ, if no such socket.
+ */
+static ssize_t
+send_one(const addr_t *to, const struct iovec *iov, const int iovcnt)
+{
+#ifdef __linux__
+  channel_t *channel = find_channel(to);
+  if (channel != NULL) {
+    ssize_t len = 0;
+    for (int i = 0; i < iovcnt; i++) {
+      len += iov[i].iov_len;
+    }
+    if (len >= message_MaxBytes) {
+      errno = EMSGSIZE;     // not for want of room; it would never fit
+      return -1;
+    }
+    if (!shm_send(channel->shm, iov, iovcnt)) {
+      errno = EAGAIN;
+      return -1;
+    }
+    shm_wake(channel->shm);
+    return len;
+  }
+#endif
+  struct msghdr msg = {
+    .msg_name = (void *) to,
+    .msg_namelen = addrLen(to),
+    .msg_iov = (struct iovec *) iov,
+    .msg_iovlen = iovcnt,
+  };
+  int sock = socketFor(to);
+  if (sock == 0) {
+    errno = EDESTADDRREQ;   // no Unix-domain socket; see message_openLocal
+    return -1;
+  }
+  return sendmsg(sock, &msg, MSG_DONTWAIT);
+}
+
+/**************** find_backlog ****************/
+/* The backlog of messages waiting for a peer; NULL if none.
+ */
+static backlog_t *
+find_backlog(const addr_t *to)
+{
+  for (int b = 0; b < message_MaxBacklogs && nbacklogs > 0; b++) {
+    if (backlogs[b].set && message_eqAddr(backlogs[b].to, *to)) {
+      return &backlogs[b];
+    }
+  }
+  return NULL;
+}
+
+/**************** wait_in_backlog ****************/
+/* Add a copy of a message, gathered from iovcnt buffers, to the end of
+ * its peer's backlog, making the backlog if need be.  A fragment of the
+ * same message as the last one waiting ('part', if not 0) joins it.
+ * Otherwise, if 'latest', it supersedes any frame already there; and if
+ * the backlog then holds message_Backlog messages, the oldest is dropped.
+ * While any backlog is left, a timer drains them all.
+ */
+static void
+wait_in_backlog(const addr_t *to, const struct iovec *iov, const int iovcnt,
+                const bool latest, const unsigned part)
+{
+  backlog_t *backlog = find_backlog(to);
+  if (backlog == NULL) {
+    int b = 0;
+    while (b < message_MaxBacklogs && backlogs[b].set) {
+      b++;
+    }
+    if (b == message_MaxBacklogs) {
+      log_s("message_send: too many slow peers; dropping a message to %s",
+            message_stringAddr(*to));
+      return;
+    }
+    backlog = &backlogs[b];
+    backlog->set = true;
+    backlog->to = *to;
+    backlog->count = 0;
+    nbacklogs++;
+  }
+
+  // make room for a new message: drop the frame this one supersedes (there
+  // is at most one, in one or more fragments), or else the oldest
+  bool joins = part != 0 && backlog->count > 0
+    && backlog->part[backlog->count - 1] == part;
+  if (!joins && latest) {
+    for (int m = 0; m < backlog->count; m++) {
+      if (backlog->latest[m]) {
+        drop_message(backlog, m);
+        break;
+      }
+    }
+  }
+  if (backlog->count == BacklogDatagrams
+      || (!joins && backlog_messages(backlog) == message_Backlog)) {
+    log_s("message_send: %s is too slow; dropping its oldest message",
+          message_stringAddr(*to));
+    drop_message(backlog, 0);
+  }
+
+  int len = 0;
+  for (int i = 0; i < iovcnt; i++) {
+    len += iov[i].iov_len;
+  }
+  char *copy = malloc(len + 1);
+  if (copy == NULL) {
+    log_v("message_send: out of memory for waiting messages");
+    exit(99);
+  }
+  int m = backlog->count++;
+  backlog->message[m] = copy;
+  backlog->length[m] = len;
+  backlog->latest[m] = latest;
+  backlog->part[m] = part;
+  for (int i = 0; i < iovcnt; i++) {
+    memcpy(copy, iov[i].iov_base, iov[i].iov_len);
+    copy += iov[i].iov_len;
+  }
+#ifdef __linux__
+  if (backlogTimer == 0) {
+    backlogTimer = message_addTimer(BacklogInterval, true, drain_all);
+  }
+#endif
+}
+
+/**************** backlog_messages ****************/
+/* The number of messages waiting in a backlog, counting the fragments
+ * of one message as one.
+ */
+static int
+backlog_messages(const backlog_t *backlog)
+{
+  int messages = 0;
+  for (int m = 0; m < backlog->count; m++) {
+    if (m == 0 || backlog->part[m] == 0 || backlog->part[m] != backlog->part[m - 1]) {
+      messages++;
+    }
+  }
+  return messages;
+}
+
+/**************** drop_message ****************/
+/* Drop the message that begins at datagram m of a backlog: that datagram,
+ * and, if a fragment, the rest of the message's fragments after it.
+ */
+static void
+drop_message(backlog_t *backlog, const int m)
+{
+  int end = m + 1;
+  while (backlog->part[m] != 0 && end < backlog->count
+         && backlog->part[end] == backlog->part[m]) {
+    end++;
+  }
+  for (int k = m; k < end; k++) {
+    free(backlog->message[k]);
+  }
+  int after = backlog->count - end;
+  memmove(backlog->message + m, backlog->message + end, after * sizeof(char *));
+  memmove(backlog->length + m, backlog->length + end, after * sizeof(int));
+  memmove(backlog->latest + m, backlog->latest + end, after * sizeof(bool));
+  memmove(backlog->part + m, backlog->part + end, after * sizeof(unsigned));
+  backlog->count = m + after;
+}
+
+/**************** drain ****************/
+/* Send the messages of a backlog, oldest first, until the peer has no
+ * room for the next.  Return true if none are left, and the backlog is
+ * gone; else false.
+ */
+static bool
+drain(backlog_t *backlog)
+{
+  int sent = 0;
+  while (sent < backlog->count) {
+    struct iovec iov = { .iov_base = backlog->message[sent],
+                         .iov_len = backlog->length[sent] };
+    if (send_one(&backlog->to, &iov, 1) >= 0) {
+      if (logLevel >= message_LogTraffic) {
+        log_s("message_send: TO %s, after waiting", message_stringAddr(backlog->to));
+        log_d("message_send: %d bytes", backlog->length[sent]);
+      }
+    } else if (blocked(errno)) {
+      break;
+    } else {
+      log_e("message_send: error sending to datagram socket");
+    }
+    free(backlog->message[sent]);
+    sent++;
+  }
+  int rest = backlog->count -= sent;
+  memmove(backlog->message, backlog->message + sent, rest * sizeof(char *));
+  memmove(backlog->length, backlog->length + sent, rest * sizeof(int));
+  memmove(backlog->latest, backlog->latest + sent, rest * sizeof(bool));
+  memmove(backlog->part, backlog->part + sent, rest * sizeof(unsigned));
+  if (rest > 0) {
+    return false;
+  }
+  backlog->set = false;
+  nbacklogs--;
+  return true;
+}
+
+/**************** drain_all ****************/
+/* The backlog timer fired (or message_flush is about to send): send what
+ * we can of every backlog; once none are left, stop the timer.
+ * Returns false, so the loop goes on.
+ */
+static bool
+drain_all(void *arg)
+{
+  for (int b = 0; b < message_MaxBacklogs; b++) {
+    if (backlogs[b].set) {
+      drain(&backlogs[b]);
+    }
+  }
+  if (nbacklogs == 0 && backlogTimer != 0) {
+    message_cancelTimer(backlogTimer);
+    backlogTimer = 0;
+  }
+  return false;
+}
+
+/**************** blocked ****************/
+/* Does a send that failed with this errno just lack room for now?
+ */
+static bool
+blocked(const int err)
+{
+  return err == EAGAIN || err == EWOULDBLOCK || err == ENOBUFS;
+}
+
+/**************** message_sequence ****************/
+/*
+ * Number the messages sent to a peer, or stop.
+ * See message.h for detailed description.
+ */
+bool
+message_sequence(const addr_t peer, const bool on)
+{
+  peer_t *p = find_peer(peer);
+  if (!on) {
+    if (p != NULL) {
+      p->set = false;
+      npeers--;
+    }
+    return true;
+  }
+  if (p != NULL) {
+    return true;    // already sequenced
+  }
+  for (int i = 0; i < message_MaxPeers; i++) {
+    if (!peers[i].set) {
+      peers[i].set = true;
+      peers[i].addr = peer;
+      peers[i].frames = 0;
+      peers[i].controls = 0;
+      npeers++;
+      return true;
+    }
+  }
+  log_v("message_sequence: too many peers");
+  return false;
+}
+
+/**************** message_sendControl ****************/
+/*
+ * Send a message that must not be lost, retrying until acknowledged.
+ * See message.h for detailed description.
+ */
+void
+message_sendControl(const addr_t to, const char *message)
+{
+  peer_t *peer = find_peer(to);
+  if (peer == NULL || message == NULL) {
+    message_send(to, message);    // not sequenced; nothing to retry
+    return;
+  }
+  unsigned seq = ++peer->controls;
+
+  // remember it, to retry until its CTLACK arrives
+  pthread_mutex_lock(&controlLock);
+  int c = 0;
+  while (c < MaxControls && controls[c].set) {
+    c++;
+  }
+  if (c < MaxControls && (controls[c].message = strdup(message)) != NULL) {
+    controls[c].set = true;
+    controls[c].to = to;
+    controls[c].seq = seq;
+    controls[c].tries = 1;
+  } else {
+    log_v("message_sendControl: too many unacknowledged; sending once");
+  }
+  pthread_mutex_unlock(&controlLock);
+  if (c < MaxControls && retransmitTimer == 0) {
+    retransmitTimer = message_addTimer(RetransmitInterval, true, retransmit);
+  }
+
+  send_control(to, seq, message);
+}
+
+/**************** message_loop ****************/
+/*
+ * Loop forever, calling handler functions for stdin or socket,
+ * as input is available from either.
+ * Returns false on error or true if any of the handlers return true.
+ * See message.h for detailed description.
+ */
+bool
+message_loop(void *arg, const float timeout,
+             bool (*handleTimeout)(void *arg),
+             bool (*handleInput)  (void *arg),
+             bool (*handleMessage)(void *arg,
+                                   const addr_t from, const char *buf))
+{
+  return loop(arg, timeout, handleTimeout, handleInput, handleMessage, NULL);
+}
+
+/**************** message_loopBatch ****************/
+/*
+ * Like message_loop, but hand each batch of messages to one handler call.
+ * See message.h for detailed description.
+ */
+bool
+message_loopBatch(void *arg, const float timeout,
+                  bool (*handleTimeout)(void *arg),
+                  bool (*handleInput)  (void *arg),
+                  bool (*handleBatch)  (void *arg, const int n,
+                                        const addr_t from[], char *buf[]))
+{
+  return loop(arg, timeout, handleTimeout, handleInput, NULL, handleBatch);
+}
+
+/**************** loop ****************/
+/*
+ * The loop behind message_loop and message_loopBatch; exactly one of
+ * handleMessage and handleBatch may be non-NULL.
+ */
+static bool
+loop(void *arg, const float timeout,
+     bool (*handleTimeout)(void *arg),
+     bool (*handleInput)  (void *arg),
+     bool (*handleMessage)(void *arg, const addr_t from, const char *buf),
+     bool (*handleBatch)  (void *arg, const int n, const addr_t from[], char *buf[]))
+{
+  // check if we're ready for messaging
+  if (ourSocket == 0) {
+    log_v("message_loop called before message_init");
+    return false; // error in usage of this function.
+  }
+
+  // check parameters
+  bool handleSocket = (handleMessage != NULL || handleBatch != NULL);
+  if (handleTimeout == NULL && handleInput == NULL && !handleSocket
+      && !timers_set() && !watches_set()) {
+    log_v("message_loop called with all handlers null");
+    return false; // error in usage of this function.
+  }
+  if (handleTimeout == NULL && timeout > 0.0) {
+    log_v("message_loop called with null handleTimeout but timeout > 0");
+    return false; // error in usage of this function.
+  }
+  if (handleTimeout != NULL && timeout <= 0.0) {
+    log_v("message_loop called with Timeout handler but timeout <= 0");
+    return false; // error in usage of this function.
+  }
+
+  handlers_t h = {
+    .arg = arg,
+    .timeout = timeout,
+    .handleTimeout = handleTimeout,
+    .handleInput = handleInput,
+    .handleMessage = handleMessage,
+    .handleBatch = handleBatch,
+    .batch = NULL,
+  };
+  // buffers for one batch of messages, reused for every batch
+  if (handleSocket) {
+    h.batch = batch_new();
+  }
+#ifdef __linux__
+  bool ok = loop_epoll(&h);
+#else
+  bool ok = loop_select(&h);
+#endif
+  batch_delete(h.batch);
+  return ok;
+}
+
+#ifdef __linux__
+/**************** loop_epoll ****************/
+/*
+ * Wait with epoll on stdin, the socket, and the timers' timerfds, calling
+ * the handlers until one returns true (we return true) or on fatal error
+ * (we return false).  The idle timeout is the epoll_wait timeout.
+ */
+static bool
+loop_epoll(handlers_t *h)
+{
+  ourEpoll = epoll_create1(EPOLL_CLOEXEC);
+  if (ourEpoll < 0) {
+    log_e("message_loop: epoll_create1()");
+    ourEpoll = -1;
+    return false;
+  }
+  // each event carries the source it is from: stdin, socket, or a timer
+  struct epoll_event event = { .events = EPOLLIN };
+  if (h->handleInput != NULL) {
+    event.data.u32 = EventInput;
+    if (epoll_ctl(ourEpoll, EPOLL_CTL_ADD, 0, &event) < 0) {
+      log_e("message_loop: cannot watch stdin");
+    }
+  }
+  if (h->batch != NULL) {
+    // with io_uring, messages arrive without our asking; its eventfd
+    // tells us when
+    if (ourUring != NULL && !uring_arm(ourUring)) {
+      log_e("message_loop: cannot receive with io_uring; falling back");
+      uring_delete(ourUring);
+      ourUring = NULL;
+    }
+    event.data.u32 = EventSocket;
+    int fd = (ourUring != NULL) ? uring_eventfd(ourUring) : ourSocket;
+    epoll_ctl(ourEpoll, EPOLL_CTL_ADD, fd, &event);
+    if (ourLocal != 0) {
+      event.data.u32 = EventLocal;
+      epoll_ctl(ourEpoll, EPOLL_CTL_ADD, ourLocal, &event);
+    }
+    for (int c = 0; c < message_MaxChannels; c++) {
+      if (channels[c].set) {
+        event.data.u32 = EventChannel + c;
+        epoll_ctl(ourEpoll, EPOLL_CTL_ADD, shm_eventfd(channels[c].shm), &event);
+      }
+    }
+  }
+  for (int w = 0; w < message_MaxWatches; w++) {
+    if (watches[w].set) {
+      event.data.u32 = EventWatch + w;
+      epoll_ctl(ourEpoll, EPOLL_CTL_ADD, watches[w].fd, &event);
+    }
+  }
+  for (int t = 0; t < message_MaxTimers; t++) {
+    if (timers[t].set) {
+      event.data.u32 = EventTimer + t;
+      epoll_ctl(ourEpoll, EPOLL_CTL_ADD, timers[t].fd, &event);
+    }
+  }
+
+  // epoll_wait counts in milliseconds; round up, so we never wake early
+  int waitms = -1;
+  if (h->timeout > 0.0) {
+    waitms = (int) (h->timeout * 1000);
+    if (waitms < h->timeout * 1000) {
+      waitms++;
+    }
+  }
+
+  bool ok = true;
+  bool quit = false;
+  struct epoll_event events[EventChannel + message_MaxChannels];
+  while (!quit) {
+    int n = epoll_wait(ourEpoll, events, EventChannel + message_MaxChannels, waitms);
+    if (n < 0) {
+      if (errno == EINTR) {
+        // interrupted by a signal - most likely SIGWINCH; just wait again.
+        log_e("message_loop: epoll_wait() EINTR: interrupted by signal");
+        continue;
+      }
+      log_e("message_loop: epoll_wait()");
+      ok = false; // error
+      break;
+    }
+    if (n == 0) {
+      // timeout occurred
+      log_v("message_loop: epoll_wait() timed out");
+      quit = (*h->handleTimeout)(h->arg);
+      continue;
+    }
+    for (int i = 0; i < n && !quit; i++) {
+      uint32_t source = events[i].data.u32;
+      if (source == EventInput) {
+        log_v("message_loop: input ready on stdin");
+        quit = (*h->handleInput)(h->arg);
+      } else if (source == EventSocket || source == EventLocal) {
+        if (logLevel >= message_LogTraffic) {
+          log_v("message_loop: message ready on socket");
+        }
+        quit = socket_ready(h, source == EventSocket ? ourSocket : ourLocal);
+      } else if (source < EventTimer) {
+        int w = source - EventWatch;
+        if (watches[w].set) {
+          quit = (*watches[w].handleReady)(h->arg);
+        }
+      } else if (source < EventChannel) {
+        quit = timer_ready(source - EventTimer, h->arg);
+      } else {
+        quit = channel_ready(h, source - EventChannel);
+      }
+    }
+  }
+  close(ourEpoll);
+  ourEpoll = -1;
+  return ok;
+}
+
+/**************** timer_ready ****************/
+/*
+ * Timer t has expired: call its handler, and return what it returns.
+ * A one-shot timer is removed first, so its handler may set another.
+ */
+static bool
+timer_ready(const int t, void *arg)
+{
+  if (t < 0 || t >= message_MaxTimers || !timers[t].set) {
+    return false;  // cancelled by an earlier handler in this wakeup
+  }
+  uint64_t expirations;
+  if (read(timers[t].fd, &expirations, sizeof(expirations)) < 0) {
+    return false;  // not expired after all
+  }
+  bool (*handleTimer)(void *arg) = timers[t].handleTimer;
+  if (!timers[t].periodic) {
+    message_cancelTimer(t + 1);
+  }
+  if (logLevel >= message_LogTraffic) {
+    log_v("message_loop: timer expired");
+  }
+  return (*handleTimer)(arg);
+}
+
+#else
+/**************** loop_select ****************/
+/*
+ * Wait with select on stdin and the socket, calling the handlers until
+ * one returns true (we return true) or on fatal error (we return false).
+ */
+static bool
+loop_select(handlers_t *h)
+{
+  struct timeval *timerp = NULL; // stays null if no timeout desired
+  struct timeval timer;          // timerp = &timer if timeout desired
+  struct timeval timeoutval;     // timeval equivalent of parameter 'timeout'
+  if (h->timeout > 0.0) {
+    timeoutval.tv_sec  = (int)h->timeout;
+    timeoutval.tv_usec = (h->timeout - (int)h->timeout) * 1000000;
+  }
+
+  // loop until error or some handler indicates time to quit looping
+  while (true) {
+    // for use with select()
+    fd_set rfds;        // set of file descriptors we want to read
+
+    // Watch stdin (fd 0) and the socket to see when either has input.
+    int nfds = 0;             // number of file descriptors to monitor
+    FD_ZERO(&rfds);           // default to none
+    if (h->handleInput != NULL) {
+      FD_SET(0, &rfds);       // monitor stdin
+      nfds = 1;
+    }
+    if (h->batch != NULL && ourSocket != 0) {
+      FD_SET(ourSocket, &rfds); // monitor the socket
+      nfds = ourSocket+1;       // highest-numbered fd in rfds
+    }
+    if (h->batch != NULL && ourLocal != 0) {
+      FD_SET(ourLocal, &rfds);  // and the Unix-domain socket
+      if (ourLocal >= nfds) {
+        nfds = ourLocal + 1;
+      }
+    }
+    for (int w = 0; w < message_MaxWatches; w++) {
+      if (watches[w].set) {
+        FD_SET(watches[w].fd, &rfds); // monitor the other fds
+        if (watches[w].fd >= nfds) {
+          nfds = watches[w].fd + 1;
+        }
+      }
+    }
+    if (h->timeout > 0.0) {   // is timeout desired?
+      timer = timeoutval;     // set the timer to the timeout value
+      timerp = &timer;        // pass that timer to select
+    } else {
+      timerp = NULL;          // no timeout is desired
+    }
+
+    // Wait for input on either source
+    int select_response = select(nfds, &rfds, NULL, NULL, timerp);
+    // note: 'rfds' updated
+
+    if (select_response < 0) {
+      if (errno == EINTR) {
+	// select() was interrupted by a signal - most likely SIGWINCH;
+	// just ignore this and loop around to select() again.
+	log_e("message_loop: select() EINTR: interrupted by signal");
+      } else {
+	// some error occurred; this should not happen
+	log_e("message_loop: select()");
+	return false; // error
+      }
+    } else if (select_response == 0) {
+      // timeout occurred
+      log_v("message_loop: select() timed out");
+      if ((*h->handleTimeout)(h->arg)) {
+        return true; // handler says to exit loop
+      }
+    } else if (select_response > 0) {
+      // some data is ready on either source, or both
+
+      if (FD_ISSET(0, &rfds)) {
+        // stdin has input ready
+        log_v("message_loop: input ready on stdin");
+        if ((*h->handleInput)(h->arg)) {
+          return true; // handler says to exit loop
+        }
+      }
+      if (h->batch != NULL && FD_ISSET(ourSocket, &rfds)) {
+        // socket has input ready
+        if (logLevel >= message_LogTraffic) {
+          log_v("message_loop: message ready on socket");
+        }
+        if (socket_ready(h, ourSocket)) {
+          return true; // handler says to exit loop
+        }
+      }
+      if (h->batch != NULL && ourLocal != 0 && FD_ISSET(ourLocal, &rfds)) {
+        if (socket_ready(h, ourLocal)) {
+          return true; // handler says to exit loop
+        }
+      }
+      for (int w = 0; w < message_MaxWatches; w++) {
+        if (watches[w].set && FD_ISSET(watches[w].fd, &rfds)) {
+          if ((*watches[w].handleReady)(h->arg)) {
+            return true; // handler says to exit loop
+          }
+        }
+      }
+    }
+  }
+}
+#endif
+
+/**************** socket_ready ****************/
+/*
+ * A socket (our UDP socket or our Unix-domain socket) has input ready:
+ * take every message waiting, up to a batch, and hand them to the
+ * handler.  Return true if the handler says to quit.
+ */
+static bool
+socket_ready(handlers_t *h, const int sock)
+{
+#ifdef __linux__
+  if (ourUring != NULL && sock == ourSocket) {
+    // the messages are already in io_uring's buffers; handle them there,
+    // then give the buffers back
+    char *buf[message_BatchSize];
+    addr_t from[message_BatchSize];
+    struct timespec when[message_BatchSize];
+    int nbytes[message_BatchSize];
+    int nrecv = uring_receive(ourUring, buf, nbytes, from, when, message_BatchSize);
+    int n = batch_keep(nrecv, nbytes, from, buf, when);
+    bool quit = deliver(h, n, from, buf, when);
+    uring_recycle(ourUring);
+    return quit;
+  }
+#endif
+  int n = batch_receive(h->batch, sock);
+  return deliver(h, n, h->batch->from, h->batch->buf, h->batch->when);
+}
+
+/**************** deliver ****************/
+/*
+ * Hand n messages to handleBatch, or one by one to handleMessage; while
+ * they have them, message_arrival tells when each arrived.
+ * Return true if the handler says to quit.
+ */
+static bool
+deliver(handlers_t *h, const int n, addr_t from[], char *buf[],
+        struct timespec when[])
+{
+  bool quit = false;
+  delivered.n = n;
+  delivered.buf = buf;
+  delivered.when = when;
+  if (h->handleBatch != NULL) {
+    quit = n > 0 && (*h->handleBatch)(h->arg, n, from, buf);
+  }
+  for (int i = 0; i < n && h->handleBatch == NULL && !quit; i++) {
+    quit = (*h->handleMessage)(h->arg, from[i], buf[i]);
+  }
+  delivered.n = 0;
+  return quit;
+}
+
+/**************** message_addTimer ****************/
+/*
+ * Set a timer to call a handler after 'interval' seconds, once or
+ * periodically.  See message.h for detailed description.
+ */
+int
+message_addTimer(const float interval, const bool periodic,
+                 bool (*handleTimer)(void *arg))
+{
+#ifdef __linux__
+  if (interval <= 0.0 || handleTimer == NULL) {
+    log_v("message_addTimer: called with bad interval or null handler");
+    return 0; // error in usage of this function.
+  }
+  int t = 0;
+  while (t < message_MaxTimers && timers[t].set) {
+    t++;
+  }
+  if (t == message_MaxTimers) {
+    log_v("message_addTimer: too many timers");
+    return 0;
+  }
+  int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (fd < 0) {
+    log_e("message_addTimer: timerfd_create()");
+    return 0;
+  }
+  struct itimerspec spec;
+  spec.it_value.tv_sec = (time_t) interval;
+  spec.it_value.tv_nsec = (long) ((interval - (time_t) interval) * 1e9);
+  if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) {
+    spec.it_value.tv_nsec = 1;  // a zero it_value would disarm the timer
+  }
+  if (periodic) {
+    spec.it_interval = spec.it_value;
+  } else {
+    spec.it_interval.tv_sec = 0;
+    spec.it_interval.tv_nsec = 0;
+  }
+  if (timerfd_settime(fd, 0, &spec, NULL) < 0) {
+    log_e("message_addTimer: timerfd_settime()");
+    close(fd);
+    return 0;
+  }
+  timers[t].set = true;
+  timers[t].fd = fd;
+  timers[t].periodic = periodic;
+  timers[t].handleTimer = handleTimer;
+
+  // a timer set from within the loop's handlers is watched at once
+  if (ourEpoll >= 0) {
+    struct epoll_event event = { .events = EPOLLIN, .data.u32 = EventTimer + t };
+    epoll_ctl(ourEpoll, EPOLL_CTL_ADD, fd, &event);
+  }
+  return t + 1;
+#else
+  log_v("message_addTimer: timers are not supported on this platform");
+  return 0;
+#endif
+}
+
+/**************** message_cancelTimer ****************/
+/*
+ * Cancel a timer set by message_addTimer.
+ * See message.h for detailed description.
+ */
+void
+message_cancelTimer(const int timer)
+{
+#ifdef __linux__
+  int t = timer - 1;
+  if (t < 0 || t >= message_MaxTimers || !timers[t].set) {
+    log_v("message_cancelTimer: no such timer");
+    return; // error in usage of this function.
+  }
+  close(timers[t].fd);    // which also removes it from the epoll set
+  timers[t].set = false;
+  timers[t].handleTimer = NULL;
+#endif
+}
+
+/**************** message_watch ****************/
+/*
+ * Watch another file descriptor for input, from within the loop.
+ * See message.h for detailed description.
+ */
+bool
+message_watch(const int fd, bool (*handleReady)(void *arg))
+{
+  if (fd < 0 || handleReady == NULL) {
+    log_v("message_watch: called with bad fd or null handler");
+    return false; // error in usage of this function.
+  }
+  int w = 0;
+  while (w < message_MaxWatches && watches[w].set) {
+    w++;
+  }
+  if (w == message_MaxWatches) {
+    log_v("message_watch: too many file descriptors watched");
+    return false;
+  }
+  watches[w].set = true;
+  watches[w].fd = fd;
+  watches[w].handleReady = handleReady;
+#ifdef __linux__
+  // a watch set from within the loop's handlers is watched at once
+  if (ourEpoll >= 0) {
+    struct epoll_event event = { .events = EPOLLIN, .data.u32 = EventWatch + w };
+    epoll_ctl(ourEpoll, EPOLL_CTL_ADD, fd, &event);
+  }
+#endif
+  return true;
+}
+
+/**************** message_unwatch ****************/
+/*
+ * Stop watching a file descriptor.
+ * See message.h for detailed description.
+ */
+void
+message_unwatch(const int fd)
+{
+  for (int w = 0; w < message_MaxWatches; w++) {
+    if (watches[w].set && watches[w].fd == fd) {
+#ifdef __linux__
+      if (ourEpoll >= 0) {
+        epoll_ctl(ourEpoll, EPOLL_CTL_DEL, fd, NULL);
+      }
+#endif
+      watches[w].set = false;
+      return;
+    }
+  }
+  log_v("message_unwatch: not watching that file descriptor");
+}
+
+/**************** message_openReceiver ****************/
+/*
+ * Open another socket that receives messages sent to our port.
+ * See message.h for detailed description.
+ */
+int
+message_openReceiver(void)
+{
+#ifdef SO_REUSEPORT
+  if (ourSocket == 0) {
+    log_v("message_openReceiver: called before message_init");
+    return -1; // error in usage of this function.
+  }
+  if (!sharedPort) {
+    log_v("message_openReceiver: our port is not shared; see message_initBackend");
+    return -1; // error in usage of this function.
+  }
+  struct sockaddr_in self;  // our address, with our port
+  socklen_t selflen = sizeof(self);
+  if (getsockname(ourSocket, (struct sockaddr *) &self, &selflen)) {
+    log_e("message_openReceiver: getting socket name");
+    return -1;
+  }
+  int sock = socket(AF_INET, SOCK_DGRAM, 0);
+  if (sock < 0) {
+    log_e("message_openReceiver: error opening datagram socket");
+    return -1;
+  }
+  int one = 1;
+  if (setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one))
+      || bind(sock, (struct sockaddr *) &self, sizeof(self))) {
+    log_e("message_openReceiver: sharing our port");
+    close(sock);
+    return -1;
+  }
+  if (timestamps) {
+    stamp_socket(sock, true);
+  }
+  return sock;
+#else
+  log_v("message_openReceiver: SO_REUSEPORT is not supported on this platform");
+  return -1;
+#endif
+}
+
+/**************** message_openLocal ****************/
+/*
+ * Open a Unix-domain datagram socket, by the given name, for programs
+ * on this host; the loop receives from it, and we send from it.
+ * See message.h for detailed description.
+ */
+int
+message_openLocal(const char *name)
+{
+  if (ourSocket == 0) {
+    log_v("message_openLocal: called before message_init");
+    return -1; // error in usage of this function.
+  }
+  if (ourLocal != 0) {
+    log_v("message_openLocal: called again, when already open");
+    return -1; // error in usage of this function.
+  }
+
+  addr_t self = message_noAddr();   // our name
+  socklen_t selflen = sizeof(sa_family_t);
+  if (name == NULL) {
+#ifdef __linux__
+    // bind to the bare family, and the kernel picks an abstract name
+    self.un.sun_family = AF_UNIX;
+#else
+    log_v("message_openLocal: a name is needed on this platform");
+    return -1;
+#endif
+  } else if (message_setLocalAddr(name, &self)) {
+    selflen = addrLen(&self);
+  } else {
+    return -1;
+  }
+
+  int sock = socket(AF_UNIX, SOCK_DGRAM, 0);
+  if (sock < 0) {
+    log_e("message_openLocal: error opening datagram socket");
+    return -1;
+  }
+  if (bind(sock, &self.sa, selflen)) {
+    log_e("message_openLocal: binding socket name");
+    close(sock);
+    return -1;
+  }
+
+  // get our name, which the kernel may have picked
+  ourLocalName = message_noAddr();
+  selflen = sizeof(ourLocalName);
+  if (getsockname(sock, &ourLocalName.sa, &selflen)) {
+    log_e("message_openLocal: getting socket name");
+    close(sock);
+    return -1;
+  }
+  ourLocal = sock;
+  if (timestamps) {
+    stamp_socket(sock, true);
+  }
+  log_s("message_openLocal: ready at '%s'", message_stringAddr(ourLocalName));
+  return sock;
+}
+
+/**************** message_receive ****************/
+/*
+ * Wait for, and receive, one message on a receiver socket.
+ * See message.h for detailed description.
+ */
+int
+message_receive(const int sock, char *buf, addr_t *from)
+{
+  if (buf == NULL || from == NULL) {
+    log_v("message_receive: called with NULL argument");
+    return -1; // error in usage of this function.
+  }
+  int fd = (sock == 0) ? ourSocket : sock;
+  receivedBuf = NULL;
+  while (true) {
+    *from = message_noAddr();   // left so if the sender has no name
+    // room for the time the message arrived, and no more: the kernel
+    // closes any file descriptors sent along (see "SHM" below)
+    _Alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(struct timespec))];
+    struct iovec iov = { .iov_base = buf, .iov_len = message_MaxBytes-1 };
+    struct msghdr msg = {
+      .msg_name = &from->sa, .msg_namelen = sizeof(*from),
+      .msg_iov = &iov, .msg_iovlen = 1,
+      .msg_control = timestamps ? control : NULL,
+      .msg_controllen = timestamps ? sizeof(control) : 0,
+    };
+    ssize_t nbytes = recvmsg(fd, &msg, 0);
+    if (nbytes < 0) {
+      if (errno == EINTR) {
+        continue;   // interrupted by a signal; wait again
+      }
+      return -1;    // shut down, or some other error
+    }
+    if (nbytes == 0 && from->sa.sa_family == AF_UNSPEC) {
+      return -1;    // shut down, by message_stopReceiver
+    }
+    buf[nbytes] = '\0';     // null terminate message string
+    if (!message_isAddr(*from)) {
+      // ignore it; we could not reply
+      log_d("message_receive: no address to reply to, family %d\n", from->sa.sa_family);
+      continue;
+    }
+    // acknowledgements of control messages are ours
+    if (take_ack(*from, buf)) {
+      continue;
+    }
+    if (strncmp(buf, "FRAG ", 5) == 0) {
+      log_v("message_receive: dropping a fragment; only message_loop reassembles");
+      continue;
+    }
+    if (strcmp(buf, "SHM") == 0) {
+      // only message_loop shares memory; the kernel has closed the fds
+      sendto(fd, "SHMNO", 5, MSG_DONTWAIT, &from->sa, addrLen(from));
+      continue;
+    }
+    if (logLevel >= message_LogTraffic) {
+      log_s("message_receive: FROM %s", message_stringAddr(*from));
+    }
+    receivedWhen = arrival_of(&msg);
+    receivedBuf = buf;
+    return nbytes;
+  }
+}
+
+/**************** message_stopReceiver ****************/
+/*
+ * Wake any thread waiting in message_receive on a receiver socket.
+ * See message.h for detailed description.
+ */
+void
+message_stopReceiver(const int sock)
+{
+  int fd = (sock == 0) ? ourSocket : sock;
+  if (fd > 0) {
+    // for an unconnected socket this reports ENOTCONN, but still wakes
+    // any receiver, and every later receive returns at once
+    shutdown(fd, SHUT_RD);
+  }
+}
+
+/**************** message_closeReceiver ****************/
+/*
+ * Close a socket opened by message_openReceiver.
+ * See message.h for detailed description.
+ */
+void
+message_closeReceiver(const int sock)
+{
+  if (sock > 0 && sock != ourSocket && sock != ourLocal) {
+    close(sock);
+  }
+}
+
+/**************** watches_set ****************/
+/*
+ * Return true if any other file descriptor is watched.
+ */
+static bool
+watches_set(void)
+{
+  for (int w = 0; w < message_MaxWatches; w++) {
+    if (watches[w].set) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**************** timers_set ****************/
+/*
+ * Return true if any timer is set.
+ */
+static bool
+timers_set(void)
+{
+#ifdef __linux__
+  for (int t = 0; t < message_MaxTimers; t++) {
+    if (timers[t].set) {
+      return true;
+    }
+  }
+#endif
+  return false;
+}
+
+/**************** batch_new ****************/
+/* Allocate the buffers for one batch of messages.
+ */
+static batch_t *
+batch_new(void)
+{
+  batch_t *batch = malloc(sizeof(batch_t));
+  char *space = malloc((size_t) message_BatchSize * message_MaxBytes);
+  if (batch == NULL || space == NULL) {
+    log_v("message_loop: out of memory for message buffers");
+    exit(99);
+  }
+  batch->space = space;
+  for (int i = 0; i < message_BatchSize; i++) {
+    batch->own[i] = space + (size_t) i * message_MaxBytes;
+  }
+  return batch;
+}
+
+/**************** batch_delete ****************/
+/* Free the buffers of a batch.
+ */
+static void
+batch_delete(batch_t *batch)
+{
+  if (batch != NULL) {
+    free(batch->space);
+    free(batch);
+  }
+}
+
+/**************** batch_receive ****************/
+/* Receive every message waiting on a socket, up to a batch, with as few
+ * system calls as we can: one recvmmsg, where available.
+ * Messages from senders without an address to reply to are dropped.
+ * Returns the number of messages in the batch, null-terminated, in order.
+ */
+static int
+batch_receive(batch_t *batch, const int sock)
+{
+  int nrecv = 0;      // number of messages received
+  int nbytes[message_BatchSize];
+  if (sock == ourLocal) {
+    // the kernel fills in only the length of a sender's name (none, for
+    // an unnamed sender), and message_eqAddr compares all of it
+    memset(batch->from, 0, sizeof(batch->from));
+  }
+#ifdef __linux__
+  struct mmsghdr msgs[message_BatchSize];
+  struct iovec iovs[message_BatchSize];
+  // a peer offering to share memory passes its file descriptors along
+  // with a message on our Unix-domain socket (see message_openShared);
+  // and the kernel may pass the time each message arrived
+  _Alignas(struct cmsghdr) char control[message_BatchSize]
+    [CMSG_SPACE(shm_Fds * sizeof(int)) + CMSG_SPACE(sizeof(struct timespec))];
+  memset(msgs, 0, sizeof(msgs));
+  for (int i = 0; i < message_BatchSize; i++) {
+    batch->buf[i] = batch->own[i];
+    iovs[i].iov_base = batch->buf[i];
+    iovs[i].iov_len = message_MaxBytes - 1;
+    msgs[i].msg_hdr.msg_name = &batch->from[i];
+    msgs[i].msg_hdr.msg_namelen = sizeof(batch->from[i]);
+    msgs[i].msg_hdr.msg_iov = &iovs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+    if (sock == ourLocal || timestamps) {
+      msgs[i].msg_hdr.msg_control = control[i];
+      msgs[i].msg_hdr.msg_controllen = sizeof(control[i]);
+    }
+  }
+  // the socket is ready, so this returns at once with at least one message
+  nrecv = recvmmsg(sock, msgs, message_BatchSize, MSG_DONTWAIT, NULL);
+  for (int i = 0; i < nrecv; i++) {
+    nbytes[i] = msgs[i].msg_len;
+    batch->when[i] = arrival_of(&msgs[i].msg_hdr);
+    if (sock == ourLocal
+        && channel_accept(&msgs[i].msg_hdr, batch->buf[i], nbytes[i], batch->from[i])) {
+      nbytes[i] = -1;     // ours, not the handler's
+    }
+  }
+#else
+  socklen_t senderlen = sizeof(batch->from[0]);
+  batch->buf[0] = batch->own[0];
+  nbytes[0] = recvfrom(sock, batch->buf[0], message_MaxBytes-1, 0,
+                       &batch->from[0].sa, &senderlen);
+  nrecv = (nbytes[0] < 0) ? -1 : 1;
+  memset(&batch->when[0], 0, sizeof(batch->when[0]));
+#endif
+  if (nrecv < 0) {
+    // error, ignore it
+    log_e("message_loop: receiving from socket");
+    return 0;
+  }
+  return batch_keep(nrecv, nbytes, batch->from, batch->buf, batch->when);
+}
+
+/**************** batch_keep ****************/
+/* Null-terminate each of nrecv messages received, of nbytes[i] bytes,
+ * and keep those from addresses we can reply to, packed at the front of the
+ * arrays, in order; one of -1 bytes has already been taken care of.
+ * A fragment is kept only as the whole message, in place of its last
+ * fragment to arrive.
+ * Returns the number kept.
+ */
+static int
+batch_keep(const int nrecv, const int nbytes[], addr_t from[], char *bufs[],
+           struct timespec when[])
+{
+  // the handlers are done with the messages reassembled for the last batch
+  release(false);
+
+  int n = 0;
+  for (int i = 0; i < nrecv; i++) {
+    if (nbytes[i] < 0) {
+      continue;
+    }
+    addr_t sender = from[i];
+    char *buf = bufs[i];
+    buf[nbytes[i]] = '\0';     // null terminate message string
+    // where was it from?
+    if (!message_isAddr(sender)) {
+      // ignore it; we could not reply
+      log_d("message_loop: no address to reply to, family %d\n", sender.sa.sa_family);
+      continue;
+    }
+    // acknowledgements of control messages are ours
+    if (take_ack(sender, buf)) {
+      continue;
+    }
+    // a fragment of a longer message: hand on the message once whole
+    if (strncmp(buf, "FRAG ", 5) == 0
+        && (buf = reassemble(sender, buf, nbytes[i])) == NULL) {
+      continue;
+    }
+    // record it
+    if (logLevel >= message_LogTraffic) {
+      log_s("message_loop: FROM %s", message_stringAddr(sender));
+      log_d("message_loop: %d lines:", numLines(buf));
+      if (logLevel >= message_LogAll) {
+        log_s("%s", buf);
+      }
+    }
+    bufs[n] = buf;
+    from[n] = sender;
+    when[n] = when[i];
+    n++;
+  }
+  return n;
+}
+
+/**************** stamp_socket ****************/
+/* Have the kernel note when each message arrives on a socket, or stop,
+ * where it can (SO_TIMESTAMPNS, on Linux).
+ */
+static void
+stamp_socket(const int sock, const bool on)
+{
+#ifdef SO_TIMESTAMPNS
+  int flag = on ? 1 : 0;
+  if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &flag, sizeof(flag))) {
+    log_e("message_setTimestamps: SO_TIMESTAMPNS");
+  }
+#else
+  if (on) {
+    log_v("message_setTimestamps: SO_TIMESTAMPNS is not supported on this platform");
+  }
+#endif
+}
+
+/**************** arrival_of ****************/
+/* Return the time the kernel noted a message arriving, from the control
+ * messages received with it; zero if there is none.
+ */
+static struct timespec
+arrival_of(const struct msghdr *msg)
+{
+  struct timespec when = { 0, 0 };
+#ifdef SCM_TIMESTAMPNS
+  if (msg->msg_control == NULL) {
+    return when;
+  }
+  for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL;
+       cmsg = CMSG_NXTHDR((struct msghdr *) msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+      memcpy(&when, CMSG_DATA(cmsg), sizeof(when));
+    }
+  }
+#endif
+  return when;
+}
+
+/**************** find_peer ****************/
+/* Return the slot of a peer whose messages are sequenced; else NULL.
+ */
+static peer_t *
+find_peer(const addr_t addr)
+{
+  for (int i = 0; i < message_MaxPeers && npeers > 0; i++) {
+    if (peers[i].set && message_eqAddr(peers[i].addr, addr)) {
+      return &peers[i];
+    }
+  }
+  return NULL;
+}
+
+/**************** frame_header ****************/
+/* If messages to 'to' are sequenced, format the SEQ line for the next
+ * one into 'header' (HeaderBytes long) and return its length; else 0.
+ */
+static int
+frame_header(const addr_t to, char *header)
+{
+  peer_t *peer = find_peer(to);
+  if (peer == NULL) {
+    return 0;
+  }
+  return snprintf(header, HeaderBytes, "SEQ %u\n", ++peer->frames);
+}
+
+/**************** send_control ****************/
+/* Send control message number seq to 'to', after its CTL line; or
+ * hold it, if messages are being held.
+ */
+static void
+send_control(const addr_t to, const unsigned seq, const char *message)
+{
+  char header[HeaderBytes];
+  int hlen = snprintf(header, HeaderBytes, "CTL %u\n", seq);
+  struct iovec iov = { .iov_base = (char *) message, .iov_len = strlen(message) };
+  if (outbox.holding) {
+    hold(to, header, hlen, &iov, 1, true, false, 0);
+    return;
+  }
+  if (send_now(to, header, hlen, &iov, 1, false, 0) < 0) {
+    log_e("message_sendControl: error sending to datagram socket");
+  } else if (logLevel >= message_LogTraffic) {
+    log_s("message_sendControl: TO %s", message_stringAddr(to));
+    log_d("message_sendControl: CTL %d", seq);
+    if (logLevel >= message_LogAll) {
+      log_s("%s", message);
+    }
+  }
+}
+
+/**************** retransmit ****************/
+/* The retransmit timer fired: send each unacknowledged control message
+ * again, or give up on it after MaxTries; once none are left, stop the
+ * timer.  Returns false, so the loop goes on.
+ */
+static bool
+retransmit(void *arg)
+{
+  bool left = false;      // are any still unacknowledged?
+  pthread_mutex_lock(&controlLock);
+  for (int c = 0; c < MaxControls; c++) {
+    if (!controls[c].set) {
+      continue;
+    }
+    if (controls[c].tries >= MaxTries) {
+      log_s("message_sendControl: no CTLACK from %s; giving up",
+            message_stringAddr(controls[c].to));
+      free(controls[c].message);
+      controls[c].set = false;
+      continue;
+    }
+    controls[c].tries++;
+    send_control(controls[c].to, controls[c].seq, controls[c].message);
+    left = true;
+  }
+  pthread_mutex_unlock(&controlLock);
+  if (!left && retransmitTimer != 0) {
+    message_cancelTimer(retransmitTimer);
+    retransmitTimer = 0;
+  }
+  return false;
+}
+
+/**************** take_ack ****************/
+/* If the message is "CTLACK n", forget the control message number n we
+ * sent its sender, and return true, so it goes no further; else false.
+ */
+static bool
+take_ack(const addr_t from, const char *buf)
+{
+  static const char ack[] = "CTLACK ";
+  if (strncmp(buf, ack, sizeof(ack) - 1) != 0) {
+    return false;
+  }
+  unsigned seq;
+  if (sscanf(buf + sizeof(ack) - 1, "%u", &seq) == 1) {
+    pthread_mutex_lock(&controlLock);
+    for (int c = 0; c < MaxControls; c++) {
+      if (controls[c].set && controls[c].seq == seq
+          && message_eqAddr(controls[c].to, from)) {
+        free(controls[c].message);
+        controls[c].set = false;
+      }
+    }
+    pthread_mutex_unlock(&controlLock);
+  }
+  return true;
+}
+
+/**************** controls_left ****************/
+/* Return true if any control message is unacknowledged; if 'resend',
+ * send each of them again.
+ */
+static bool
+controls_left(const bool resend)
+{
+  bool left = false;
+  pthread_mutex_lock(&controlLock);
+  for (int c = 0; c < MaxControls; c++) {
+    if (controls[c].set) {
+      if (resend) {
+        send_control(controls[c].to, controls[c].seq, controls[c].message);
+      }
+      left = true;
+    }
+  }
+  pthread_mutex_unlock(&controlLock);
+  return left;
+}
+
+/**************** linger ****************/
+/* At message_done, while control messages are unacknowledged (at most
+ * MaxTries rounds): wait one interval for CTLACKs, on our UDP socket, any
+ * Unix-domain socket, and any memory we share, and send the rest again.
+ * If nothing still receives, we just send them.
+ */
+static void
+linger(void)
+{
+  char *buf = NULL;
+  int socks[2] = { ourSocket, ourLocal };   // those still receiving, or 0
+  for (int round = 0; round < MaxTries && controls_left(false); round++) {
+    if (buf == NULL && (buf = malloc(message_MaxBytes)) == NULL) {
+      socks[0] = socks[1] = 0;
+    }
+
+    // wait for CTLACKs, taking up to a batch of messages this round
+    for (int i = 0; i < message_BatchSize; i++) {
+      fd_set rfds;
+      FD_ZERO(&rfds);
+      int nfds = 0;
+      for (int k = 0; k < 2; k++) {
+        if (socks[k] != 0) {
+          FD_SET(socks[k], &rfds);
+          nfds = (socks[k] >= nfds) ? socks[k] + 1 : nfds;
+        }
+      }
+#ifdef __linux__
+      for (int c = 0; c < message_MaxChannels && buf != NULL; c++) {
+        if (channels[c].set) {
+          int fd = shm_eventfd(channels[c].shm);
+          FD_SET(fd, &rfds);
+          nfds = (fd >= nfds) ? fd + 1 : nfds;
+        }
+      }
+#endif
+      struct timeval timer = { .tv_sec = 0, .tv_usec = RetransmitInterval * 1000000 };
+      if (select(nfds, &rfds, NULL, NULL, &timer) <= 0) {
+        break;    // the interval is up
+      }
+#ifdef __linux__
+      for (int c = 0; c < message_MaxChannels && buf != NULL; c++) {
+        int len;
+        if (channels[c].set && FD_ISSET(shm_eventfd(channels[c].shm), &rfds)) {
+          while (shm_receive(channels[c].shm, &buf, &len, 1) == 1) {
+            take_ack(channels[c].peer, buf);
+          }
+        }
+      }
+#endif
+      for (int k = 0; k < 2; k++) {
+        if (socks[k] == 0 || !FD_ISSET(socks[k], &rfds)) {
+          continue;
+        }
+        addr_t from = message_noAddr();
+        socklen_t fromlen = sizeof(from);
+        ssize_t nbytes = recvfrom(socks[k], buf, message_MaxBytes - 1, MSG_DONTWAIT,
+                                  &from.sa, &fromlen);
+        if (nbytes <= 0 && from.sa.sa_family == AF_UNSPEC) {
+          socks[k] = 0;    // shut down, by message_stopReceiver
+          continue;
+        }
+        buf[nbytes < 0 ? 0 : nbytes] = '\0';
+        take_ack(from, buf);
+      }
+      if (!controls_left(false)) {
+        break;    // all acknowledged
+      }
+    }
+    controls_left(true);
+  }
+  free(buf);
+
+  // give up on the rest
+  pthread_mutex_lock(&controlLock);
+  for (int c = 0; c < MaxControls; c++) {
+    if (controls[c].set) {
+      free(controls[c].message);
+      controls[c].set = false;
+    }
+  }
+  pthread_mutex_unlock(&controlLock);
+}
+
+/**************** send_fragments ****************/
+/* Send a message too long for one datagram (its header, then the
+ * caller's buffers) as up to message_MaxFragments fragments, each
+ * "FRAG id i n length" and its share of the message; or hold them, if
+ * messages are being held.  If 'latest', the fragments together
+ * supersede any frame still waiting for the peer, as message_sendFrame.
+ */
+static void
+send_fragments(const addr_t to, const char *header, const int hlen,
+               const struct iovec *iov, const int iovcnt, const bool latest)
+{
+  // the whole message: the header, then the caller's buffers
+  struct iovec all[iovcnt + 1];
+  int first = (hlen > 0) ? 1 : 0;
+  int count = first + iovcnt;
+  all[0].iov_base = (char *) header;
+  all[0].iov_len = hlen;
+  memcpy(all + first, iov, iovcnt * sizeof(struct iovec));
+  int length = 0;
+  for (int b = 0; b < count; b++) {
+    length += all[b].iov_len;
+  }
+  if (length > message_MaxLength) {
+    log_d("message_send: a %d-byte message is too long to send", length);
+    return;
+  }
+
+  // split it evenly, so the receiver can tell where each share goes
+  int n = (length + FragmentShare - 1) / FragmentShare;
+  int share = (length + n - 1) / n;
+  if (++fragmentId == 0) {
+    fragmentId++;     // 0 marks a whole message, in the backlogs
+  }
+  unsigned id = fragmentId;
+  int b = 0;          // buffer the next share starts in
+  size_t off = 0;     // and where in that buffer
+  for (int i = 0; i < n; i++) {
+    // cut this fragment's share from the buffers, without copying
+    int want = (i < n - 1) ? share : length - share * (n - 1);
+    struct iovec piece[count];
+    int npieces = 0;
+    while (want > 0) {
+      size_t take = all[b].iov_len - off;
+      if (take > (size_t) want) {
+        take = want;
+      }
+      if (take > 0) {
+        piece[npieces].iov_base = (char *) all[b].iov_base + off;
+        piece[npieces].iov_len = take;
+        npieces++;
+      }
+      off += take;
+      want -= take;
+      if (off == all[b].iov_len) {
+        b++;
+        off = 0;
+      }
+    }
+    char fragment[HeaderBytes];
+    int flen = snprintf(fragment, HeaderBytes, "FRAG %u %d %d %d\n", id, i, n, length);
+    if (outbox.holding) {
+      hold(to, fragment, flen, piece, npieces, true, latest, id);
+    } else if (send_now(to, fragment, flen, piece, npieces, latest, id) < 0) {
+      log_e("message_send: error sending a fragment to datagram socket");
+    }
+  }
+  if (logLevel >= message_LogTraffic) {
+    log_s("message_send: TO %s", message_stringAddr(to));
+    log_d("message_send: %d fragments", n);
+    log_d("message_send: %d bytes", length);
+  }
+}
+
+/**************** reassemble ****************/
+/* Add a fragment of len bytes, from 'from', to the message it belongs to.
+ * Return the message, null-terminated, once every fragment has arrived
+ * (it stays valid until the next batch); NULL until then, or if the
+ * fragment is malformed.  Each sender may have one message in progress;
+ * a fragment of a newer one drops the older.  A message unfinished after
+ * ReassemblyTimeout seconds is dropped, and when all slots are busy, the
+ * oldest unfinished one is.
+ */
+static char *
+reassemble(const addr_t from, const char *buf, const int len)
+{
+  // parse the FRAG line, and check the fragment is the size it should be;
+  // a message is always split into as few fragments as will hold it (as
+  // send_fragments does), so every share fits within the message
+  const char *body = memchr(buf, '\n', len);
+  unsigned id;
+  int i, n, length;
+  if (body == NULL
+      || sscanf(buf, "FRAG %u %d %d %d", &id, &i, &n, &length) != 4
+      || n < 1 || n > message_MaxFragments || i < 0 || i >= n
+      || length < 1 || length > message_MaxLength
+      || n != (length + FragmentShare - 1) / FragmentShare) {
+    log_v("message_loop: dropping a malformed fragment");
+    return NULL;
+  }
+  body++;
+  int share = (length + n - 1) / n;
+  int size = (i < n - 1) ? share : length - share * (n - 1);
+  if (size < 0 || i * share + size > length || len - (body - buf) != size) {
+    log_v("message_loop: dropping a fragment of the wrong size");
+    return NULL;
+  }
+
+  // find the sender's message, or a slot for it; a complete message is
+  // still being handled, so its slot is busy until release
+  time_t now = time(NULL);
+  reassembly_t *r = NULL;
+  reassembly_t *oldest = NULL;
+  for (int k = 0; k < MaxReassembly; k++) {
+    reassembly_t *slot = &reassembly[k];
+    if (slot->set && !slot->complete && now - slot->started > ReassemblyTimeout) {
+      free(slot->buf);        // waited too long for the rest
+      slot->buf = NULL;
+      slot->set = false;
+    }
+    if (slot->set && !slot->complete && message_eqAddr(slot->from, from)) {
+      r = slot;
+      break;
+    }
+    if (!slot->set && r == NULL) {
+      r = slot;               // free; keep looking for the sender's own
+    } else if (slot->set && !slot->complete
+               && (oldest == NULL || slot->started < oldest->started)) {
+      oldest = slot;
+    }
+  }
+  if (r == NULL && (r = oldest) == NULL) {
+    return NULL;              // every slot holds a message being handled
+  }
+  if (!r->set || !message_eqAddr(r->from, from)
+      || r->id != id || r->n != n || r->length != length) {
+    // a new message
+    if (r->set) {
+      free(r->buf);
+    }
+    r->set = false;
+    if ((r->buf = malloc(length + 1)) == NULL) {
+      log_v("message_loop: out of memory for reassembly");
+      return NULL;
+    }
+    r->set = true;
+    r->complete = false;
+    r->from = from;
+    r->id = id;
+    r->n = n;
+    r->length = length;
+    r->received = 0;
+    r->got = 0;
+    r->started = now;
+  }
+
+  // copy its share into place, once
+  if ((r->got & ((uint32_t) 1 << i)) == 0) {
+    memcpy(r->buf + i * share, body, size);
+    r->got |= (uint32_t) 1 << i;
+    r->received++;
+  }
+  if (r->received < n) {
+    return NULL;
+  }
+  r->buf[length] = '\0';
+  r->complete = true;
+  return r->buf;
+}
+
+/**************** release ****************/
+/* Free the messages reassembled and handed on; or, if 'all', every
+ * message being reassembled too.
+ */
+static void
+release(const bool all)
+{
+  for (int k = 0; k < MaxReassembly; k++) {
+    if (reassembly[k].set && (all || reassembly[k].complete)) {
+      free(reassembly[k].buf);
+      reassembly[k].buf = NULL;
+      reassembly[k].set = false;
+    }
+  }
+}
+
+/**************** message_openShared ****************/
+/*
+ * Offer a peer on this host memory to share, through which we then
+ * exchange messages.
+ * See message.h for detailed description.
+ */
+bool
+message_openShared(const addr_t peer)
+{
+#ifdef __linux__
+  if (ourLocal == 0) {
+    log_v("message_openShared: no Unix-domain socket; see message_openLocal");
+    return false; // error in usage of this function.
+  }
+  if (peer.sa.sa_family != AF_UNIX || !message_isAddr(peer)) {
+    log_v("message_openShared: needs a Unix-domain address");
+    return false; // error in usage of this function.
+  }
+  if (find_channel(&peer) != NULL) {
+    return true;
+  }
+  int c = 0;
+  while (c < message_MaxChannels && channels[c].set) {
+    c++;
+  }
+  if (c == message_MaxChannels) {
+    log_v("message_openShared: too many peers sharing memory");
+    return false;
+  }
+  int fds[shm_Fds];
+  shm_t *shm = shm_new(fds);
+  if (shm == NULL) {
+    log_e("message_openShared: making shared memory");
+    return false;
+  }
+
+  // pass the memory and eventfds with "SHM"
+  _Alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(fds))];
+  memset(control, 0, sizeof(control));
+  struct iovec iov = { .iov_base = "SHM", .iov_len = 3 };
+  struct msghdr msg = {
+    .msg_name = (void *) &peer,
+    .msg_namelen = addrLen(&peer),
+    .msg_iov = &iov,
+    .msg_iovlen = 1,
+    .msg_control = control,
+    .msg_controllen = sizeof(control),
+  };
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+  if (sendmsg(ourLocal, &msg, 0) < 0) {
+    log_e("message_openShared: passing shared memory");
+    shm_delete(shm);
+    return false;
+  }
+
+  // wait for the answer, SHMOK or SHMNO, dropping anything else
+  char answer[8];
+  for (int try = 0; try < ShareTries; try++) {
+    fd_set rfds;
+    FD_ZERO(&rfds);
+    FD_SET(ourLocal, &rfds);
+    struct timeval timer = { .tv_sec = 0, .tv_usec = ShareInterval * 1000000 };
+    if (select(ourLocal + 1, &rfds, NULL, NULL, &timer) <= 0) {
+      continue;
+    }
+    addr_t from = message_noAddr();
+    socklen_t fromlen = sizeof(from);
+    ssize_t nbytes = recvfrom(ourLocal, answer, sizeof(answer) - 1, MSG_DONTWAIT,
+                              &from.sa, &fromlen);
+    if (nbytes < 0 || !message_eqAddr(from, peer)) {
+      log_v("message_openShared: dropping a message while waiting for an answer");
+      continue;
+    }
+    answer[nbytes] = '\0';
+    if (strcmp(answer, "SHMOK") == 0) {
+      open_channel(c, peer, shm);
+      log_s("message_openShared: sharing memory with %s", message_stringAddr(peer));
+      return true;
+    }
+    if (strcmp(answer, "SHMNO") == 0) {
+      break;
+    }
+  }
+  log_s("message_openShared: %s declined; using the socket", message_stringAddr(peer));
+  shm_delete(shm);
+  return false;
+#else
+  log_v("message_openShared: shared memory needs Linux");
+  return false;
+#endif
+}
+
+#ifdef __linux__
+/**************** find_channel ****************/
+/* Return the channel to a peer with which we share memory; else NULL.
+ */
+static channel_t *
+find_channel(const addr_t *addr)
+{
+  if (nchannels == 0 || addr->sa.sa_family != AF_UNIX) {
+    return NULL;
+  }
+  for (int c = 0; c < message_MaxChannels; c++) {
+    if (channels[c].set && message_eqAddr(channels[c].peer, *addr)) {
+      return &channels[c];
+    }
+  }
+  return NULL;
+}
+
+/**************** open_channel ****************/
+/* Set up channel c, to a peer, through the given memory; a running
+ * loop watches it at once.
+ */
+static void
+open_channel(const int c, const addr_t peer, shm_t *shm)
+{
+  channels[c].set = true;
+  channels[c].peer = peer;
+  channels[c].shm = shm;
+  nchannels++;
+  if (ourEpoll >= 0) {
+    struct epoll_event event = { .events = EPOLLIN, .data.u32 = EventChannel + c };
+    epoll_ctl(ourEpoll, EPOLL_CTL_ADD, shm_eventfd(shm), &event);
+  }
+}
+
+/**************** close_channel ****************/
+/* Take down channel c, and free its memory.
+ */
+static void
+close_channel(const int c)
+{
+  if (ourEpoll >= 0) {
+    epoll_ctl(ourEpoll, EPOLL_CTL_DEL, shm_eventfd(channels[c].shm), NULL);
+  }
+  shm_delete(channels[c].shm);
+  channels[c].set = false;
+  nchannels--;
+}
+
+/**************** channel_accept ****************/
+/* A message of 'len' bytes came on our Unix-domain socket, perhaps with
+ * file descriptors.  If it is "SHM" with a channel's, from a named
+ * sender, open the channel (in place of any from that sender), and answer
+ * SHMOK; if it is "SHM" otherwise, answer SHMNO.  We close any file
+ * descriptors we do not keep.
+ * Return true if it was "SHM", which is ours, not the handler's.
+ */
+static bool
+channel_accept(const struct msghdr *msg, const char *buf, const int len,
+               const addr_t from)
+{
+  int fds[shm_Fds];
+  int nfds = 0;
+  for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL;
+       cmsg = CMSG_NXTHDR((struct msghdr *) msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+      int n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      for (int j = 0; j < n; j++) {
+        int fd;
+        memcpy(&fd, CMSG_DATA(cmsg) + j * sizeof(int), sizeof(int));
+        if (nfds < shm_Fds) {
+          fds[nfds++] = fd;
+        } else {
+          close(fd);
+        }
+      }
+    }
+  }
+  bool offer = (len == 3 && strncmp(buf, "SHM", 3) == 0);
+  if (!offer || nfds != shm_Fds || !message_isAddr(from)) {
+    for (int j = 0; j < nfds; j++) {
+      close(fds[j]);
+    }
+    if (offer) {
+      sendto(ourLocal, "SHMNO", 5, MSG_DONTWAIT, &from.sa, addrLen(&from));
+    }
+    return offer;
+  }
+
+  // a sender offering again replaces its channel
+  channel_t *old = find_channel(&from);
+  if (old != NULL) {
+    close_channel(old - channels);
+  }
+  int c = 0;
+  while (c < message_MaxChannels && channels[c].set) {
+    c++;
+  }
+  shm_t *shm = (c < message_MaxChannels) ? shm_attach(fds) : NULL;
+  if (shm == NULL) {
+    if (c == message_MaxChannels) {
+      for (int j = 0; j < nfds; j++) {
+        close(fds[j]);
+      }
+    }
+    log_s("message_loop: declining to share memory with %s", message_stringAddr(from));
+    sendto(ourLocal, "SHMNO", 5, MSG_DONTWAIT, &from.sa, addrLen(&from));
+    return true;
+  }
+  open_channel(c, from, shm);
+  log_s("message_loop: sharing memory with %s", message_stringAddr(from));
+  sendto(ourLocal, "SHMOK", 5, MSG_DONTWAIT, &from.sa, addrLen(&from));
+  return true;
+}
+
+/**************** channel_ready ****************/
+/* Channel c has messages: take up to a batch, and hand them to the
+ * handler, just as from a socket.  Return true if the handler says to quit.
+ * If the peer has corrupted the memory, we close the channel.
+ */
+static bool
+channel_ready(handlers_t *h, const int c)
+{
+  if (c < 0 || c >= message_MaxChannels || !channels[c].set) {
+    return false;  // closed by an earlier handler in this wakeup
+  }
+  batch_t *batch = h->batch;
+  if (batch == NULL) {
+    // this loop does not handle messages; leave them for one that does
+    epoll_ctl(ourEpoll, EPOLL_CTL_DEL, shm_eventfd(channels[c].shm), NULL);
+    return false;
+  }
+  int nbytes[message_BatchSize];
+  for (int i = 0; i < message_BatchSize; i++) {
+    batch->buf[i] = batch->own[i];
+  }
+  int nrecv = shm_receive(channels[c].shm, batch->buf, nbytes, message_BatchSize);
+  if (nrecv < 0) {
+    log_s("message_loop: memory shared with %s is corrupt; closing it",
+          message_stringAddr(channels[c].peer));
+    close_channel(c);
+    return false;
+  }
+  // no kernel saw them arrive; they arrive as we take them
+  struct timespec now = { 0, 0 };
+  if (timestamps) {
+    clock_gettime(CLOCK_REALTIME, &now);
+  }
+  for (int i = 0; i < nrecv; i++) {
+    batch->from[i] = channels[c].peer;
+    batch->when[i] = now;
+  }
+  int n = batch_keep(nrecv, nbytes, batch->from, batch->buf, batch->when);
+  return deliver(h, n, batch->from, batch->buf, batch->when);
+}
+
+/**************** channel_held ****************/
+/* Put held message i into the ring of the channel to its recipient;
+ * send_held wakes the recipient later.  If the ring is full, the
+ * message waits in the recipient's backlog.
+ */
+static void
+channel_held(channel_t *channel, const int i)
+{
+  int len = 0;
+  for (int j = 0; j < outbox.iovcnt[i]; j++) {
+    len += outbox.iov[i][j].iov_len;
+  }
+  if (len >= message_MaxBytes) {
+    log_d("message_flush: a %d-byte message is too long for shared memory", len);
+  } else if (!shm_send(channel->shm, outbox.iov[i], outbox.iovcnt[i])) {
+    wait_in_backlog(&outbox.to[i], outbox.iov[i], outbox.iovcnt[i],
+                    outbox.latest[i], outbox.part[i]);
+  } else if (logLevel >= message_LogTraffic) {
+    log_s("message_flush: TO %s", message_stringAddr(outbox.to[i]));
+    log_d("message_flush: %d bytes", len);
+  }
+}
+#endif
+
+/**************** message_done ****************/
+/*
+ * Clean up the message module, prior to exit.
+ * See message.h for detailed description.
+ */
+void
+message_done(void)
+{
+  // send anything still held
+  message_flush();
+#ifdef __linux__
+  if (ourUring != NULL) {
+    // take any CTLACKs io_uring has received already, before it goes
+    char *buf[message_BatchSize];
+    addr_t from[message_BatchSize];
+    struct timespec when[message_BatchSize];
+    int len[message_BatchSize];
+    int n = uring_receive(ourUring, buf, len, from, when, message_BatchSize);
+    for (int i = 0; i < n; i++) {
+      take_ack(from[i], buf[i]);
+    }
+    uring_delete(ourUring);
+    ourUring = NULL;
+  }
+#endif
+  // retry control messages until acknowledged, briefly, on the bare socket
+  if (ourSocket != 0) {
+    linger();
+  }
+  // give slow peers a last chance, then drop what they have not taken
+  drain_all(NULL);
+  for (int b = 0; b < message_MaxBacklogs; b++) {
+    if (backlogs[b].set) {
+      log_d("message_done: dropping %d messages waiting", backlogs[b].count);
+      log_s("message_done: for %s", message_stringAddr(backlogs[b].to));
+      for (int m = 0; m < backlogs[b].count; m++) {
+        free(backlogs[b].message[m]);
+      }
+      backlogs[b].set = false;
+    }
+  }
+  nbacklogs = 0;
+  free(outbox.copies);
+  outbox.copies = NULL;
+  outbox.size = 0;
+  release(true);
+#ifdef __linux__
+  for (int c = 0; c < message_MaxChannels; c++) {
+    if (channels[c].set) {
+      close_channel(c);
+    }
+  }
+#endif
+#ifdef __linux__
+  for (int t = 0; t < message_MaxTimers; t++) {
+    if (timers[t].set) {
+      message_cancelTimer(t + 1);
+    }
+  }
+#endif
+  retransmitTimer = 0;
+  backlogTimer = 0;
+
   if (ourSocket != 0) {
     close(ourSocket);
     ourSocket = 0;
   }
+  if (ourLocal != 0) {
+    close(ourLocal);
+    ourLocal = 0;
+    if (ourLocalName.un.sun_path[0] != '\0') {
+      unlink(ourLocalName.un.sun_path);   // a pathname, not an abstract name
+    }
+  }
   log_v("message_done: message module closing down.");
 }
 
@@ -570,9 +3366,8 @@ handleMessage(void *arg, const addr_t from, const char *message)
   // this sender becomes our correspondent, henceforth
   *otherp = from;
 
-  printf("[%s@%05d]: %s\n",
-         inet_ntoa(from.sin_addr), // IP address of the sender
-         ntohs(from.sin_port),     // port number of the sender
+  printf("[%s]: %s\n",
+         message_stringAddr(from), // address and port of the sender
          message);                 // message from the sender
   fflush(stdout);
   return false;
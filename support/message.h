@@ -4,6 +4,9 @@
  * Provides a message-passing abstraction among Internet hosts.  Messages
  * are sent via UDP and are thus limited to UDP packet size, may be lost,
  * and may be reordered, but require no connection setup or teardown.
+ * Programs on the same host may also exchange messages through Unix-domain
+ * datagram sockets (see message_openLocal), which skip the network stack,
+ * or through shared memory (see message_openShared), which skips the kernel.
  *
  * Typical server sequence looks like this:
  *   message_init(stderr);
@@ -17,6 +20,7 @@
  *   message_done();
  * Note:
  *  handleTimeout may be NULL (and timeout==0) if no timers needed.
+ *  Timers set with message_addTimer fire while message_loop runs.
  *  handleInput may be NULL if no input expected.
  *  arg may be NULL if not needed by handlers.
  *
@@ -30,12 +34,17 @@
 #include <stdbool.h>
 #include <arpa/inet.h>  // These two includes are not needed for this file,
 #include <sys/select.h> // but is needed for users of this file.
+#include <sys/uio.h>    // struct iovec, for message_sendv
+#include <sys/un.h>     // struct sockaddr_un, in addr_t
+#include <time.h>       // struct timespec, for message_arrival
 
 /****************** types *********************/
-/* A type representing an Internet address, suitable for use in message_send().
- * Although not technically opaque (because struct sockaddr_in is well
- * documented and not made opaque by the include file <arpa/inet.h> that
- * defines it), users of this module should treat addr_t as an opaque type.
+/* A type representing an Internet address, or the name of a Unix-domain
+ * socket on this host, suitable for use in message_send().
+ * Although not technically opaque (because struct sockaddr_in and
+ * struct sockaddr_un are well documented and not made opaque by the
+ * include files that define them), users of this module should treat
+ * addr_t as an opaque type.
  * Module users can declare variables of type addr_t, and initialize them
  * to the value returned by message_noAddr, or initialize them in a call to
  * message_setAddr, or receive them as a parameter in one of the handler
@@ -43,13 +52,53 @@
  * cannot be compared directly for equality; to compare two addresses,
  * use message_eqAddr.
  */
-typedef struct sockaddr_in addr_t;
+typedef union {
+  struct sockaddr sa;       // sa.sa_family says which: AF_INET or AF_UNIX
+  struct sockaddr_in in;    // an Internet address and UDP port
+  struct sockaddr_un un;    // a Unix-domain socket's name
+} addr_t;
 
 /****************** constants *********************/
 // Maximum payload size for UDP messages, according to
 // https://en.wikipedia.org/wiki/User_Datagram_Protocol
 static const int message_MaxBytes = 65507;
 
+// A longer message is sent in up to message_MaxFragments datagrams, and
+// reassembled by message_loop; so the longest message, message_MaxLength
+// bytes, is message_MaxFragments times a fragment's share (65000 bytes).
+#define message_MaxFragments 32
+static const int message_MaxLength = message_MaxFragments * 65000;
+
+// Most messages handed to the handler at once by message_loopBatch.
+#define message_BatchSize 32
+
+// Most messages held for sending at once by message_flush.
+#define message_QueueSize 64
+
+// Most messages waiting for one peer that is slow to receive, and most
+// such peers at once; see message_send.
+#define message_Backlog 16
+#define message_MaxBacklogs 32
+
+// Most timers set at once with message_addTimer.
+#define message_MaxTimers 8
+
+// Most other file descriptors watched at once with message_watch.
+#define message_MaxWatches 4
+
+// Most peers to which messages are sequenced at once; see message_sequence.
+#define message_MaxPeers 32
+
+// Most peers with which we share memory at once; see message_openShared.
+#define message_MaxChannels 32
+
+// How message_loop receives, and message_flush sends: with epoll (or select)
+// and recvmmsg/sendmmsg, or with io_uring; see message_initBackend.
+typedef enum { message_Poll, message_Uring } message_backend_t;
+
+// How much to log of each message sent or received; see message_setLogLevel.
+typedef enum { message_LogErrors, message_LogTraffic, message_LogAll } message_loglevel_t;
+
 /****************** global functions *********************/
 
 /******************************************/
@@ -64,6 +113,74 @@ static const int message_MaxBytes = 65507;
  */
 int message_init(FILE *logFP);
 
+/******************************************/
+/* message_initBackend: initialize the module, choosing how it does I/O.
+ * Caller provides:
+ *   file pointer(fp), as for message_init;
+ *   the backend: message_Poll, which is what message_init uses, or
+ *   message_Uring, which receives every message with one multishot
+ *   recvmsg request, and sends all held messages with one io_uring_enter;
+ *   whether the caller will open receiver sockets (message_openReceiver),
+ *   which share our port.
+ * Function returns:
+ *   port number where messages can be sent; zero on error.
+ * Notes:
+ *   If io_uring is unavailable (not Linux, an old kernel, or one that
+ *   disallows it), we log that and fall back to message_Poll.
+ *   Either way, the module behaves the same to its users.
+ *   Only if asked for receivers do we let our port be shared (SO_REUSEPORT);
+ *   any socket of the same user could then bind it too, and take a share
+ *   of our messages.  message_init asks for none.
+ * Logs: as for message_init; the backend in use.
+ */
+int message_initBackend(FILE *logFP, const message_backend_t backend,
+                        const bool receivers);
+
+/******************************************/
+/* message_setLogLevel: choose how much of the traffic to log.
+ * Caller provides:
+ *   message_LogAll, the default: the address, size, and text of each
+ *     message sent or received;
+ *   message_LogTraffic: the address and size of each, but not its text;
+ *   message_LogErrors: nothing per message, so sending and receiving cost
+ *     only their system calls; errors and setup are still logged.
+ * Notes: may be called at any time, even before message_init.
+ * Logs: nothing.
+ */
+void message_setLogLevel(const message_loglevel_t level);
+
+/******************************************/
+/* message_setTimestamps: have the kernel note when each message arrives.
+ * Caller provides:
+ *   true to turn it on, for our sockets and any opened later; false to
+ *   turn it off.
+ * Assumptions: message_init() has already been called.
+ * Notes:
+ *   The kernel stamps each datagram as it takes it from the network
+ *   (SO_TIMESTAMPNS), before it waits in the socket for us, so
+ *   message_arrival then tells how long a message waited in all.
+ *   A message through shared memory is stamped as we take it.
+ *   Linux only; elsewhere message_arrival never knows.
+ * Logs: errors.
+ */
+void message_setTimestamps(const bool on);
+
+/******************************************/
+/* message_arrival: when a message arrived at this host.
+ * Caller provides:
+ *   a message, as handed to a message_loop or message_loopBatch handler
+ *   that has not yet returned, or as filled in by the last
+ *   message_receive on this thread;
+ *   where to put the time, by CLOCK_REALTIME.
+ * Function returns:
+ *   true if we know; false if timestamps are off (see
+ *   message_setTimestamps), or 'buf' is not such a message.
+ * Notes: a message reassembled from fragments arrived when its last
+ *   fragment did.
+ * Logs: nothing.
+ */
+bool message_arrival(const char *buf, struct timespec *when);
+
 /******************************************/
 /* message_noAddr: return an addr_t representing "no address".
  * Logs: nothing.
@@ -105,6 +222,29 @@ bool message_eqAddr(const addr_t a, const addr_t b);
  */
 bool message_setAddr(const char *hostname, const char *portStr, addr_t *addr);
 
+/******************************************/
+/* message_setLocalAddr: initialize an address to a Unix-domain socket's name.
+ * Caller provides:
+ *   the name a program on this host gave message_openLocal;
+ *   a pointer to an address, which will be initialized.
+ * Function returns:
+ *   true if successful in initalizing the address;
+ *   false if an error, which may indicate a name too long.
+ * Logs: information about errors in parameters.
+ */
+bool message_setLocalAddr(const char *name, addr_t *addr);
+
+/******************************************/
+/* message_stringAddr: format an address for printing.
+ * Caller provides: an address.
+ * Function returns:
+ *   "host:port" for an Internet address; the name, for a Unix-domain one.
+ *   The string is static to the calling thread, and thus should not be
+ *   retained; it is overwritten by the next call.
+ * Logs: nothing.
+ */
+const char *message_stringAddr(const addr_t addr);
+
 /******************************************/
 /* message_send: send a message.
  * Caller provides:
@@ -112,12 +252,146 @@ bool message_setAddr(const char *hostname, const char *portStr, addr_t *addr);
  *   a string containing the message.
  * Function returns: none
  * Assumptions: message_init() has already been called.
+ * Notes:
+ *   A message too long for one datagram, as a receiver takes it (that is,
+ *   of message_MaxBytes or more, leaving room for the '\0' that ends it,
+ *   with any SEQ line) is split into fragments, each a datagram beginning with a line
+ *     FRAG id i n length
+ *   (fragment i of n of message id, which is 'length' bytes long), which
+ *   message_loop reassembles; up to message_MaxLength bytes.
+ *   message_sendBytes and message_sendv do the same.
+ *   We never wait for a peer: a message its socket (or shared memory)
+ *   has no room for waits, with any later ones to the same peer, in that
+ *   peer's backlog, which is sent as room appears.  A backlog holds at
+ *   most message_Backlog messages, a message in fragments counting as
+ *   one; beyond that, the oldest is dropped, with all its fragments, as
+ *   UDP would drop it.  Call from one thread only, like message_hold.
  * Logs:
  *   errors in arguments,
  *   errors in sending the message.
  */
 void message_send(const addr_t to, const char *message);
 
+/******************************************/
+/* message_sendBytes: send a message that may hold any bytes, even '\0'.
+ * Caller provides:
+ *   a valid address to which to send the message,
+ *   a buffer containing the message, and its length in bytes.
+ * Function returns: none
+ * Assumptions: message_init() has already been called.
+ * Logs:
+ *   errors in arguments,
+ *   errors in sending the message,
+ *   the length of the message, but not its contents.
+ */
+void message_sendBytes(const addr_t to, const char *message, const int len);
+
+/******************************************/
+/* message_sendv: send a message gathered from several buffers.
+ * Caller provides:
+ *   a valid address to which to send the message,
+ *   an array of iovcnt iovecs, whose buffers are sent one after another
+ *   as a single message; the buffers may hold any bytes, even '\0'.
+ * Function returns: none
+ * Assumptions: message_init() has already been called.
+ * Notes:
+ *   This lets a caller send a header and a body kept in separate
+ *   buffers without first copying them into one.
+ * Logs:
+ *   errors in arguments,
+ *   errors in sending the message,
+ *   the length of the message, but not its contents.
+ */
+void message_sendv(const addr_t to, const struct iovec *iov, const int iovcnt);
+
+/******************************************/
+/* message_sendFrame: send a message that supersedes the last one sent
+ *   to the same peer with message_sendFrame, such as a new display.
+ * Caller provides:
+ *   as for message_sendv.
+ * Function returns: none
+ * Assumptions: message_init() has already been called.
+ * Notes:
+ *   If the earlier one is still in the peer's backlog (see message_send),
+ *   it is dropped, and this one waits at the end of the backlog instead;
+ *   a frame sent in fragments is dropped or waits as a whole, but for
+ *   any of its fragments the peer has already taken;
+ *   so a slow peer gets the newest frame as soon as it can take one, not
+ *   every frame it fell behind on.  Use this only for messages the peer
+ *   can afford to lose.
+ * Logs:
+ *   as for message_sendv.
+ */
+void message_sendFrame(const addr_t to, const struct iovec *iov, const int iovcnt);
+
+/******************************************/
+/* message_hold: hold the messages sent from now on, to send them together.
+ * Caller provides: nothing.
+ * Function returns: nothing.
+ * Assumptions: message_init() has already been called.
+ * Notes:
+ *   Until message_flush is called, message_send, message_sendBytes,
+ *   message_sendv and message_sendFrame queue their messages rather than
+ *   send them; then they are all sent, in order, with as few system calls
+ *   as possible (one sendmmsg per message_QueueSize messages, where
+ *   available).  This suits a server that sends many clients an update
+ *   at once.  Messages from message_send and message_sendBytes are
+ *   copied, but message_sendv and message_sendFrame refer to the caller's
+ *   buffers, which must remain unchanged until message_flush.
+ * Logs: nothing.
+ */
+void message_hold(void);
+
+/******************************************/
+/* message_flush: send the messages held since message_hold, and stop holding.
+ * Caller provides: nothing.
+ * Function returns: nothing.
+ * Assumptions: message_init() has already been called.
+ * Logs:
+ *   errors in sending the messages,
+ *   the address and length of each message sent, but not its contents.
+ */
+void message_flush(void);
+
+/******************************************/
+/* message_sequence: number the messages sent to a peer, or stop.
+ * Caller provides:
+ *   a valid address, and whether to sequence the messages sent to it.
+ * Function returns:
+ *   false if asked to sequence more than message_MaxPeers peers at once.
+ * Notes:
+ *   Every message then sent to the peer with message_send,
+ *   message_sendBytes, or message_sendv begins with a line
+ *     SEQ n
+ *   where n counts up from 1; a peer that has seen a higher n may drop
+ *   the message as stale, since UDP may reorder messages.
+ *   Messages sent with message_sendControl are numbered separately.
+ *   Turning sequencing off, and on again, starts again from 1.
+ * Logs: errors.
+ */
+bool message_sequence(const addr_t peer, const bool on);
+
+/******************************************/
+/* message_sendControl: send a message that must not be lost.
+ * Caller provides:
+ *   a valid address, and a null-terminated string, as for message_send.
+ * Function returns: none
+ * Notes:
+ *   To a peer whose messages are sequenced (see message_sequence), the
+ *   message begins with a line
+ *     CTL n
+ *   and is sent again every so often, until the peer answers with
+ *     CTLACK n
+ *   or until we give up, after a few tries; the peer should act on each
+ *   n once.  We take the CTLACK messages ourselves: message_loop's
+ *   handlers and message_receive never see them.  Unacknowledged control
+ *   messages are retried from a timer (see message_addTimer), and once
+ *   more by message_done, which waits a moment for their CTLACKs.
+ *   To any other peer this is just message_send.
+ * Logs: as message_send, and when we give up on a message.
+ */
+void message_sendControl(const addr_t to, const char *message);
+
 /******************************************/
 /* message_loop: loop, handling input and incoming messages.
  * Caller provides:
@@ -139,6 +413,7 @@ void message_send(const addr_t to, const char *message);
  *   Handlers should return true to terminate looping, false to keep looping.
  * Notes:
  *   The timeout feature is optional; use timeout=0 and handleTimeout=NULL.
+ *   On Linux we wait with epoll, elsewhere with select.
  * Logs:
  *   errors in arguments,
  *   errors in monitoring stdin and/or network,
@@ -151,6 +426,189 @@ bool message_loop(void *arg, const float timeout,
                                         const addr_t from,
                                         const char *message));
 
+/******************************************/
+/* message_loopBatch: like message_loop, but for a batch-aware handler.
+ * Each time the socket is ready, every message waiting (up to
+ * message_BatchSize) is received at once, with one recvmmsg call where
+ * available, and handed to one call of the handler.  Thus the caller can,
+ * e.g., apply a whole batch of moves and then refresh its clients once.
+ * Caller provides:
+ *   as for message_loop, but a batch handler in place of handleMessage.
+ * Handlers:
+ *   handleBatch: provided the number of messages n >= 1, and arrays of
+ *     their senders' addresses and their contents, in order of arrival.
+ *     The handler may modify the strings, but should realize their memory
+ *     will be reused upon return from the handler.
+ *   Others as for message_loop.
+ * Function returns, Logs: as for message_loop.
+ */
+bool message_loopBatch(void *arg, const float timeout,
+                       bool (*handleTimeout)(void *arg),
+                       bool (*handleInput)  (void *arg),
+                       bool (*handleBatch)  (void *arg, const int n,
+                                             const addr_t from[], char *buf[]));
+
+/******************************************/
+/* message_addTimer: set a timer, to call a handler from within the loop.
+ * Caller provides:
+ *   the interval (in seconds, > 0) after which the timer fires,
+ *   whether it then fires again every interval (periodic), or only once,
+ *   a function to handle it firing (not NULL).
+ * Function returns:
+ *   a timer number > 0, for message_cancelTimer; 0 on error, or if timers
+ *   are not supported on this platform (they need Linux's timerfd).
+ * Handlers:
+ *   handleTimer: provided the 'arg' given to message_loop; it should
+ *     return true to terminate looping, false to keep looping.
+ * Notes:
+ *   Unlike message_loop's timeout, which fires only when time passes with
+ *   no input or message, a timer fires on schedule however busy the loop.
+ *   At most message_MaxTimers timers may be set at once.  A timer may be
+ *   set before the loop, or from within any handler.  A one-shot timer is
+ *   removed when it fires, before its handler is called.
+ * Logs: errors in arguments or in setting the timer.
+ */
+int message_addTimer(const float interval, const bool periodic,
+                     bool (*handleTimer)(void *arg));
+
+/******************************************/
+/* message_cancelTimer: cancel a timer set with message_addTimer.
+ * Caller provides: the number message_addTimer returned.
+ * Function returns: nothing.
+ * Logs: errors in arguments.
+ */
+void message_cancelTimer(const int timer);
+
+/******************************************/
+/* message_watch: watch another file descriptor for input, within the loop.
+ * Caller provides:
+ *   a file descriptor (>= 0), such as an eventfd or a pipe,
+ *   a function to handle it having input (not NULL).
+ * Function returns:
+ *   true if the file descriptor is now watched; false on error.
+ * Handlers:
+ *   handleReady: provided the 'arg' given to message_loop; it should read
+ *     the input, and return true to terminate looping, false to keep looping.
+ * Notes:
+ *   At most message_MaxWatches file descriptors may be watched at once.
+ *   message_loop may then be called with all its other handlers NULL.
+ *   Another thread can thus wake the loop, by writing to a pipe or eventfd.
+ * Logs: errors in arguments.
+ */
+bool message_watch(const int fd, bool (*handleReady)(void *arg));
+
+/******************************************/
+/* message_unwatch: stop watching a file descriptor given to message_watch.
+ * Caller provides: the file descriptor.
+ * Function returns: nothing.
+ * Logs: errors in arguments.
+ */
+void message_unwatch(const int fd);
+
+/******************************************/
+/* message_openReceiver: open another socket, sharing our port.
+ * Caller provides: nothing.
+ * Function returns:
+ *   a socket (> 0) on which message_receive can receive messages sent to
+ *   our port; -1 on error, or if the platform lacks SO_REUSEPORT.
+ * Assumptions: message_initBackend() has already been called, asking
+ *   for receivers.
+ * Notes:
+ *   The kernel spreads the messages sent to our port among our socket and
+ *   all receiver sockets, each sender always to the same socket; so each
+ *   thread receiving on its own socket sees a sender's messages in order.
+ *   Replies are still sent, from our port, with message_send.
+ *   Call message_stopReceiver, then message_closeReceiver, when done.
+ * Logs: errors in opening the socket.
+ */
+int message_openReceiver(void);
+
+/******************************************/
+/* message_receive: wait for one message on a receiver socket.
+ * Caller provides:
+ *   a socket from message_openReceiver or message_openLocal, or 0 for
+ *   our own socket,
+ *   a buffer of at least message_MaxBytes chars, for the message,
+ *   a pointer to an address, which will be set to the sender's.
+ * Function returns:
+ *   the length of the message, which is null-terminated in the buffer;
+ *   -1 on error, or once message_stopReceiver has been called.
+ * Notes:
+ *   Unlike the rest of this module, this may be called from any thread;
+ *   each socket should have one receiving thread.  Messages from a
+ *   sender without an address to reply to are dropped.
+ * Logs: the sender of each message, but not its contents.
+ */
+int message_receive(const int sock, char *buf, addr_t *from);
+
+/******************************************/
+/* message_stopReceiver: wake any thread waiting in message_receive.
+ * Caller provides: a socket from message_openReceiver or
+ *   message_openLocal, or 0 for our own.
+ * Function returns: nothing.
+ * Notes: every later message_receive on that socket returns -1 at once;
+ *   our own socket can still send.
+ * Logs: nothing.
+ */
+void message_stopReceiver(const int sock);
+
+/******************************************/
+/* message_closeReceiver: close a socket from message_openReceiver,
+ * once no thread is receiving on it.
+ * Caller provides: the socket.
+ * Function returns: nothing.
+ * Logs: nothing.
+ */
+void message_closeReceiver(const int sock);
+
+/******************************************/
+/* message_openLocal: also receive, and send, through a Unix-domain
+ * datagram socket, for programs on this host.
+ * Caller provides:
+ *   the socket's name: a file's pathname; or, on Linux, "@" and a name in
+ *   the abstract namespace, which needs no file; or NULL, for a client
+ *   that speaks first, to take a name the kernel picks (Linux only).
+ * Function returns:
+ *   the socket (> 0), which message_loop then waits on along with our
+ *   UDP socket, and from which messages to Unix-domain addresses are
+ *   sent; -1 on error, e.g., if the name is in use.
+ * Assumptions: message_init() has already been called.
+ * Notes:
+ *   Messages between programs on one host through such a socket skip the
+ *   network stack; otherwise they are just like messages through UDP.
+ *   A program receiving with message_receive on its own threads may
+ *   receive on this socket too; it is not a receiver socket to close.
+ *   A socket given a pathname is removed at message_done.
+ * Logs: errors in opening the socket; the name.
+ */
+int message_openLocal(const char *name);
+
+/******************************************/
+/* message_openShared: exchange messages with a peer on this host through
+ * shared memory, rather than through sockets.
+ * Caller provides:
+ *   the Unix-domain address of a peer that has called message_openLocal,
+ *   and that runs message_loop (or message_loopBatch).
+ * Function returns:
+ *   true if the peer agreed, so that, from now on, message_send and the
+ *   like put messages for it in a ring of bytes in memory we share, and
+ *   message_loop takes its messages from another; false on error, or if
+ *   the peer declined, in which case we still use the socket.
+ * Assumptions:
+ *   message_openLocal() has already been called.  Linux only.
+ * Notes:
+ *   We make the memory, and two eventfds by which each side wakes the
+ *   other, and pass them to the peer over the Unix-domain socket; then
+ *   we wait up to a second for it to agree.  Call this before exchanging
+ *   other messages with the peer, for any received meanwhile are dropped.
+ *   The peer needs nothing more than message_openLocal to agree, up to
+ *   message_MaxChannels such peers at once.
+ *   As with a socket with no room, a message for a peer whose ring is
+ *   full waits in the peer's backlog (see message_send).
+ * Logs: errors; whether the peer agreed.
+ */
+bool message_openShared(const addr_t peer);
+
 /******************************************/
 /* message_done: shut down the module.
  * Caller provides: nothing.
@@ -158,6 +616,7 @@ bool message_loop(void *arg, const float timeout,
  * Assumptions:
  *   message_init() had been called earlier.
  *   no message() functions will be called later.
+ * Notes: any messages still held are sent first; any timers are cancelled.
  * Logs: a note indicating close down of message module.
  */
 void message_done(void);
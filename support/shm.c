@@ -0,0 +1,312 @@
+/*
+ * shm - a shared-memory transport behind the message module
+ *
+ * See shm.h for detailed interface description for each function.
+ *
+ * The region holds two rings of bytes: ring 0 carries messages from the
+ * client (who made the region) to the server, ring 1 the other way.
+ * Each message is an 8-byte header, holding its length, and the message,
+ * padded to 8 bytes; a message never wraps around the end of a ring,
+ * which instead holds a WrapMark telling the consumer to go back to the
+ * start.  'tail' counts the bytes ever put in a ring, and 'head' those
+ * ever taken out; only the producer stores the tail, and the consumer
+ * the head.
+ *
+ * A consumer that finds its ring empty goes back to waiting on its
+ * eventfd, so a producer must write that eventfd when it puts a message
+ * in a ring the consumer had emptied.  The producer stores the tail and
+ * then loads the head; the consumer stores the head and then loads the
+ * tail; with sequentially consistent atomics, either the producer sees
+ * that the ring had been emptied, and wakes the consumer, or the consumer
+ * sees the new message.
+ *
+ * The other process may be buggy or hostile, so we trust nothing it
+ * writes in the region: every length, head, and tail is checked before
+ * use, and the region is sealed so it cannot shrink under us.
+ *
+ * Team JEN, Winter 2021
+ */
+
+#ifdef __linux__        // the whole module; see shm.h
+
+#define _GNU_SOURCE     // for memfd_create and the file seals
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include "shm.h"
+
+/**************** file-local constants ****************/
+// bytes in each ring; a power of 2, and room for many a largest message
+#define RingBytes (1 << 20)
+static const uint32_t WrapMark = UINT32_MAX;   // length meaning "wrap"
+static const int HeaderSize = 8;               // bytes before each message
+
+/**************** file-local types ****************/
+/* ringhdr_t: the head and tail of a ring, in the region; each on a cache
+ * line of its own, so the producer and consumer do not contend for one.
+ */
+typedef struct ringhdr {
+  _Alignas(64) uint64_t tail;   // bytes ever put in, by the producer
+  _Alignas(64) uint64_t head;   // bytes ever taken out, by the consumer
+} ringhdr_t;
+
+/* region_t: the memory the two processes share.
+ */
+typedef struct region {
+  ringhdr_t hdr[2];             // 0: client to server; 1: server to client
+  char data[2][RingBytes];
+} region_t;
+
+typedef struct shm {
+  region_t *region;             // the shared memory
+  int memfd;                    // the region's file, kept to pass; or -1
+  ringhdr_t *out;               // the ring we put messages in
+  char *outData;
+  int outFd;                    // eventfd to wake the other side
+  ringhdr_t *in;                // the ring we take messages out of
+  char *inData;
+  int inFd;                     // eventfd the other side wakes us with
+  bool wake;                    // should shm_wake wake the other side?
+} shm_t;
+
+/**************** file-local functions ****************/
+static shm_t *shm_map(const int memfd, const bool client);
+static size_t padded(const size_t len);
+
+/**************** shm_new ****************/
+/* see shm.h for description */
+shm_t *
+shm_new(int fds[shm_Fds])
+{
+  int memfd = memfd_create("message", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (memfd < 0) {
+    return NULL;
+  }
+  // seal its size, so the server can trust the region to stay mapped
+  if (ftruncate(memfd, sizeof(region_t)) < 0
+      || fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0) {
+    close(memfd);
+    return NULL;
+  }
+  shm_t *shm = shm_map(memfd, true);
+  if (shm == NULL) {
+    close(memfd);
+    return NULL;
+  }
+  shm->outFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  shm->inFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (shm->outFd < 0 || shm->inFd < 0) {
+    shm_delete(shm);
+    return NULL;
+  }
+  fds[0] = memfd;
+  fds[1] = shm->outFd;  // wakes the server, for ring 0
+  fds[2] = shm->inFd;   // wakes us, for ring 1
+  return shm;
+}
+
+/**************** shm_attach ****************/
+/* see shm.h for description */
+shm_t *
+shm_attach(const int fds[shm_Fds])
+{
+  struct stat st;
+  int seals = fcntl(fds[0], F_GET_SEALS);
+  shm_t *shm = NULL;
+  if (fstat(fds[0], &st) == 0 && st.st_size == sizeof(region_t)
+      && seals >= 0 && (seals & F_SEAL_SHRINK) != 0) {
+    shm = shm_map(fds[0], false);
+  }
+  close(fds[0]);      // the mapping keeps the region
+  if (shm == NULL) {
+    close(fds[1]);
+    close(fds[2]);
+    return NULL;
+  }
+  shm->memfd = -1;
+  shm->inFd = fds[1];
+  shm->outFd = fds[2];
+  // never block on a descriptor the other side may not have made so
+  fcntl(shm->inFd, F_SETFL, O_NONBLOCK);
+  fcntl(shm->outFd, F_SETFL, O_NONBLOCK);
+  return shm;
+}
+
+/**************** shm_eventfd ****************/
+/* see shm.h for description */
+int
+shm_eventfd(const shm_t *shm)
+{
+  return shm->inFd;
+}
+
+/**************** shm_send ****************/
+/* see shm.h for description */
+bool
+shm_send(shm_t *shm, const struct iovec *iov, const int iovcnt)
+{
+  size_t len = 0;
+  for (int i = 0; i < iovcnt; i++) {
+    len += iov[i].iov_len;
+  }
+  if (len > message_MaxBytes - 1) {
+    return false;   // too long for the other side's buffers
+  }
+  uint64_t tail = shm->out->tail;     // ours alone to store
+  uint64_t head = __atomic_load_n(&shm->out->head, __ATOMIC_SEQ_CST);
+  if (tail - head > RingBytes) {
+    return false;   // corrupt
+  }
+
+  // the message goes after the tail, unless it would cross the end
+  size_t need = HeaderSize + padded(len);
+  size_t off = tail % RingBytes;
+  size_t skip = (RingBytes - off < need) ? RingBytes - off : 0;
+  if (tail + skip + need - head > RingBytes) {
+    return false;   // full
+  }
+  if (skip > 0) {
+    memcpy(shm->outData + off, &WrapMark, sizeof(WrapMark));
+    off = 0;
+  }
+  uint32_t len32 = len;
+  memcpy(shm->outData + off, &len32, sizeof(len32));
+  char *p = shm->outData + off + HeaderSize;
+  for (int i = 0; i < iovcnt; i++) {
+    memcpy(p, iov[i].iov_base, iov[i].iov_len);
+    p += iov[i].iov_len;
+  }
+  __atomic_store_n(&shm->out->tail, tail + skip + need, __ATOMIC_SEQ_CST);
+
+  // had the other side taken everything before it?  then it may be waiting
+  if (__atomic_load_n(&shm->out->head, __ATOMIC_SEQ_CST) == tail) {
+    shm->wake = true;
+  }
+  return true;
+}
+
+/**************** shm_wake ****************/
+/* see shm.h for description */
+void
+shm_wake(shm_t *shm)
+{
+  if (shm->wake) {
+    uint64_t one = 1;
+    if (write(shm->outFd, &one, sizeof(one)) < 0) {
+      // its counter is full, so it is readable anyway
+    }
+    shm->wake = false;
+  }
+}
+
+/**************** shm_receive ****************/
+/* see shm.h for description */
+int
+shm_receive(shm_t *shm, char *buf[], int nbytes[], const int max)
+{
+  // reset the eventfd first, so no wakeup is lost for a message put in
+  // the ring after we last look
+  uint64_t count;
+  if (read(shm->inFd, &count, sizeof(count)) < 0) {
+    // not signalled; look anyway
+  }
+
+  uint64_t head = shm->in->head;      // ours alone to store
+  int n = 0;
+  while (n < max) {
+    uint64_t tail = __atomic_load_n(&shm->in->tail, __ATOMIC_SEQ_CST);
+    if (tail == head) {
+      break;        // empty
+    }
+    size_t off = head % RingBytes;
+    uint32_t len;
+    memcpy(&len, shm->inData + off, sizeof(len));
+    size_t need = (len == WrapMark) ? RingBytes - off : HeaderSize + padded(len);
+    if (tail - head > RingBytes || tail - head < need || off + need > RingBytes
+        || (len != WrapMark && len > message_MaxBytes - 1)) {
+      return -1;    // corrupt
+    }
+    if (len != WrapMark) {
+      memcpy(buf[n], shm->inData + off + HeaderSize, len);
+      buf[n][len] = '\0';
+      nbytes[n] = len;
+      n++;
+    }
+    head += need;
+    __atomic_store_n(&shm->in->head, head, __ATOMIC_SEQ_CST);
+  }
+
+  // more than we could take: stay readable, for the next call
+  if (n == max && __atomic_load_n(&shm->in->tail, __ATOMIC_SEQ_CST) != head) {
+    uint64_t one = 1;
+    if (write(shm->inFd, &one, sizeof(one)) < 0) {
+      // its counter is full, so it is readable anyway
+    }
+  }
+  return n;
+}
+
+/**************** shm_delete ****************/
+/* see shm.h for description */
+void
+shm_delete(shm_t *shm)
+{
+  if (shm == NULL) {
+    return;
+  }
+  munmap(shm->region, sizeof(region_t));
+  if (shm->memfd >= 0) {
+    close(shm->memfd);
+  }
+  if (shm->outFd >= 0) {
+    close(shm->outFd);
+  }
+  if (shm->inFd >= 0) {
+    close(shm->inFd);
+  }
+  free(shm);
+}
+
+/**************** shm_map ****************/
+/* Map the region, and point at the rings: the client puts messages in
+ * ring 0, and the server in ring 1.  The eventfds are left to the caller.
+ */
+static shm_t *
+shm_map(const int memfd, const bool client)
+{
+  shm_t *shm = calloc(1, sizeof(shm_t));
+  if (shm == NULL) {
+    return NULL;
+  }
+  shm->region = mmap(NULL, sizeof(region_t), PROT_READ | PROT_WRITE,
+                     MAP_SHARED, memfd, 0);
+  if (shm->region == MAP_FAILED) {
+    free(shm);
+    return NULL;
+  }
+  shm->memfd = memfd;
+  shm->outFd = shm->inFd = -1;
+  int out = client ? 0 : 1;
+  shm->out = &shm->region->hdr[out];
+  shm->outData = shm->region->data[out];
+  shm->in = &shm->region->hdr[1 - out];
+  shm->inData = shm->region->data[1 - out];
+  return shm;
+}
+
+/**************** padded ****************/
+/* A message's length, padded to a multiple of 8 bytes.
+ */
+static size_t
+padded(const size_t len)
+{
+  return (len + 7) & ~(size_t) 7;
+}
+
+#endif // __linux__
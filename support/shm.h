@@ -0,0 +1,100 @@
+/*
+ * shm - a shared-memory transport behind the message module
+ *
+ * Two processes on one host exchange messages through a region of memory
+ * they share: a ring of bytes in each direction, each with one producer
+ * and one consumer, so a message passes with two copies and no system
+ * call but the eventfd write that wakes a consumer which has run dry.
+ * One side (the client) makes the region and the eventfds, with shm_new,
+ * and hands them to the other (the server), over a Unix-domain socket;
+ * the server maps them with shm_attach.
+ *
+ * Only message.c uses this module; see message_openShared in message.h.
+ * Linux only.
+ *
+ * Team JEN, Winter 2021
+ */
+
+#ifndef _SHM_H_
+#define _SHM_H_
+
+#include <stdbool.h>
+#include <sys/uio.h>
+#include "message.h"
+
+/****************** types *********************/
+typedef struct shm shm_t;  // opaque to users of the module
+
+/****************** constants *********************/
+// the file descriptors shm_new makes, for the other side's shm_attach:
+// the region, and the eventfds that signal each side of new messages
+#define shm_Fds 3
+
+/****************** functions *********************/
+
+/******************************************/
+/* shm_new: make a region, and the eventfds, for a pair of rings.
+ * Caller provides:
+ *   an array to be filled with the shm_Fds file descriptors to pass to the
+ *   other side; they stay ours, too, until shm_delete.
+ * Function returns:
+ *   the new shm; NULL on error.
+ * Caller expectations: call shm_delete later.
+ */
+shm_t *shm_new(int fds[shm_Fds]);
+
+/******************************************/
+/* shm_attach: map the region another process made with shm_new.
+ * Caller provides:
+ *   the shm_Fds file descriptors it passed us, which become ours.
+ * Function returns:
+ *   the shm; NULL if they are not such a region, or not one sealed
+ *   against being shrunk under us; then we have closed them.
+ * Caller expectations: call shm_delete later.
+ */
+shm_t *shm_attach(const int fds[shm_Fds]);
+
+/******************************************/
+/* shm_eventfd: an eventfd that becomes readable when messages arrive,
+ * for the caller to wait on with epoll; shm_receive resets it.
+ */
+int shm_eventfd(const shm_t *shm);
+
+/******************************************/
+/* shm_send: put a message, gathered from iovcnt buffers, in our ring.
+ * Function returns:
+ *   false if the ring is full, if the message is too long for the other
+ *   side's buffers (message_MaxBytes - 1 bytes, at most; see message_send,
+ *   which sends a longer one in fragments), or if the other side has
+ *   corrupted the ring.
+ * Notes:
+ *   The other side is not woken until shm_wake, so a burst of messages
+ *   costs one wakeup.
+ */
+bool shm_send(shm_t *shm, const struct iovec *iov, const int iovcnt);
+
+/******************************************/
+/* shm_wake: wake the other side, if it may be waiting for the messages
+ * sent since the last shm_wake.
+ */
+void shm_wake(shm_t *shm);
+
+/******************************************/
+/* shm_receive: copy up to 'max' messages out of the other side's ring.
+ * Caller provides:
+ *   arrays of 'max' buffers, each of message_MaxBytes chars, and of
+ *   'max' lengths, to fill in.
+ * Function returns:
+ *   the number of messages, each null-terminated, in order;
+ *   -1 if the other side has corrupted the ring.
+ * Notes:
+ *   If messages remain, the eventfd stays readable, for the next call.
+ */
+int shm_receive(shm_t *shm, char *buf[], int nbytes[], const int max);
+
+/******************************************/
+/* shm_delete: unmap the region, and close the eventfds.
+ */
+void shm_delete(shm_t *shm);
+
+#endif // _SHM_H_
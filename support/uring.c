@@ -0,0 +1,446 @@
+/*
+ * uring - an io_uring transport behind the message module
+ *
+ * See uring.h for detailed interface description for each function.
+ *
+ * The kernel shares three regions with us: the submission queue (SQ),
+ * where we put requests; the completion queue (CQ), where the kernel
+ * puts their results; and a ring of buffers we provide for receiving.
+ * We are the only producer of the SQ and the buffer ring, and the only
+ * consumer of the CQ; the kernel reads or writes the other end of each,
+ * so every head and tail we share with it is loaded with acquire and
+ * stored with release.
+ *
+ * Team JEN, Winter 2021
+ */
+
+#ifdef __linux__        // the whole module; see uring.h
+
+#define _GNU_SOURCE     // for syscall
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <linux/io_uring.h>
+#include "uring.h"
+
+/**************** file-local constants ****************/
+static const unsigned Entries = 64;   // entries in the submission queue
+static const int BufGroup = 0;        // id of our ring of buffers
+static const uint64_t RecvData = 0;   // user_data of the receive request;
+                                      // send i has user_data i + 1
+
+// buffers we provide for receiving; a power of 2
+#define NumBufs message_BatchSize
+
+/**************** file-local types ****************/
+typedef struct uring {
+  int fd;                       // the io_uring
+  int sock;                     // the socket we receive and send on
+  int efd;                      // eventfd signalled on each completion
+
+  // the submission queue
+  unsigned *sq_head, *sq_tail, *sq_array;
+  unsigned sq_mask, sq_entries;
+  struct io_uring_sqe *sqes;
+  // the completion queue
+  unsigned *cq_head, *cq_tail;
+  unsigned cq_mask;
+  struct io_uring_cqe *cqes;
+  // the memory mapped for them
+  void *sq_ring, *cq_ring;
+  size_t sq_ring_size, cq_ring_size, sqes_size;
+
+  // the buffers we provide for receiving, and the ring that hands them out
+  struct io_uring_buf_ring *br;
+  char *bufs;                   // NumBufs buffers of bufsize bytes
+  size_t bufsize;
+  struct msghdr recv_msg;       // the shape of each message received
+
+  bool receiving;               // should we be receiving?
+  bool armed;                   // is the multishot receive in place?
+  int pending[NumBufs];         // buffers received into, not yet collected
+  int npending;
+  int held[NumBufs];            // buffers collected, not yet recycled
+  int nheld;
+
+  int *results;                 // result of each send, during uring_send
+  int inflight;                 // sends not yet completed
+} uring_t;
+
+/**************** file-local functions ****************/
+static struct io_uring_sqe *get_sqe(uring_t *uring);
+static void commit_sqe(uring_t *uring);
+static int enter(uring_t *uring, const unsigned submit, const unsigned wait);
+static void reap(uring_t *uring);
+static void unmap(uring_t *uring);
+static struct timespec arrival(char *control, const size_t len);
+
+/**************** uring_new ****************/
+/* see uring.h for description */
+uring_t *
+uring_new(const int sock)
+{
+  uring_t *uring = calloc(1, sizeof(uring_t));
+  if (uring == NULL) {
+    return NULL;
+  }
+  uring->sock = sock;
+  uring->efd = -1;
+
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  uring->fd = syscall(__NR_io_uring_setup, Entries, &params);
+  if (uring->fd < 0) {
+    free(uring);
+    return NULL;    // no io_uring here
+  }
+
+  // map the queues; newer kernels put both rings in one mapping
+  uring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  uring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (single && uring->cq_ring_size > uring->sq_ring_size) {
+    uring->sq_ring_size = uring->cq_ring_size;
+  }
+  uring->sq_ring = mmap(NULL, uring->sq_ring_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQ_RING);
+  uring->cq_ring = single ? uring->sq_ring
+                 : mmap(NULL, uring->cq_ring_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_CQ_RING);
+  uring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  uring->sqes = mmap(NULL, uring->sqes_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQES);
+  if (uring->sq_ring == MAP_FAILED || uring->cq_ring == MAP_FAILED
+      || uring->sqes == MAP_FAILED) {
+    uring_delete(uring);
+    return NULL;
+  }
+  char *sq = uring->sq_ring;
+  uring->sq_head = (unsigned *) (sq + params.sq_off.head);
+  uring->sq_tail = (unsigned *) (sq + params.sq_off.tail);
+  uring->sq_array = (unsigned *) (sq + params.sq_off.array);
+  uring->sq_mask = *(unsigned *) (sq + params.sq_off.ring_mask);
+  uring->sq_entries = *(unsigned *) (sq + params.sq_off.ring_entries);
+  char *cq = uring->cq_ring;
+  uring->cq_head = (unsigned *) (cq + params.cq_off.head);
+  uring->cq_tail = (unsigned *) (cq + params.cq_off.tail);
+  uring->cq_mask = *(unsigned *) (cq + params.cq_off.ring_mask);
+  uring->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+
+  // provide buffers for receiving; each holds the io_uring_recvmsg_out
+  // header, the sender's address, and a message of up to
+  // message_MaxBytes-1 bytes, then the '\0' we add
+  uring->br = mmap(NULL, NumBufs * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (uring->br == MAP_FAILED) {
+    uring->br = NULL;
+    uring_delete(uring);
+    return NULL;
+  }
+  struct io_uring_buf_reg reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = (uint64_t) (uintptr_t) uring->br;
+  reg.ring_entries = NumBufs;
+  reg.bgid = BufGroup;
+  if (syscall(__NR_io_uring_register, uring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+    uring_delete(uring);
+    return NULL;    // kernel too old for provided buffer rings
+  }
+  // each buffer holds a header, the sender's name, room for the time
+  // the message arrived (see message_setTimestamps), and the message
+  uring->bufsize = sizeof(struct io_uring_recvmsg_out) + sizeof(addr_t)
+                 + CMSG_SPACE(sizeof(struct timespec)) + message_MaxBytes;
+  uring->bufs = malloc(NumBufs * uring->bufsize);
+  if (uring->bufs == NULL) {
+    uring_delete(uring);
+    return NULL;
+  }
+  for (int bid = 0; bid < NumBufs; bid++) {
+    uring->held[uring->nheld++] = bid;
+  }
+  uring_recycle(uring);
+  memset(&uring->recv_msg, 0, sizeof(uring->recv_msg));
+  uring->recv_msg.msg_namelen = sizeof(addr_t);
+  uring->recv_msg.msg_controllen = CMSG_SPACE(sizeof(struct timespec));
+
+  // signal an eventfd on each completion, for the caller's epoll
+  uring->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (uring->efd < 0
+      || syscall(__NR_io_uring_register, uring->fd, IORING_REGISTER_EVENTFD, &uring->efd, 1) < 0) {
+    uring_delete(uring);
+    return NULL;
+  }
+  return uring;
+}
+
+/**************** uring_eventfd ****************/
+/* see uring.h for description */
+int
+uring_eventfd(const uring_t *uring)
+{
+  return uring->efd;
+}
+
+/**************** uring_arm ****************/
+/* see uring.h for description */
+bool
+uring_arm(uring_t *uring)
+{
+  uring->receiving = true;
+  if (uring->armed) {
+    return true;
+  }
+  // one request receives message after message, each into a buffer the
+  // kernel takes from our ring, until it runs out of buffers
+  struct io_uring_sqe *sqe = get_sqe(uring);
+  if (sqe == NULL) {
+    return false;
+  }
+  sqe->opcode = IORING_OP_RECVMSG;
+  sqe->fd = uring->sock;
+  sqe->addr = (uint64_t) (uintptr_t) &uring->recv_msg;
+  sqe->len = 1;
+  sqe->msg_flags = MSG_TRUNC;           // report the length of a long message
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = BufGroup;
+  sqe->user_data = RecvData;
+  commit_sqe(uring);
+  if (enter(uring, 1, 0) < 0) {
+    return false;
+  }
+  uring->armed = true;
+  return true;
+}
+
+/**************** uring_receive ****************/
+/* see uring.h for description */
+int
+uring_receive(uring_t *uring, char *buf[], int len[], addr_t from[],
+              struct timespec when[], const int max)
+{
+  // reset the eventfd before we look, so no completion is left behind
+  uint64_t count;
+  if (read(uring->efd, &count, sizeof(count)) < 0) {
+    // not signalled; there may still be completions left from uring_send
+  }
+  reap(uring);
+
+  int n = 0;        // messages collected
+  int taken = 0;    // buffers taken from 'pending'
+  while (taken < uring->npending && n < max) {
+    int bid = uring->pending[taken++];
+    uring->held[uring->nheld++] = bid;
+    char *base = uring->bufs + bid * uring->bufsize;
+    struct io_uring_recvmsg_out *out = (struct io_uring_recvmsg_out *) base;
+    char *name = base + sizeof(*out);
+    char *control = name + uring->recv_msg.msg_namelen;
+    char *payload = control + uring->recv_msg.msg_controllen;
+    // a longer message is truncated, as recvmmsg would
+    size_t room = uring->bufsize - 1 - (payload - base);
+    size_t size = (out->payloadlen < room) ? out->payloadlen : room;
+    memcpy(&from[n], name, sizeof(addr_t));
+    when[n] = arrival(control, out->controllen);
+    payload[size] = '\0';
+    len[n] = size;
+    buf[n++] = payload;
+  }
+  uring->npending -= taken;
+  memmove(uring->pending, uring->pending + taken, uring->npending * sizeof(int));
+  return n;
+}
+
+/**************** uring_recycle ****************/
+/* see uring.h for description */
+void
+uring_recycle(uring_t *uring)
+{
+  // append the buffers at the tail of the ring; the tail overlays the
+  // 'resv' field of the first entry, so set each field, not the struct
+  uint16_t tail = uring->br->tail;
+  for (int i = 0; i < uring->nheld; i++) {
+    int bid = uring->held[i];
+    struct io_uring_buf *b = &uring->br->bufs[(uint16_t) (tail + i) & (NumBufs - 1)];
+    b->addr = (uint64_t) (uintptr_t) (uring->bufs + bid * uring->bufsize);
+    b->len = uring->bufsize - 1;    // room for the '\0' we add
+    b->bid = bid;
+  }
+  __atomic_store_n(&uring->br->tail, (uint16_t) (tail + uring->nheld), __ATOMIC_RELEASE);
+  uring->nheld = 0;
+
+  // the kernel ends the receive when it runs out of buffers; start again
+  if (uring->receiving && !uring->armed) {
+    uring_arm(uring);
+  }
+}
+
+/**************** uring_send ****************/
+/* see uring.h for description */
+void
+uring_send(uring_t *uring, const int n, struct msghdr msgs[], int result[])
+{
+  uring->results = result;
+  uring->inflight = 0;
+  int i = 0;      // next message to submit
+  while (i < n || uring->inflight > 0) {
+    // queue as many sends as the submission queue holds
+    unsigned queued = 0;
+    struct io_uring_sqe *sqe;
+    while (i < n && (sqe = get_sqe(uring)) != NULL) {
+      sqe->opcode = IORING_OP_SENDMSG;
+      sqe->fd = uring->sock;
+      sqe->addr = (uint64_t) (uintptr_t) &msgs[i];
+      sqe->len = 1;
+      sqe->msg_flags = MSG_DONTWAIT;        // fail, rather than wait for room
+      sqe->user_data = i + 1;
+      commit_sqe(uring);
+      uring->inflight++;
+      queued++;
+      i++;
+    }
+    // submit them, and wait for them, in one system call
+    if (enter(uring, queued, uring->inflight) < 0) {
+      for (int j = 0; j < n; j++) {
+        result[j] = -errno;
+      }
+      break;
+    }
+    reap(uring);
+  }
+  uring->results = NULL;
+}
+
+/**************** uring_delete ****************/
+/* see uring.h for description */
+void
+uring_delete(uring_t *uring)
+{
+  if (uring != NULL) {
+    // closing the io_uring also ends the receive
+    unmap(uring);
+    if (uring->fd >= 0) {
+      close(uring->fd);
+    }
+    if (uring->efd >= 0) {
+      close(uring->efd);
+    }
+    free(uring->bufs);
+    free(uring);
+  }
+}
+
+/**************** get_sqe ****************/
+/* Return the next free entry in the submission queue, cleared;
+ * NULL if the queue is full.  commit_sqe then hands it to the kernel.
+ */
+static struct io_uring_sqe *
+get_sqe(uring_t *uring)
+{
+  unsigned tail = *uring->sq_tail;
+  unsigned head = __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE);
+  if (tail - head >= uring->sq_entries) {
+    return NULL;
+  }
+  struct io_uring_sqe *sqe = &uring->sqes[tail & uring->sq_mask];
+  memset(sqe, 0, sizeof(*sqe));
+  return sqe;
+}
+
+/**************** commit_sqe ****************/
+/* Hand the entry from get_sqe to the kernel, at the next io_uring_enter.
+ */
+static void
+commit_sqe(uring_t *uring)
+{
+  unsigned tail = *uring->sq_tail;
+  uring->sq_array[tail & uring->sq_mask] = tail & uring->sq_mask;
+  __atomic_store_n(uring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/**************** enter ****************/
+/* Submit 'submit' entries, and wait for at least 'wait' completions.
+ * Return what io_uring_enter returns.
+ */
+static int
+enter(uring_t *uring, const unsigned submit, const unsigned wait)
+{
+  unsigned flags = (wait > 0) ? IORING_ENTER_GETEVENTS : 0;
+  int ret;
+  do {
+    ret = syscall(__NR_io_uring_enter, uring->fd, submit, wait, flags, NULL, 0);
+  } while (ret < 0 && errno == EINTR);
+  return ret;
+}
+
+/**************** reap ****************/
+/* Take every completion from the completion queue: note the result of
+ * each send, and keep each message received for uring_receive.
+ */
+static void
+reap(uring_t *uring)
+{
+  unsigned head = *uring->cq_head;
+  unsigned tail = __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE);
+  for (; head != tail; head++) {
+    struct io_uring_cqe *cqe = &uring->cqes[head & uring->cq_mask];
+    if (cqe->user_data == RecvData) {
+      if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        uring->armed = false;   // it ended; uring_recycle starts it again
+      }
+      if (cqe->res >= 0 && (cqe->flags & IORING_CQE_F_BUFFER)) {
+        uring->pending[uring->npending++] = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+      }
+    } else if (uring->results != NULL) {
+      uring->results[cqe->user_data - 1] = cqe->res;
+      uring->inflight--;
+    }
+  }
+  __atomic_store_n(uring->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/**************** arrival ****************/
+/* Return the time the kernel noted a message arriving, from the 'len'
+ * bytes of control messages received with it; zero if there is none.
+ */
+static struct timespec
+arrival(char *control, const size_t len)
+{
+  struct timespec when = { 0, 0 };
+  struct msghdr msg = { .msg_control = control, .msg_controllen = len };
+  for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+       cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+      memcpy(&when, CMSG_DATA(cmsg), sizeof(when));
+    }
+  }
+  return when;
+}
+
+/**************** unmap ****************/
+/* Unmap whatever uring_new mapped.
+ */
+static void
+unmap(uring_t *uring)
+{
+  if (uring->br != NULL && uring->br != MAP_FAILED) {
+    munmap(uring->br, NumBufs * sizeof(struct io_uring_buf));
+  }
+  if (uring->sqes != NULL && uring->sqes != MAP_FAILED) {
+    munmap(uring->sqes, uring->sqes_size);
+  }
+  if (uring->cq_ring != NULL && uring->cq_ring != MAP_FAILED
+      && uring->cq_ring != uring->sq_ring) {
+    munmap(uring->cq_ring, uring->cq_ring_size);
+  }
+  if (uring->sq_ring != NULL && uring->sq_ring != MAP_FAILED) {
+    munmap(uring->sq_ring, uring->sq_ring_size);
+  }
+}
+
+#endif // __linux__
@@ -0,0 +1,87 @@
+/*
+ * uring - an io_uring transport behind the message module
+ *
+ * Receives the messages sent to a socket with one multishot recvmsg,
+ * into buffers the kernel picks from a ring of buffers we provide, so no
+ * system call is needed per message; and sends a batch of messages with
+ * one io_uring_enter.  We make the system calls directly, without liburing.
+ *
+ * Only message.c uses this module; see message_initBackend in message.h.
+ * Linux only.
+ *
+ * Team JEN, Winter 2021
+ */
+
+#ifndef _URING_H_
+#define _URING_H_
+
+#include <stdbool.h>
+#include <sys/socket.h>
+#include "message.h"
+
+/****************** types *********************/
+typedef struct uring uring_t;  // opaque to users of the module
+
+/****************** functions *********************/
+
+/******************************************/
+/* uring_new: set up io_uring for a socket.
+ * Caller provides: the socket, already bound.
+ * Function returns:
+ *   the new uring; NULL if io_uring is unavailable here (an old kernel,
+ *   or one that disallows it), in which case the caller should fall back.
+ * Caller expectations: call uring_delete later.
+ */
+uring_t *uring_new(const int sock);
+
+/******************************************/
+/* uring_eventfd: an eventfd that becomes readable when operations
+ * complete, for the caller to wait on with epoll; we reset it ourselves.
+ */
+int uring_eventfd(const uring_t *uring);
+
+/******************************************/
+/* uring_arm: start receiving on the socket, if not already.
+ * Function returns: false on error.
+ */
+bool uring_arm(uring_t *uring);
+
+/******************************************/
+/* uring_receive: collect the messages received, without a system call.
+ * Caller provides:
+ *   arrays of 'max' message pointers, lengths, addresses, and arrival
+ *   times, to fill in; a time is zero unless the socket notes them
+ *   (SO_TIMESTAMPNS).
+ * Function returns:
+ *   the number of messages, null-terminated and in order of arrival;
+ *   they stay valid until uring_recycle.  A message may hold '\0', so
+ *   its length is that of the datagram, not of the string.
+ */
+int uring_receive(uring_t *uring, char *buf[], int len[], addr_t from[],
+                  struct timespec when[], const int max);
+
+/******************************************/
+/* uring_recycle: give the buffers of the last uring_receive back to the
+ * kernel, and start receiving again, if it had to stop for lack of them.
+ */
+void uring_recycle(uring_t *uring);
+
+/******************************************/
+/* uring_send: send n messages, submitted together, and wait for them.
+ * Caller provides:
+ *   the messages, as for sendmsg, and an array to hold each one's result:
+ *   bytes sent, or -errno.
+ * Notes:
+ *   All n are sent before we return, so the caller may then reuse the
+ *   buffers.  Messages received meanwhile are kept for uring_receive.
+ *   We do not wait for room in the socket: a message with none fails,
+ *   with -EAGAIN.
+ */
+void uring_send(uring_t *uring, const int n, struct msghdr msgs[], int result[]);
+
+/******************************************/
+/* uring_delete: stop receiving, and free everything.
+ */
+void uring_delete(uring_t *uring);
+
+#endif // _URING_H_